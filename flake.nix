@@ -63,6 +63,7 @@
         version = if self ? shortRev then self.shortRev else "dirty";
         src = self;
         cmakeFlags = [ "-DOVNI_GIT_COMMIT=${version}" ];
+        buildInputs = old.buildInputs ++ [ final.zlib ];
       });
       # Select correct ovni for libovni
       ovni = if (useLocalOvni) then final.ovniLocal else final.ovniFixed;
@@ -165,7 +166,7 @@
         pname = "ovni-armv7";
         buildInputs = [];
         nativeBuildInputs = [ pkgs.pkgsCross.armv7l-hf-multiplatform.buildPackages.cmake ];
-        cmakeFlags = old.cmakeFlags ++ [ "-DUSE_MPI=OFF" ];
+        cmakeFlags = old.cmakeFlags ++ [ "-DUSE_MPI=OFF" "-DUSE_ZLIB=OFF" ];
       })).overrideDerivation (old: {
         doCheck = true;
       });
@@ -174,7 +175,7 @@
         pname = "ovni-aarch64";
         buildInputs = [];
         nativeBuildInputs = [ pkgs.pkgsCross.aarch64-multiplatform.buildPackages.cmake ];
-        cmakeFlags = old.cmakeFlags ++ [ "-DUSE_MPI=OFF" ];
+        cmakeFlags = old.cmakeFlags ++ [ "-DUSE_MPI=OFF" "-DUSE_ZLIB=OFF" ];
       })).overrideDerivation (old: {
         doCheck = true;
       });
@@ -183,7 +184,7 @@
         pname = "ovni-riscv64";
         buildInputs = [];
         nativeBuildInputs = [ pkgs.pkgsCross.riscv64.buildPackages.cmake ];
-        cmakeFlags = old.cmakeFlags ++ [ "-DUSE_MPI=OFF" ];
+        cmakeFlags = old.cmakeFlags ++ [ "-DUSE_MPI=OFF" "-DUSE_ZLIB=OFF" ];
       })).overrideDerivation (old: {
         doCheck = true;
       });
@@ -6,6 +6,8 @@
 #include "compat.h"
 #include <errno.h>
 #include <features.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 /* Define gettid for older glibc versions (below 2.30) */
@@ -49,3 +51,11 @@ sleep_us(long usec)
 
 	return res;
 }
+
+/* There is no glibc wrapper for perf_event_open */
+int
+perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+		int group_fd, unsigned long flags)
+{
+	return (int) syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
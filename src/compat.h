@@ -6,7 +6,11 @@
 
 #include <time.h>
 
+struct perf_event_attr;
+
 pid_t get_tid(void);
 int sleep_us(long usec);
+int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+		int group_fd, unsigned long flags);
 
 #endif /* COMPAT_H */
@@ -0,0 +1,113 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "arena.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of each block, the larger objects get their own block */
+#define ARENA_BLOCK (1024 * 1024)
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	max_align_t data[];
+};
+
+void
+arena_init(struct arena *arena)
+{
+	memset(arena, 0, sizeof(struct arena));
+}
+
+static struct arena_block *
+new_block(struct arena *arena, size_t size)
+{
+	/* The memory comes zeroed, so the objects don't need to be */
+	struct arena_block *block = calloc(1, sizeof(struct arena_block) + size);
+	if (block == NULL)
+		return NULL;
+
+	block->size = size;
+	arena->nblocks++;
+
+	return block;
+}
+
+/** Allocates n objects of the given size set to zero, like calloc(3).
+ * Without an arena it just calls calloc(3), so the modules can be used
+ * alone. Returns NULL and sets errno on failure. */
+void *
+arena_calloc(struct arena *arena, size_t n, size_t size)
+{
+	if (arena == NULL)
+		return calloc(n, size);
+
+	if (size != 0 && n > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	size_t bytes = n * size;
+	size_t len = (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	struct arena_block *block = arena->blocks;
+
+	if (len > ARENA_BLOCK / 4) {
+		/* Keep the current block for the small objects */
+		struct arena_block *big = new_block(arena, len);
+		if (big == NULL)
+			return NULL;
+
+		big->used = len;
+		if (block != NULL) {
+			big->next = block->next;
+			block->next = big;
+		} else {
+			arena->blocks = big;
+		}
+		block = big;
+	} else {
+		if (block == NULL || block->size - block->used < len) {
+			block = new_block(arena, ARENA_BLOCK);
+			if (block == NULL)
+				return NULL;
+
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+		block->used += len;
+	}
+
+	arena->nobjects++;
+	arena->nbytes += bytes;
+
+	return (char *) block->data + block->used - len;
+}
+
+/** Frees an object allocated with arena_calloc(). The objects of an arena
+ * are only freed all together by arena_destroy(), so this only frees the
+ * ones allocated without an arena. */
+void
+arena_free(struct arena *arena, void *ptr)
+{
+	if (arena == NULL)
+		free(ptr);
+}
+
+/** Frees all the objects of the arena at once */
+void
+arena_destroy(struct arena *arena)
+{
+	struct arena_block *block = arena->blocks;
+	while (block != NULL) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+
+	arena_init(arena);
+}
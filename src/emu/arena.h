@@ -0,0 +1,27 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "common.h"
+
+/* Objects allocated during the emulator setup which live until the end,
+ * placed one after another in large blocks and freed all at once */
+
+struct arena_block;
+
+struct arena {
+	struct arena_block *blocks;
+	size_t nblocks;
+	size_t nobjects;
+	size_t nbytes; /* Requested by the objects */
+};
+
+        void arena_init(struct arena *arena);
+USE_RET void *arena_calloc(struct arena *arena, size_t n, size_t size);
+        void arena_free(struct arena *arena, void *ptr);
+        void arena_destroy(struct arena *arena);
+
+#endif /* ARENA_H */
@@ -4,11 +4,36 @@
 #include "bay.h"
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "chan.h"
 #include "common.h"
 #include "uthash.h"
 #include "utlist.h"
 
+/* Ensures there is a dirty list for the given level */
+static int
+grow_levels(struct bay *bay, int level)
+{
+	if (level < bay->nlevels)
+		return 0;
+
+	int n = level + 1;
+	struct bay_chan **dirty = realloc(bay->dirty,
+			(size_t) n * sizeof(struct bay_chan *));
+	if (dirty == NULL) {
+		err("realloc failed:");
+		return -1;
+	}
+
+	for (int i = bay->nlevels; i < n; i++)
+		dirty[i] = NULL;
+
+	bay->dirty = dirty;
+	bay->nlevels = n;
+
+	return 0;
+}
+
 /* Called from the channel when it becomes dirty */
 static int
 cb_chan_is_dirty(struct chan *chan, void *arg)
@@ -28,8 +53,21 @@ cb_chan_is_dirty(struct chan *chan, void *arg)
 		return -1;
 	}
 
-	dbg("adding dirty chan %s", chan->name);
-	DL_APPEND(bay->dirty, bchan);
+	/* A channel written from a callback without a declared dependency
+	 * may have a lower level, so it is appended to the level being
+	 * propagated, which is still processed. */
+	int level = bchan->level;
+	if (level < bay->level)
+		level = bay->level;
+
+	if (grow_levels(bay, level) != 0) {
+		err("grow_levels failed");
+		return -1;
+	}
+
+	dbg("adding dirty chan %s at level %d", chan->name, level);
+	DL_APPEND(bay->dirty[level], bchan);
+	bchan->is_dirty = 1;
 
 	return 0;
 }
@@ -63,7 +101,7 @@ bay_register(struct bay *bay, struct chan *chan)
 		return -1;
 	}
 
-	bchan = calloc(1, sizeof(struct bay_chan));
+	bchan = arena_calloc(bay->arena, 1, sizeof(struct bay_chan));
 	if (bchan == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -96,7 +134,7 @@ bay_add_cb(struct bay *bay, enum bay_cb_type type,
 		return NULL;
 	}
 
-	struct bay_cb *cb = calloc(1, sizeof(struct bay_cb));
+	struct bay_cb *cb = arena_calloc(bay->arena, 1, sizeof(struct bay_cb));
 
 	if (cb == NULL) {
 		err("calloc failed");
@@ -115,6 +153,9 @@ bay_add_cb(struct bay *bay, enum bay_cb_type type,
 	return cb;
 }
 
+/* The muxes may enable or disable the callbacks of a dirty channel, as
+ * they are only called by index they can be appended while the channel is
+ * being propagated. */
 void
 bay_enable_cb(struct bay_cb *cb)
 {
@@ -124,10 +165,24 @@ bay_enable_cb(struct bay_cb *cb)
 	cb->enabled = 1;
 
 	struct bay_chan *bchan = cb->bchan;
-	if (bchan->is_dirty)
-		die("cannot change callbacks of dirty bay channel");
-	DL_APPEND(bchan->cb[cb->type], cb);
-	bchan->ncallbacks[cb->type]++;
+	int type = cb->type;
+	int n = bchan->ncallbacks[type];
+
+	if (n >= bchan->maxcallbacks[type]) {
+		int max = bchan->maxcallbacks[type] ? 2 * n : 4;
+		struct bay_fn *fn = realloc(bchan->cb[type],
+				(size_t) max * sizeof(struct bay_fn));
+		if (fn == NULL)
+			die("realloc failed:");
+		bchan->cb[type] = fn;
+		bchan->maxcallbacks[type] = max;
+	}
+
+	struct bay_fn *fn = &bchan->cb[type][n];
+	fn->func = cb->func;
+	fn->arg = cb->arg;
+	fn->cb = cb;
+	bchan->ncallbacks[type]++;
 }
 
 void
@@ -139,10 +194,163 @@ bay_disable_cb(struct bay_cb *cb)
 	cb->enabled = 0;
 
 	struct bay_chan *bchan = cb->bchan;
-	if (bchan->is_dirty)
-		die("cannot change callbacks of dirty bay channel");
-	DL_DELETE(bchan->cb[cb->type], cb);
-	bchan->ncallbacks[cb->type]++;
+	int type = cb->type;
+	int n = bchan->ncallbacks[type];
+	struct bay_fn *fn = bchan->cb[type];
+
+	/* Keep the order of the remaining callbacks */
+	for (int i = 0; i < n; i++) {
+		if (fn[i].cb != cb)
+			continue;
+
+		memmove(&fn[i], &fn[i + 1],
+				(size_t) (n - i - 1) * sizeof(struct bay_fn));
+		bchan->ncallbacks[type]--;
+		return;
+	}
+
+	die("callback not found in channel %s", bchan->chan->name);
+}
+
+/** Disables the callback and frees it, so it is no longer usable */
+void
+bay_remove_cb(struct bay_cb *cb)
+{
+	struct bay *bay = cb->bchan->bay;
+	bay_disable_cb(cb);
+	arena_free(bay->arena, cb);
+}
+
+/* Raises the level of the output channels of the dependency and the ones
+ * they depend on, so they are propagated after the input channels. */
+static int
+raise_dep(struct bay_dep *dep, int level)
+{
+	if (dep->visiting) {
+		err("dependency cycle found in channel %s",
+				dep->out[0]->chan->name);
+		return -1;
+	}
+
+	if (dep->level >= level)
+		return 0;
+
+	if (grow_levels(dep->bay, level) != 0) {
+		err("grow_levels failed");
+		return -1;
+	}
+
+	dep->level = level;
+	dep->visiting = 1;
+
+	for (int64_t i = 0; i < dep->nout; i++) {
+		struct bay_chan *out = dep->out[i];
+		if (out->level >= level)
+			continue;
+
+		out->level = level;
+		for (int j = 0; j < out->ndeps; j++) {
+			if (raise_dep(out->deps[j], level + 1) != 0) {
+				err("cannot raise level of %s", out->chan->name);
+				dep->visiting = 0;
+				return -1;
+			}
+		}
+	}
+
+	dep->visiting = 0;
+
+	return 0;
+}
+
+/** Declares the output channels that the callbacks of the input channels of
+ * the dependency may write. The nout output channels must be contiguous in
+ * memory and already registered. */
+struct bay_dep *
+bay_add_dep(struct bay *bay, struct chan *out, int64_t nout)
+{
+	struct bay_dep *dep = arena_calloc(bay->arena, 1, sizeof(struct bay_dep));
+	if (dep == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	dep->out = arena_calloc(bay->arena, (size_t) nout, sizeof(struct bay_chan *));
+	if (dep->out == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	for (int64_t i = 0; i < nout; i++) {
+		struct bay_chan *bchan = find_bay_chan(bay, out[i].name);
+		if (bchan == NULL) {
+			err("cannot find channel %s in bay", out[i].name);
+			return NULL;
+		}
+		dep->out[i] = bchan;
+	}
+
+	dep->bay = bay;
+	dep->nout = nout;
+	LL_PREPEND(bay->deps, dep);
+
+	return dep;
+}
+
+/** Adds the channel as input of the dependency. Once the bay is compiled,
+ * the levels of the outputs are updated immediately. */
+int
+bay_dep_input(struct bay_dep *dep, struct chan *chan)
+{
+	struct bay_chan *bchan = find_bay_chan(dep->bay, chan->name);
+	if (bchan == NULL) {
+		err("cannot find channel %s in bay", chan->name);
+		return -1;
+	}
+
+	if (bchan->ndeps >= bchan->maxdeps) {
+		int max = bchan->maxdeps ? 2 * bchan->maxdeps : 2;
+		struct bay_dep **deps = realloc(bchan->deps,
+				(size_t) max * sizeof(struct bay_dep *));
+		if (deps == NULL) {
+			err("realloc failed:");
+			return -1;
+		}
+		bchan->deps = deps;
+		bchan->maxdeps = max;
+	}
+
+	bchan->deps[bchan->ndeps++] = dep;
+
+	if (dep->bay->is_compiled && raise_dep(dep, bchan->level + 1) != 0) {
+		err("cannot add %s as input", chan->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Assigns a level to each channel following the dependencies, so the
+ * channels are propagated in level order and each channel only runs its
+ * callbacks once all its inputs are updated. Fails if the dependencies
+ * have a cycle. */
+int
+bay_compile(struct bay *bay)
+{
+	for (struct bay_chan *bchan = bay->channels; bchan; bchan = bchan->hh.next) {
+		for (int j = 0; j < bchan->ndeps; j++) {
+			if (raise_dep(bchan->deps[j], bchan->level + 1) != 0) {
+				err("cannot compute level of %s", bchan->chan->name);
+				return -1;
+			}
+		}
+	}
+
+	bay->is_compiled = 1;
+
+	dbg("bay compiled with %d levels", bay->nlevels);
+
+	return 0;
 }
 
 void
@@ -152,6 +360,14 @@ bay_init(struct bay *bay)
 	bay->state = BAY_READY;
 }
 
+/** Allocates the channels, callbacks and dependencies from the arena,
+ * which must be set before registering any channel. */
+void
+bay_set_arena(struct bay *bay, struct arena *arena)
+{
+	bay->arena = arena;
+}
+
 static int
 propagate_chan(struct bay_chan *bchan, enum bay_cb_type type)
 {
@@ -165,11 +381,13 @@ propagate_chan(struct bay_chan *bchan, enum bay_cb_type type)
 	dbg("- propagating channel '%s' phase %s",
 			bchan->chan->name, propname[type]);
 
-	struct bay_cb *cur = NULL;
-	/* New callbacks cannot be added while propagating a bay_chan */
-	DL_FOREACH(bchan->cb[type], cur) {
-		dbg("calling cb %"PRIxPTR, (uintptr_t) cur->func);
-		if (cur->func(bchan->chan, cur->arg) != 0) {
+	/* The callbacks may be appended while running them, so the array
+	 * is accessed by index every time */
+	for (int i = 0; i < bchan->ncallbacks[type]; i++) {
+		bay_cb_func_t func = bchan->cb[type][i].func;
+		void *arg = bchan->cb[type][i].arg;
+		dbg("calling cb %"PRIxPTR, (uintptr_t) func);
+		if (func(bchan->chan, arg) != 0) {
 			err("callback failed for %s", bchan->chan->name);
 			return -1;
 		}
@@ -183,11 +401,16 @@ bay_propagate(struct bay *bay)
 {
 	struct bay_chan *cur;
 	bay->state = BAY_PROPAGATING;
-	DL_FOREACH(bay->dirty, cur) {
-		/* May add more dirty channels */
-		if (propagate_chan(cur, BAY_CB_DIRTY) != 0) {
-			err("propagate_chan failed");
-			return -1;
+
+	/* New levels may appear while propagating */
+	for (int level = 0; level < bay->nlevels; level++) {
+		bay->level = level;
+		DL_FOREACH(bay->dirty[level], cur) {
+			/* May add more dirty channels */
+			if (propagate_chan(cur, BAY_CB_DIRTY) != 0) {
+				err("propagate_chan failed");
+				return -1;
+			}
 		}
 	}
 
@@ -196,11 +419,13 @@ bay_propagate(struct bay *bay)
 	/* Once the dirty callbacks have been propagated,
 	 * begin the emit stage */
 	bay->state = BAY_EMITTING;
-	DL_FOREACH(bay->dirty, cur) {
-		/* Cannot add more dirty channels */
-		if (propagate_chan(cur, BAY_CB_EMIT) != 0) {
-			err("propagate_chan failed");
-			return -1;
+	for (int level = 0; level < bay->nlevels; level++) {
+		DL_FOREACH(bay->dirty[level], cur) {
+			/* Cannot add more dirty channels */
+			if (propagate_chan(cur, BAY_CB_EMIT) != 0) {
+				err("propagate_chan failed");
+				return -1;
+			}
 		}
 	}
 
@@ -210,15 +435,19 @@ bay_propagate(struct bay *bay)
 	 * callbacks, so we capture any potential double write when
 	 * running the callbacks */
 	bay->state = BAY_FLUSHING;
-	DL_FOREACH(bay->dirty, cur) {
-		if (chan_flush(cur->chan) != 0) {
-			err("chan_flush failed");
-			return -1;
+	for (int level = 0; level < bay->nlevels; level++) {
+		DL_FOREACH(bay->dirty[level], cur) {
+			if (chan_flush(cur->chan) != 0) {
+				err("chan_flush failed");
+				return -1;
+			}
+			cur->is_dirty = 0;
 		}
-		cur->is_dirty = 0;
+
+		bay->dirty[level] = NULL;
 	}
 
-	bay->dirty = NULL;
+	bay->level = 0;
 	bay->state = BAY_READY;
 
 	return 0;
@@ -1,4 +1,4 @@
-/* Copyright (c) 2021-2023 Barcelona Supercomputing Center (BSC)
+/* Copyright (c) 2021-2024 Barcelona Supercomputing Center (BSC)
  * SPDX-License-Identifier: GPL-3.0-or-later */
 
 #ifndef BAY_H
@@ -6,6 +6,7 @@
 
 #include "common.h"
 #include "uthash.h"
+struct arena;
 struct chan;
 
 /* Handle connections between channels and callbacks */
@@ -24,10 +25,27 @@ struct bay_cb {
 	struct bay_chan *bchan;
 	int enabled;
 	int type;
+};
+
+/* Copy of an enabled callback, stored contiguously in the channel */
+struct bay_fn {
+	bay_cb_func_t func;
+	void *arg;
+	struct bay_cb *cb;
+};
+
+/* Set of channels that the callbacks of other channels may write. All
+ * the output channels have the same level, which is higher than the
+ * level of any input channel. */
+struct bay_dep {
+	struct bay *bay;
+	struct bay_chan **out;
+	int64_t nout;
+	int level;
+	int visiting;
 
-	/* List of callbacks in one channel */
-	struct bay_cb *next;
-	struct bay_cb *prev;
+	/* List of dependencies in the bay */
+	struct bay_dep *next;
 };
 
 #define MAX_BAY_NAME 1024
@@ -35,10 +53,19 @@ struct bay_cb {
 struct bay_chan {
 	struct chan *chan;
 	int ncallbacks[BAY_CB_MAX];
-	struct bay_cb *cb[BAY_CB_MAX];
+	int maxcallbacks[BAY_CB_MAX];
+	struct bay_fn *cb[BAY_CB_MAX];
 	struct bay *bay;
 	int is_dirty;
 
+	/* Propagation order, channels only write into higher levels */
+	int level;
+
+	/* Dependencies written by the callbacks of this channel */
+	int ndeps;
+	int maxdeps;
+	struct bay_dep **deps;
+
 	/* Global hash table with all channels in bay */
 	UT_hash_handle hh;
 
@@ -58,7 +85,18 @@ enum bay_state {
 struct bay {
 	enum bay_state state;
 	struct bay_chan *channels;
-	struct bay_chan *dirty;
+	struct bay_dep *deps;
+	int is_compiled;
+
+	/* Setup objects, NULL to use calloc */
+	struct arena *arena;
+
+	/* One dirty list per level */
+	struct bay_chan **dirty;
+	int nlevels;
+
+	/* Level being propagated */
+	int level;
 };
 
         void bay_init(struct bay *bay);
@@ -69,6 +107,11 @@ USE_RET struct chan *bay_find(struct bay *bay, const char *name);
 USE_RET struct bay_cb *bay_add_cb(struct bay *bay, enum bay_cb_type type,
 		struct chan *chan, bay_cb_func_t func, void *arg, int enabled);
         void bay_enable_cb(struct bay_cb *cb);
+USE_RET struct bay_dep *bay_add_dep(struct bay *bay, struct chan *out, int64_t nout);
+USE_RET int bay_dep_input(struct bay_dep *dep, struct chan *chan);
+USE_RET int bay_compile(struct bay *bay);
+        void bay_set_arena(struct bay *bay, struct arena *arena);
         void bay_disable_cb(struct bay_cb *cb);
+        void bay_remove_cb(struct bay_cb *cb);
 
 #endif /* BAY_H */
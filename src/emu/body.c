@@ -27,6 +27,45 @@ struct body {
 	char name[256];
 };
 
+/* Number of bodies allocated at once */
+#define BODY_SLAB 1024
+
+/* Free bodies, shared by all tasks */
+static struct body *free_bodies;
+
+static struct body *
+alloc_body(void)
+{
+	if (free_bodies == NULL) {
+		struct body *slab = calloc(BODY_SLAB, sizeof(struct body));
+		if (slab == NULL) {
+			err("calloc failed:");
+			return NULL;
+		}
+
+		for (long i = 0; i < BODY_SLAB; i++)
+			LL_PREPEND(free_bodies, &slab[i]);
+	}
+
+	struct body *body = free_bodies;
+	LL_DELETE(free_bodies, body);
+	memset(body, 0, sizeof(struct body));
+
+	return body;
+}
+
+/** Releases all the bodies, which must not be in any stack, so they can be
+ * reused by other tasks. */
+void
+body_free_all(struct body_info *info)
+{
+	struct body *body, *tmp;
+	HASH_ITER(hh, info->bodies, body, tmp) {
+		HASH_DEL(info->bodies, body);
+		LL_PREPEND(free_bodies, body);
+	}
+}
+
 struct body *
 body_find(struct body_info *info, uint32_t body_id)
 {
@@ -54,10 +93,9 @@ body_create(struct body_info *info, struct task *task, uint32_t body_id, int fla
 		return NULL;
 	}
 
-	struct body *body = calloc(1, sizeof(struct body));
-
+	struct body *body = alloc_body();
 	if (body == NULL) {
-		err("calloc failed:");
+		err("alloc_body failed");
 		return NULL;
 	}
 
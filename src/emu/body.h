@@ -39,6 +39,7 @@ struct body_stack {
 
 USE_RET struct body *body_find(struct body_info *info, uint32_t body_id);
 USE_RET struct body *body_create(struct body_info *info, struct task *task, uint32_t body_id, int flags);
+        void body_free_all(struct body_info *info);
 
 USE_RET int body_execute(struct body_stack *stack, struct body *body);
 USE_RET int body_pause(struct body_stack *stack, struct body *body);
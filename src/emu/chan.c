@@ -80,7 +80,7 @@ chan_set(struct chan *chan, struct value value)
 	/* If duplicates are allowed just skip the check */
 	if (!chan->prop[CHAN_ALLOW_DUP]) {
 		if (value_is_equal(&chan->last_value, &value)) {
-			if (chan->prop[CHAN_IGNORE_DUP]) {
+			if (chan->prop[CHAN_IGNORE_DUP] || chan->prop[CHAN_IGNORE_UNMATCHED]) {
 				dbg("%s: value already set to %s",
 						chan->name, value_str(value));
 				return 0;
@@ -125,7 +125,7 @@ chan_push(struct chan *chan, struct value value)
 	/* If duplicates are allowed just skip the check */
 	if (!chan->prop[CHAN_ALLOW_DUP]) {
 		if (value_is_equal(&chan->last_value, &value)) {
-			if (chan->prop[CHAN_IGNORE_DUP]) {
+			if (chan->prop[CHAN_IGNORE_DUP] || chan->prop[CHAN_IGNORE_UNMATCHED]) {
 				dbg("%s: value already set to %s",
 						chan->name, value_str(value));
 				return 0;
@@ -157,6 +157,10 @@ chan_push(struct chan *chan, struct value value)
 /** Remove one value from the stack. Fails if the top of the stack
  * doesn't match the expected value.
  *
+ * With CHAN_IGNORE_UNMATCHED, the pop of a value not in the stack is
+ * ignored, and the values above the expected one are discarded, as their
+ * pops may have been lost.
+ *
  *  @param evalue The expected value on the top of the stack.
  *
  *  @return On success returns 0, otherwise returns -1.
@@ -177,6 +181,12 @@ chan_pop(struct chan *chan, struct value evalue)
 	struct chan_stack *stack = &chan->data.stack;
 
 	if (stack->n <= 0) {
+		if (chan->prop[CHAN_IGNORE_UNMATCHED]) {
+			dbg("%s: ignoring pop of %s from empty stack",
+					chan->name, value_str(evalue));
+			return 0;
+		}
+
 		err("%s: channel stack empty", chan->name);
 		return -1;
 	}
@@ -184,11 +194,27 @@ chan_pop(struct chan *chan, struct value evalue)
 	struct value *value = &stack->values[stack->n - 1];
 
 	if (!value_is_equal(value, &evalue)) {
-		err("%s: expected value %s different from top of stack %s",
-				chan->name,
-				value_str(evalue),
-				value_str(*value));
-		return -1;
+		if (!chan->prop[CHAN_IGNORE_UNMATCHED]) {
+			err("%s: expected value %s different from top of stack %s",
+					chan->name,
+					value_str(evalue),
+					value_str(*value));
+			return -1;
+		}
+
+		int i = stack->n - 2;
+		while (i >= 0 && !value_is_equal(&stack->values[i], &evalue))
+			i--;
+
+		if (i < 0) {
+			dbg("%s: ignoring pop of %s not in the stack",
+					chan->name, value_str(evalue));
+			return 0;
+		}
+
+		dbg("%s: discarding %d values above %s",
+				chan->name, stack->n - 1 - i, value_str(evalue));
+		stack->n = i + 1;
 	}
 
 	stack->n--;
@@ -21,6 +21,7 @@ enum chan_prop {
 	CHAN_DIRTY_WRITE = 0,
 	CHAN_ALLOW_DUP,
 	CHAN_IGNORE_DUP,
+	CHAN_IGNORE_UNMATCHED, /* Tolerate the lost pushes and pops */
 	CHAN_MAXPROP,
 };
 
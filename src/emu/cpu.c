@@ -179,45 +179,49 @@ cpu_add_to_pcf_type(struct cpu *cpu, struct pcf_type *type)
 	return pcf_add_value(type, (int) cpu->gindex + 1, cpu->name);
 }
 
-static struct thread *
-find_thread(struct cpu *cpu, struct thread *thread)
+static void
+set_running(struct cpu *cpu, struct thread *th, int running)
 {
-	struct thread *p = NULL;
+	/* The prev pointer is never NULL while in the list */
+	int in_list = (th->run_prev != NULL);
+
+	if (running && !in_list) {
+		DL_APPEND2(cpu->run_threads, th, run_prev, run_next);
+		cpu->nth_running++;
+	} else if (!running && in_list) {
+		DL_DELETE2(cpu->run_threads, th, run_prev, run_next);
+		th->run_prev = th->run_next = NULL;
+		cpu->nth_running--;
+	}
+}
 
-	/* TODO use hash table */
-	DL_FOREACH2(cpu->threads, p, cpu_next)
-	{
-		if (p == thread)
-			return p;
+static void
+set_active(struct cpu *cpu, struct thread *th, int active)
+{
+	int in_list = (th->act_prev != NULL);
+
+	if (active && !in_list) {
+		DL_APPEND2(cpu->act_threads, th, act_prev, act_next);
+		cpu->nth_active++;
+	} else if (!active && in_list) {
+		DL_DELETE2(cpu->act_threads, th, act_prev, act_next);
+		th->act_prev = th->act_next = NULL;
+		cpu->nth_active--;
 	}
+}
 
-	return NULL;
+/* Moves the thread in or out of the running and active lists of the CPU
+ * to follow its state, so the counters don't need to be recomputed. */
+void
+cpu_update_thread(struct cpu *cpu, struct thread *th)
+{
+	set_running(cpu, th, th->is_running);
+	set_active(cpu, th, th->is_active);
 }
 
 int
 cpu_update(struct cpu *cpu)
 {
-	struct thread *th = NULL;
-	struct thread *th_running = NULL;
-	struct thread *th_active = NULL;
-	int active = 0, running = 0;
-
-	DL_FOREACH2(cpu->threads, th, cpu_next)
-	{
-		if (th->state == TH_ST_RUNNING) {
-			th_running = th;
-			running++;
-			th_active = th;
-			active++;
-		} else if (th->state == TH_ST_COOLING || th->state == TH_ST_WARMING) {
-			th_active = th;
-			active++;
-		}
-	}
-
-	cpu->nth_running = (size_t) running;
-	cpu->nth_active = (size_t) active;
-
 	/* Only virtual cpus can be oversubscribed */
 	if (cpu->nth_running > 1 && !cpu->is_virtual) {
 		err("physical cpu %s has %zd threads running at the same time",
@@ -225,53 +229,74 @@ cpu_update(struct cpu *cpu)
 		return -1;
 	}
 
+	struct thread *th_running = NULL;
+	if (cpu->nth_running == 1)
+		th_running = cpu->run_threads;
+
+	struct thread *th_active = NULL;
+	if (cpu->nth_active == 1)
+		th_active = cpu->act_threads;
+
+	/* The channels only depend on these, skip them if none changed */
+	if (cpu->is_updated
+			&& cpu->upd_running == cpu->nth_running
+			&& cpu->th_running == th_running
+			&& cpu->th_active == th_active)
+		return 0;
+
+	cpu->is_updated = 1;
+	cpu->upd_running = cpu->nth_running;
+
 	struct value tid_running;
 	struct value pid_running;
 	struct value gid_running;
-	if (running == 1) {
-		cpu->th_running = th_running;
+	if (th_running != NULL) {
 		tid_running = value_int64(th_running->tid);
 		pid_running = value_int64(th_running->proc->pid);
 		gid_running = value_int64(th_running->gindex);
 	} else {
-		cpu->th_running = NULL;
 		tid_running = value_null();
 		pid_running = value_null();
 		gid_running = value_null();
 	}
 
-	if (chan_set(&cpu->chan[CPU_CHAN_TID], tid_running) != 0) {
-		err("chan_set tid failed");
-		return -1;
-	}
-	if (chan_set(&cpu->chan[CPU_CHAN_PID], pid_running) != 0) {
-		err("chan_set pid failed");
-		return -1;
-	}
-	dbg("cpu%"PRIi64" sets th_running to %s",
-			cpu->gindex, value_str(gid_running));
-	if (chan_set(&cpu->chan[CPU_CHAN_THRUN], gid_running) != 0) {
-		err("chan_set gid_running failed");
-		return -1;
-	}
+	if (cpu->th_running != th_running) {
+		cpu->th_running = th_running;
 
-	struct value gid_active;
-	if (active == 1) {
-		cpu->th_active = th_active;
-		gid_active = value_int64(th_active->gindex);
-	} else {
-		cpu->th_active = NULL;
-		gid_active = value_null();
+		if (chan_set(&cpu->chan[CPU_CHAN_TID], tid_running) != 0) {
+			err("chan_set tid failed");
+			return -1;
+		}
+		if (chan_set(&cpu->chan[CPU_CHAN_PID], pid_running) != 0) {
+			err("chan_set pid failed");
+			return -1;
+		}
+		dbg("cpu%"PRIi64" sets th_running to %s",
+				cpu->gindex, value_str(gid_running));
+		if (chan_set(&cpu->chan[CPU_CHAN_THRUN], gid_running) != 0) {
+			err("chan_set gid_running failed");
+			return -1;
+		}
 	}
 
 	/* Update nth_running number in the channel */
-	if (chan_set(&cpu->chan[CPU_CHAN_NRUN], value_int64((int64_t) running)) != 0) {
+	int64_t running = (int64_t) cpu->nth_running;
+	if (chan_set(&cpu->chan[CPU_CHAN_NRUN], value_int64(running)) != 0) {
 		err("chan_set nth_running failed");
 		return -1;
 	}
-	if (chan_set(&cpu->chan[CPU_CHAN_THACT], gid_active) != 0) {
-		err("chan_set gid_active failed");
-		return -1;
+
+	if (cpu->th_active != th_active) {
+		cpu->th_active = th_active;
+
+		struct value gid_active = value_null();
+		if (th_active != NULL)
+			gid_active = value_int64(th_active->gindex);
+
+		if (chan_set(&cpu->chan[CPU_CHAN_THACT], gid_active) != 0) {
+			err("chan_set gid_active failed");
+			return -1;
+		}
 	}
 
 	return 0;
@@ -281,14 +306,16 @@ cpu_update(struct cpu *cpu)
 int
 cpu_add_thread(struct cpu *cpu, struct thread *thread)
 {
-	if (find_thread(cpu, thread) != NULL) {
+	if (thread->cpu_owner != NULL) {
 		err("thread %d already assigned to %s",
-				thread->tid, cpu->name);
+				thread->tid, thread->cpu_owner->name);
 		return -1;
 	}
 
 	DL_APPEND2(cpu->threads, thread, cpu_prev, cpu_next);
 	cpu->nthreads++;
+	thread->cpu_owner = cpu;
+	cpu_update_thread(cpu, thread);
 
 	if (cpu_update(cpu) != 0) {
 		err("cpu_update failed");
@@ -301,17 +328,19 @@ cpu_add_thread(struct cpu *cpu, struct thread *thread)
 int
 cpu_remove_thread(struct cpu *cpu, struct thread *thread)
 {
-	struct thread *t = find_thread(cpu, thread);
-
 	/* Not found, abort */
-	if (t == NULL) {
+	if (thread->cpu_owner != cpu) {
 		err("cannot remove missing thread %d from cpu %s",
 				thread->tid, cpu->name);
 		return -1;
 	}
 
+	set_running(cpu, thread, 0);
+	set_active(cpu, thread, 0);
+
 	DL_DELETE2(cpu->threads, thread, cpu_prev, cpu_next);
 	cpu->nthreads--;
+	thread->cpu_owner = NULL;
 
 	if (cpu_update(cpu) != 0) {
 		err("cpu_update failed");
@@ -44,9 +44,15 @@ struct cpu {
 	size_t nth_running;
 	size_t nth_active;
 	struct thread *threads; /* List of threads assigned to this CPU */
+	struct thread *run_threads; /* Assigned threads running */
+	struct thread *act_threads; /* Assigned threads running, cooling or warming */
 	struct thread *th_running; /* Unique thread or NULL */
 	struct thread *th_active; /* Unique thread or NULL */
 
+	/* Number of running threads last written by cpu_update() */
+	int is_updated;
+	size_t upd_running;
+
 	int is_virtual;
 
 	/* Loom list sorted by phyid */
@@ -78,6 +84,7 @@ USE_RET int cpu_update(struct cpu *cpu);
 USE_RET int cpu_add_thread(struct cpu *cpu, struct thread *thread);
 USE_RET int cpu_remove_thread(struct cpu *cpu, struct thread *thread);
 USE_RET int cpu_migrate_thread(struct cpu *cpu, struct thread *thread, struct cpu *newcpu);
+        void cpu_update_thread(struct cpu *cpu, struct thread *thread);
 
 USE_RET struct chan *cpu_get_th_chan(struct cpu *cpu);
 USE_RET struct pcf_value *cpu_add_to_pcf_type(struct cpu *cpu, struct pcf_type *type);
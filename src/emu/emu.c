@@ -6,14 +6,29 @@
 #include "emu_ev.h"
 #include "models.h"
 #include "stream.h"
+#include "task.h"
 
 int
 emu_init(struct emu *emu, int argc, char *argv[])
 {
 	memset(emu, 0, sizeof(*emu));
+	arena_init(&emu->arena);
 
 	emu_args_init(&emu->args, argc, argv);
 
+	stream_set_limits(emu->args.max_mapped, emu->args.max_fds);
+	if (emu->args.prefetch >= 0)
+		stream_set_prefetch(emu->args.prefetch);
+
+	/* Keep the ended tasks to detect if they run again */
+	task_set_reclaim(!emu->args.linter_mode);
+
+	/* The PRV timestamps cannot be shifted per thread */
+	if (emu->args.compensate && !emu->args.summary) {
+		err("the overhead compensation requires the summary mode");
+		return -1;
+	}
+
 	/* Load the streams into the trace */
 	if (trace_load(&emu->trace, emu->args.tracedir) != 0) {
 		err("cannot load trace '%s'", emu->args.tracedir);
@@ -27,14 +42,51 @@ emu_init(struct emu *emu, int argc, char *argv[])
 		return -1;
 	}
 
+	model_init(&emu->model);
+
+	/* Register all the models */
+	if (models_register(&emu->model) != 0) {
+		err("failed to register models");
+		return -1;
+	}
+
+	if (emu->args.models != NULL && model_select(&emu->model, emu->args.models) != 0) {
+		err("model_select failed");
+		return -1;
+	}
+
+	/* Leave out the configurations of the excluded models */
+	const char *skip_cfg[MAX_MODELS + 1];
+	int nskip = 0;
+	for (int i = 0; i < MAX_MODELS; i++) {
+		if (emu->model.excluded[i])
+			skip_cfg[nskip++] = emu->model.spec[i]->name;
+	}
+	skip_cfg[nskip] = NULL;
+
 	/* Place output inside the same tracedir directory */
-	if (recorder_init(&emu->recorder, emu->args.tracedir) != 0) {
+	if (recorder_init(&emu->recorder, emu->args.tracedir, skip_cfg,
+				emu->args.summary) != 0) {
 		err("recorder_init failed");
 		return -1;
 	}
 
+	recorder_set_arena(&emu->recorder, &emu->arena);
+
+	if (emu->args.compress > 0 && recorder_compress(&emu->recorder, emu->args.compress) != 0) {
+		err("recorder_compress failed");
+		return -1;
+	}
+
+	if (recorder_load_profile(&emu->recorder, emu->args.profile,
+				emu->args.profile_rules) != 0) {
+		err("recorder_load_profile failed");
+		return -1;
+	}
+
 	/* Initialize the bay */
 	bay_init(&emu->bay);
+	bay_set_arena(&emu->bay, &emu->arena);
 
 	/* Connect system channels to bay */
 	if (system_connect(&emu->system, &emu->bay, &emu->recorder) != 0) {
@@ -42,17 +94,15 @@ emu_init(struct emu *emu, int argc, char *argv[])
 		return -1;
 	}
 
-	if (player_init(&emu->player, &emu->trace, 0) != 0) {
-		err("cannot init player for trace '%s'",
-				emu->args.tracedir);
+	if (overhead_init(&emu->overhead, &emu->system, &emu->recorder,
+				emu->args.compensate) != 0) {
+		err("overhead_init failed");
 		return -1;
 	}
 
-	model_init(&emu->model);
-
-	/* Register all the models */
-	if (models_register(&emu->model) != 0) {
-		err("failed to register models");
+	if (player_init(&emu->player, &emu->trace, 0) != 0) {
+		err("cannot init player for trace '%s'",
+				emu->args.tracedir);
 		return -1;
 	}
 
@@ -79,6 +129,18 @@ emu_connect(struct emu *emu)
 		return -1;
 	}
 
+	/* The labels of the connected rows and types are final now */
+	if (recorder_flush(&emu->recorder) != 0) {
+		err("recorder_flush failed");
+		return -1;
+	}
+
+	/* The channel graph is complete, so sort the channels by level */
+	if (bay_compile(&emu->bay) != 0) {
+		err("bay_compile failed");
+		return -1;
+	}
+
 	/* Run a propagation phase so we clean all the dirty channels, in
 	 * particular the select channel of the muxes */
 	if (bay_propagate(&emu->bay) != 0) {
@@ -151,6 +213,12 @@ emu_step(struct emu *emu)
 		return -1;
 	}
 
+	/* Drop the events of the excluded models before any processing */
+	if (emu->model.excluded[player_ev(&emu->player)->m]) {
+		emu->model.ndropped++;
+		return 0;
+	}
+
 	if (set_current(emu) != 0) {
 		err("cannot set current event information");
 		return -1;
@@ -166,6 +234,12 @@ emu_step(struct emu *emu)
 		return -1;
 	}
 
+	/* The kernel events come from perf, not emitted by the thread */
+	if (emu->ev->m != 'K' && overhead_event(&emu->overhead, emu->thread, emu->ev->dclock) != 0) {
+		err("overhead_event failed");
+		return -1;
+	}
+
 	/* Otherwise progress */
 	if (model_event(&emu->model, emu, emu->ev->m) != 0) {
 		err("model_event failed");
@@ -187,7 +261,20 @@ emu_finish(struct emu *emu)
 {
 	emu_stat_report(&emu->stat, &emu->player, 1);
 
+	if (emu->model.ndropped > 0) {
+		info("dropped %"PRIi64" events of excluded models",
+				emu->model.ndropped);
+	}
+
+	task_print_stats();
+
 	int ret = 0;
+
+	if (overhead_finish(&emu->overhead, &emu->system, emu->args.tracedir) != 0) {
+		err("overhead_finish failed");
+		ret = -1;
+	}
+
 	if (model_finish(&emu->model, emu) != 0) {
 		err("model_finish failed");
 		ret = -1;
@@ -199,5 +286,12 @@ emu_finish(struct emu *emu)
 		ret = -1;
 	}
 
+	info("setup objects: %zu in %zu blocks (%.1f MiB)",
+			emu->arena.nobjects, emu->arena.nblocks,
+			(double) emu->arena.nbytes / (1024.0 * 1024.0));
+
+	/* No channel can be used from here on */
+	arena_destroy(&emu->arena);
+
 	return ret;
 }
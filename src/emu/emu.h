@@ -4,12 +4,14 @@
 #ifndef EMU_H
 #define EMU_H
 
+#include "arena.h"
 #include "bay.h"
 #include "common.h"
 #include "emu_args.h"
 #include "emu_stat.h"
 #include "extend.h"
 #include "model.h"
+#include "overhead.h"
 #include "player.h"
 #include "recorder.h"
 #include "system.h"
@@ -18,6 +20,9 @@
 struct emu {
 	struct bay bay;
 
+	/* Objects created in the setup, freed at the end */
+	struct arena arena;
+
 	struct emu_args args;
 	struct trace trace;
 	struct system system;
@@ -25,6 +30,7 @@ struct emu {
 	struct model model;
 	struct recorder recorder;
 	struct emu_stat stat;
+	struct overhead overhead;
 
 	int finished;
 
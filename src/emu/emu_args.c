@@ -7,6 +7,7 @@
 #include "ovni.h"
 #include "path.h"
 #include "models.h"
+#include <limits.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
@@ -19,22 +20,59 @@ usage(void)
 {
 	rerr("%s -- version %s\n", progname, version);
 	rerr("\n");
-	rerr("Usage: %s [-c offsetfile] [-abdlh] tracedir\n", progname);
+	rerr("Usage: %s [-c offsetfile] [-m maxmem] [-f maxfiles] [-p prefetch] [-M models] [-o profile] [-O rules] [-z nworkers] [-H metrics] [-abdlsh] tracedir\n", progname);
 	rerr("\n");
 	rerr("Options:\n");
 	rerr("  -c offsetfile      Use the given offset file to correct\n");
 	rerr("                     the clocks among nodes. It can be\n");
 	rerr("                     generated by the ovnisync program\n");
 	rerr("\n");
+	rerr("  -m maxmem          Limit the memory mapped from the streams\n");
+	rerr("                     to maxmem MiB (default 4096)\n");
+	rerr("\n");
+	rerr("  -f maxfiles        Limit the number of stream files kept\n");
+	rerr("                     open (default 256)\n");
+	rerr("\n");
+	rerr("  -p prefetch        Read prefetch MiB ahead of each stream\n");
+	rerr("                     in the background, 0 to disable (default 4)\n");
+	rerr("\n");
+	rerr("  -M models          Only emulate the given comma separated\n");
+	rerr("                     list of models, the events of the rest\n");
+	rerr("                     are discarded. The ovni model is always\n");
+	rerr("                     emulated\n");
+	rerr("\n");
+	rerr("  -o profile         Only write the PRV types and rows\n");
+	rerr("                     selected in the output profile file\n");
+	rerr("\n");
+	rerr("  -O rules           Same as -o, with the profile rules\n");
+	rerr("                     given inline separated by ';'\n");
+	rerr("\n");
+	rerr("  -z nworkers        Write the PRV files compressed with gzip\n");
+	rerr("                     using nworkers threads (0 for the number\n");
+	rerr("                     of CPUs)\n");
+	rerr("\n");
+	rerr("  -H metrics         Compute the given nOS-V hardware counter\n");
+	rerr("                     metrics, separated by ';', each with the\n");
+	rerr("                     form NAME=NUM/DEN[*MUL] where NUM and DEN\n");
+	rerr("                     are counter names or 'ns' for the time\n");
+	rerr("\n");
 	rerr("  -a                 Enable all models (experimental)\n");
 	rerr("\n");
 	rerr("  -b                 Enable breakdown model (experimental)\n");
 	rerr("\n");
 	rerr("  -d                 Enable debug output (very verbose)\n");
 	rerr("\n");
+	rerr("  -k                 Subtract the instrumentation overhead\n");
+	rerr("                     of each thread from the summary of the\n");
+	rerr("                     threads and CPUs, requires -s\n");
+	rerr("\n");
 	rerr("  -l                 Enable linter mode. Extra tests will\n");
 	rerr("                     be performed.\n");
 	rerr("\n");
+	rerr("  -s                 Summary mode. Only write the time spent\n");
+	rerr("                     in each value of the channels per row,\n");
+	rerr("                     process and in total, no PRV files\n");
+	rerr("\n");
 	rerr("  -h                 Show help.\n");
 	rerr("\n");
 	rerr("  tracedir           The output trace dir generated by ovni.\n");
@@ -47,17 +85,70 @@ usage(void)
 	exit(EXIT_FAILURE);
 }
 
+static int64_t
+parse_positive(const char *arg)
+{
+	char *end = NULL;
+	long long n = strtoll(arg, &end, 10);
+
+	if (end == arg || *end != '\0' || n <= 0 || n > INT_MAX) {
+		err("invalid number: %s", arg);
+		usage();
+	}
+
+	return n;
+}
+
 void
 emu_args_init(struct emu_args *args, int argc, char *argv[])
 {
 	memset(args, 0, sizeof(struct emu_args));
+	args->prefetch = -1;
 
 	int opt;
-	while ((opt = getopt(argc, argv, "abdc:lh")) != -1) {
+	while ((opt = getopt(argc, argv, "abdc:klm:f:p:M:o:O:z:H:sh")) != -1) {
 		switch (opt) {
 			case 'c':
 				args->clock_offset_file = optarg;
 				break;
+			case 'm':
+				args->max_mapped = parse_positive(optarg) << 20;
+				break;
+			case 'f':
+				args->max_fds = (int) parse_positive(optarg);
+				break;
+			case 'p':
+				/* Allow zero to disable it */
+				if (strcmp(optarg, "0") == 0)
+					args->prefetch = 0;
+				else
+					args->prefetch = parse_positive(optarg) << 20;
+				break;
+			case 'M':
+				args->models = optarg;
+				break;
+			case 'o':
+				args->profile = optarg;
+				break;
+			case 'O':
+				args->profile_rules = optarg;
+				break;
+			case 's':
+				args->summary = 1;
+				break;
+			case 'H':
+				args->hwc_metrics = optarg;
+				break;
+			case 'z':
+				/* Zero uses all CPUs */
+				if (strcmp(optarg, "0") == 0)
+					args->compress = (int) sysconf(_SC_NPROCESSORS_ONLN);
+				else
+					args->compress = (int) parse_positive(optarg);
+				break;
+			case 'k':
+				args->compensate = 1;
+				break;
 			case 'l':
 				args->linter_mode = 1;
 				break;
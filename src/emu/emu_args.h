@@ -4,12 +4,24 @@
 #ifndef EMU_ARGS_H
 #define EMU_ARGS_H
 
+#include <stdint.h>
+
 struct emu_args {
 	int linter_mode;
 	int breakdown;
 	int enable_all_models;
 	char *clock_offset_file;
 	char *tracedir;
+	int64_t max_mapped; /* In bytes, 0 for the default */
+	int max_fds; /* 0 for the default */
+	int64_t prefetch; /* In bytes, -1 for the default */
+	char *models; /* Comma separated list of models, NULL for all */
+	char *profile; /* Output profile file */
+	char *profile_rules; /* Output profile rules, separated by ';' */
+	int compress; /* Number of workers to compress the PRV, 0 to disable */
+	int summary; /* Only write the time in each value, no PRV */
+	int compensate; /* Subtract the instrumentation overhead, in summary */
+	char *hwc_metrics; /* nOS-V HWC derived metrics, separated by ';' */
 };
 
 void emu_args_init(struct emu_args *args, int argc, char *argv[]);
@@ -40,7 +40,9 @@ enum emu_prv_types {
 	/* User marks [100, 200) */
 	PRV_NOSV_HWC         = 200,
 	/* nOS-V HWC [200, 300) */
-	PRV_RESERVED         = 300,
+	PRV_NOSV_HWC_METRIC  = 300,
+	/* nOS-V HWC derived metrics [300, 350) */
+	PRV_RESERVED         = 350,
 };
 
 #endif /* EMU_PRV_H */
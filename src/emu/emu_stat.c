@@ -3,9 +3,21 @@
 
 #include "emu_stat.h"
 #include <string.h>
+#include <sys/resource.h>
 #include <time.h>
 #include "common.h"
 #include "player.h"
+#include "stream.h"
+
+static long
+get_majflt(void)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	return usage.ru_majflt;
+}
 
 static double
 get_time(void)
@@ -27,6 +39,7 @@ emu_stat_init(struct emu_stat *stat)
 	stat->maxcalls = 100;
 	stat->period = 0.2;
 	stat->average = 1; /* Show average speed */
+	stat->majflt = get_majflt();
 }
 
 void
@@ -58,6 +71,8 @@ emu_stat_report(struct emu_stat *stat, struct player *player, int last)
 				progress * 100.0, avgspeed * 1e-3);
 		info("processed %"PRIi64" input events in %.2f s\n",
 				nprocessed, time_elapsed);
+		info("stalled %.2f s reading streams (%ld major page faults)\n",
+				stream_stall_time(), get_majflt() - stat->majflt);
 	} else {
 		int tmin = (int) (time_left / 60.0);
 		double tsec = ((time_left / 60.0 - tmin) * 60.0);
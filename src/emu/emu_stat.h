@@ -18,6 +18,7 @@ struct emu_stat {
 	int64_t ncalls;
 	int64_t maxcalls;
 	int average;
+	long majflt;
 };
 
 void emu_stat_init(struct emu_stat *stat);
@@ -17,6 +17,22 @@ context_switch(struct emu *emu)
 	struct kernel_thread *th = extend_get(&emu->thread->ext, 'K');
 	struct chan *ch = &th->m.ch[CH_CS];
 
+	/* After a lost record, ignore the switches to the current state */
+	if (th->lost && (emu->ev->v == 'O' || emu->ev->v == 'I')) {
+		struct value cur;
+		if (chan_read(ch, &cur) != 0) {
+			err("chan_read failed");
+			return -1;
+		}
+
+		int is_out = !value_is_null(cur);
+		int to_out = emu->ev->v == 'O';
+		if (is_out == to_out) {
+			dbg("ignoring unpaired context switch %s", emu->ev->mcv);
+			return 0;
+		}
+	}
+
 	switch (emu->ev->v) {
 		case 'O':
 			emu->thread->is_out_of_cpu = 1;
@@ -21,6 +21,10 @@ enum kernel_cs_state {
 
 struct kernel_thread {
 	struct model_thread m;
+
+	/* Some context switch records were lost, so the events may be
+	 * unpaired */
+	int lost;
 };
 
 struct kernel_cpu {
@@ -12,9 +12,11 @@
 #include "model_cpu.h"
 #include "model_pvt.h"
 #include "model_thread.h"
+#include "parson.h"
 #include "pv/pcf.h"
 #include "pv/prv.h"
 #include "system.h"
+#include "thread.h"
 #include "track.h"
 
 static const char model_name[] = "kernel";
@@ -137,6 +139,18 @@ model_kernel_create(struct emu *emu)
 		return -1;
 	}
 
+	for (struct thread *t = emu->system.threads; t; t = t->gnext) {
+		double lost = json_object_dotget_number(t->meta, "ovni.perf.lost");
+		if (lost <= 0)
+			continue;
+
+		warn("thread %s lost %.0f context switch records, ignoring the unpaired ones",
+				t->id, lost);
+
+		struct kernel_thread *th = EXT(t, model_id);
+		th->lost = 1;
+	}
+
 	if (model_cpu_create(emu, &cpu_spec) != 0) {
 		err("model_cpu_init failed");
 		return -1;
@@ -2,12 +2,14 @@
  * SPDX-License-Identifier: GPL-3.0-or-later */
 
 #include "model.h"
+#include <stdlib.h>
 #include <string.h>
 #include "common.h"
 #include "version.h"
 #include "emu.h"
 #include "emu_args.h"
 #include "model_evspec.h"
+#include "model_thread.h"
 #include "ev_spec.h"
 #include "thread.h"
 #include "proc.h"
@@ -66,6 +68,57 @@ model_register(struct model *model, struct model_spec *spec)
 	return 0;
 }
 
+static struct model_spec *
+find_spec(struct model *model, const char *name)
+{
+	for (int i = 0; i < MAX_MODELS; i++) {
+		if (model->registered[i] && strcmp(model->spec[i]->name, name) == 0)
+			return model->spec[i];
+	}
+
+	return NULL;
+}
+
+/** Excludes the registered models not present in the comma separated list
+ * of model names. The ovni model is never excluded, as the rest of the
+ * models depend on it. */
+int
+model_select(struct model *model, const char *list)
+{
+	int selected[MAX_MODELS] = {0};
+	selected['O'] = 1;
+
+	char *copy = strdup(list);
+	if (copy == NULL) {
+		err("strdup failed:");
+		return -1;
+	}
+
+	char *saveptr = NULL;
+	for (char *name = strtok_r(copy, ",", &saveptr); name != NULL;
+			name = strtok_r(NULL, ",", &saveptr)) {
+		struct model_spec *spec = find_spec(model, name);
+		if (spec == NULL) {
+			err("unknown model '%s'", name);
+			free(copy);
+			return -1;
+		}
+
+		selected[spec->model] = 1;
+	}
+
+	free(copy);
+
+	for (int i = 0; i < MAX_MODELS; i++) {
+		if (model->registered[i] && !selected[i]) {
+			model->excluded[i] = 1;
+			info("excluding model %s", model->spec[i]->name);
+		}
+	}
+
+	return 0;
+}
+
 int
 model_probe(struct model *model, struct emu *emu)
 {
@@ -74,6 +127,10 @@ model_probe(struct model *model, struct emu *emu)
 		if (!model->registered[i])
 			continue;
 
+		/* Not even probed, so they are not validated */
+		if (model->excluded[i])
+			continue;
+
 		struct model_spec *spec = model->spec[i];
 		if (spec->probe == NULL)
 			continue;
@@ -177,6 +234,11 @@ model_event(struct model *model, struct emu *emu, int index)
 	if (spec->event == NULL)
 		return 0;
 
+	if (model_thread_materialize(emu, emu->thread, spec->model) != 0) {
+		err("model_thread_materialize failed for '%s' model", spec->name);
+		return -1;
+	}
+
 	if (spec->event(emu) != 0) {
 		err("event() failed for '%s' model", spec->name);
 		return -1;
@@ -31,10 +31,15 @@ struct model {
 	struct model_spec *spec[MAX_MODELS];
 	int registered[MAX_MODELS];
 	int enabled[MAX_MODELS];
+
+	/* Not selected by the user, their events are discarded */
+	int excluded[MAX_MODELS];
+	int64_t ndropped;
 };
 
         void model_init(struct model *model);
 USE_RET int model_register(struct model *model, struct model_spec *spec);
+USE_RET int model_select(struct model *model, const char *list);
 USE_RET int model_probe(struct model *model, struct emu *emu);
 USE_RET int model_create(struct model *model, struct emu *emu);
 USE_RET int model_connect(struct model *model, struct emu *emu);
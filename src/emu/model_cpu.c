@@ -4,6 +4,8 @@
 #include "model_cpu.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include "arena.h"
+#include "bay.h"
 #include "chan.h"
 #include "common.h"
 #include "cpu.h"
@@ -16,7 +18,6 @@
 #include "system.h"
 #include "thread.h"
 #include "track.h"
-struct bay;
 
 static struct model_cpu *
 get_model_cpu(struct cpu *cpu, int id)
@@ -27,7 +28,8 @@ get_model_cpu(struct cpu *cpu, int id)
 static int
 init_chan(struct model_cpu *cpu, const struct model_chan_spec *spec, int64_t gindex)
 {
-	cpu->track = calloc((size_t) spec->nch, sizeof(struct track));
+	cpu->track = arena_calloc(cpu->bay->arena, (size_t) spec->nch,
+			sizeof(struct track));
 	if (cpu->track == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -55,7 +57,7 @@ static int
 init_cpu(struct cpu *syscpu, struct bay *bay, const struct model_cpu_spec *spec)
 {
 	/* The first member must be a struct model_cpu */
-	struct model_cpu *cpu = calloc(1, spec->size);
+	struct model_cpu *cpu = arena_calloc(bay->arena, 1, spec->size);
 	if (cpu == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -89,6 +91,19 @@ model_cpu_create(struct emu *emu, const struct model_cpu_spec *spec)
 	return 0;
 }
 
+static struct chan *
+thread_chan(struct thread *t, void *arg, int64_t index)
+{
+	const struct model_cpu_spec *spec = arg;
+	struct model_thread *th = EXT(t, spec->model->model);
+
+	/* Not created until the first event of the model */
+	if (th->ch == NULL)
+		return NULL;
+
+	return &th->ch[index];
+}
+
 static int
 connect_cpu(struct emu *emu, struct cpu *scpu, int id)
 {
@@ -106,26 +121,13 @@ connect_cpu(struct emu *emu, struct cpu *scpu, int id)
 			return -1;
 		}
 
-		struct chan *sel = cpu_get_th_chan(scpu);
-
+		/* Only the threads that run in the CPU are connected */
 		int64_t nthreads = (int64_t) emu->system.nthreads;
-		if (track_set_select(track, sel, NULL, nthreads) != 0) {
-			err("track_select failed");
+		if (track_set_cpu_running(track, scpu, nthreads, thread_chan,
+					(void *) cpu->spec, i) != 0) {
+			err("track_set_cpu_running failed");
 			return -1;
 		}
-
-		/* Add each thread as input */
-		for (struct thread *t = emu->system.threads; t; t = t->gnext) {
-			struct model_thread *th = EXT(t, id);
-
-			/* Use the input thread directly */
-			struct chan *inp = &th->ch[i];
-
-			if (track_set_input(track, t->gindex, inp) != 0) {
-				err("track_add_input failed");
-				return -1;
-			}
-		}
 	}
 
 	return 0;
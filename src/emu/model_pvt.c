@@ -149,9 +149,50 @@ model_pvt_connect_cpu(struct emu *emu, const struct model_cpu_spec *spec)
 	return 0;
 }
 
+/* The thread channels are created on the first event of the model. Until
+ * then, the rows of the running and active tracks follow the null channel
+ * of the thread, as their output only changes with the thread state. The
+ * rows of the other tracks are registered when the channels are created. */
 static int
 connect_thread_prv(struct emu *emu, struct thread *sth, struct prv *prv, int id)
 {
+	struct model_thread *th = EXT(sth, id);
+	const struct model_chan_spec *spec = th->spec->chan;
+	const long *flags_arr = spec->pvt->flags;
+	for (int i = 0; i < spec->nch; i++) {
+		if (spec->track[i] == TRACK_TH_ANY)
+			continue;
+
+		struct chan *out = thread_get_null_chan(sth, &emu->bay);
+		if (out == NULL) {
+			err("thread_get_null_chan failed");
+			return -1;
+		}
+
+		long type = spec->pvt->type[i];
+		long row = (long) sth->gindex;
+		long flags = flags_arr ? flags_arr[i] : 0;
+		if (prv_register(prv, row, type, &emu->bay, out, flags)) {
+			err("prv_register failed");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Connects the rows of the thread to the channels just created, after
+ * model_pvt_connect_thread() */
+int
+model_pvt_bind_thread(struct emu *emu, struct thread *sth, int id)
+{
+	struct pvt *pvt = recorder_find_pvt(&emu->recorder, "thread");
+	if (pvt == NULL) {
+		err("cannot find thread pvt");
+		return -1;
+	}
+
+	struct prv *prv = pvt_get_prv(pvt);
 	struct model_thread *th = EXT(sth, id);
 	const struct model_chan_spec *spec = th->spec->chan;
 	const long *flags_arr = spec->pvt->flags;
@@ -159,6 +200,15 @@ connect_thread_prv(struct emu *emu, struct thread *sth, struct prv *prv, int id)
 		struct chan *out = track_get_output(&th->track[i]);
 		long type = spec->pvt->type[i];
 		long row = (long) sth->gindex;
+
+		if (spec->track[i] != TRACK_TH_ANY) {
+			if (prv_rebind(prv, row, type, &emu->bay, out) != 0) {
+				err("prv_rebind failed");
+				return -1;
+			}
+			continue;
+		}
+
 		long flags = flags_arr ? flags_arr[i] : 0;
 		if (prv_register(prv, row, type, &emu->bay, out, flags)) {
 			err("prv_register failed");
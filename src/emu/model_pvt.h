@@ -8,6 +8,7 @@
 struct emu;
 struct model_cpu_spec;
 struct model_thread_spec;
+struct thread;
 
 struct model_pvt_spec {
 	const int *type;
@@ -19,5 +20,6 @@ struct model_pvt_spec {
 
 USE_RET int model_pvt_connect_cpu(struct emu *emu, const struct model_cpu_spec *spec);
 USE_RET int model_pvt_connect_thread(struct emu *emu, const struct model_thread_spec *spec);
+USE_RET int model_pvt_bind_thread(struct emu *emu, struct thread *sth, int id);
 
 #endif /* MODEL_PRV_H */
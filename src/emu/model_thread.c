@@ -4,25 +4,30 @@
 #include "model_thread.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include "arena.h"
 #include "bay.h"
 #include "chan.h"
 #include "common.h"
+#include "cpu.h"
 #include "emu.h"
 #include "extend.h"
 #include "model.h"
 #include "model_chan.h"
+#include "model_cpu.h"
 #include "model_pvt.h"
+#include "mux.h"
 #include "system.h"
 #include "thread.h"
 #include "track.h"
 
 static int
-init_chan(struct model_thread *th, const struct model_chan_spec *spec, int64_t gindex)
+init_chan(struct model_thread *th, const struct model_chan_spec *spec,
+		int64_t gindex, int truncated)
 {
 	const char *fmt = "%s.thread%"PRIi64".%s";
 	const char *prefix = spec->prefix;
 
-	th->ch = calloc((size_t) spec->nch, sizeof(struct chan));
+	th->ch = arena_calloc(th->bay->arena, (size_t) spec->nch, sizeof(struct chan));
 	if (th->ch == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -39,13 +44,19 @@ init_chan(struct model_thread *th, const struct model_chan_spec *spec, int64_t g
 			chan_prop_set(c, CHAN_ALLOW_DUP, dup);
 		}
 
+		/* The flight recorder may have lost the events that pushed
+		 * or popped some values */
+		if (truncated)
+			chan_prop_set(c, CHAN_IGNORE_UNMATCHED, 1);
+
 		if (bay_register(th->bay, c) != 0) {
 			err("bay_register failed");
 			return -1;
 		}
 	}
 
-	th->track = calloc((size_t) spec->nch, sizeof(struct track));
+	th->track = arena_calloc(th->bay->arena, (size_t) spec->nch,
+			sizeof(struct track));
 	if (th->track == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -71,7 +82,7 @@ init_chan(struct model_thread *th, const struct model_chan_spec *spec, int64_t g
 static int
 init_thread(struct thread *systh, struct bay *bay, const struct model_thread_spec *spec)
 {
-	struct model_thread *th = calloc(1, spec->size);
+	struct model_thread *th = arena_calloc(bay->arena, 1, spec->size);
 	if (th == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -80,11 +91,7 @@ init_thread(struct thread *systh, struct bay *bay, const struct model_thread_spe
 	th->spec = spec;
 	th->bay = bay;
 
-	if (init_chan(th, spec->chan, systh->gindex) != 0) {
-		err("init_chan failed");
-		return -1;
-	}
-
+	/* The channels are created on the first event of the model */
 	extend_set(&systh->ext, spec->model->model, th);
 
 	return 0;
@@ -109,22 +116,94 @@ model_thread_create(struct emu *emu, const struct model_thread_spec *spec)
 int
 model_thread_connect(struct emu *emu, const struct model_thread_spec *spec)
 {
-	int id = spec->model->model;
-	struct system *sys = &emu->system;
+	/* Declare the Paraver rows, as the channels don't exist yet */
+	if (model_pvt_connect_thread(emu, spec) != 0) {
+		err("model_pvt_connect_thread failed");
+		return -1;
+	}
 
-	for (struct thread *t = sys->threads; t; t = t->gnext) {
-		struct model_thread *th = EXT(t, id);
-		struct chan *sel = &t->chan[TH_CHAN_STATE];
-		int nch = th->spec->chan->nch;
-		if (track_connect_thread(th->track, th->ch, sel, nch) != 0) {
-			err("track_thread failed");
+	return 0;
+}
+
+/* Selects the new channel in the tracks of the CPU if the thread is the
+ * one running there */
+static int
+refresh_cpu(struct thread *systh, int id)
+{
+	struct cpu *syscpu = systh->cpu;
+	if (syscpu == NULL || syscpu->th_running != systh)
+		return 0;
+
+	struct model_cpu *cpu = EXT(syscpu, id);
+	if (cpu == NULL)
+		return 0;
+
+	for (int i = 0; i < cpu->spec->chan->nch; i++) {
+		if (mux_refresh(&cpu->track[i].mux) != 0) {
+			err("mux_refresh failed");
 			return -1;
 		}
 	}
 
-	/* Connect channels to Paraver trace */
-	if (model_pvt_connect_thread(emu, spec) != 0) {
-		err("model_pvt_connect_thread failed");
+	return 0;
+}
+
+/** Creates the channels and tracks of the thread for the model with the
+ * given id, if not done already. Most threads only use a few models, so
+ * they are only created once the thread needs them, which must be after
+ * model_thread_connect(). */
+int
+model_thread_materialize(struct emu *emu, struct thread *systh, int id)
+{
+	struct model_thread *th = EXT(systh, id);
+
+	if (th == NULL || th->ch != NULL)
+		return 0;
+
+	const struct model_chan_spec *spec = th->spec->chan;
+	if (init_chan(th, spec, systh->gindex, systh->is_truncated) != 0) {
+		err("init_chan failed");
+		return -1;
+	}
+
+	struct chan *sel = &systh->chan[TH_CHAN_STATE];
+	if (track_connect_thread(th->track, th->ch, sel, spec->nch) != 0) {
+		err("track_connect_thread failed");
+		return -1;
+	}
+
+	for (int i = 0; i < spec->nch; i++) {
+		if (spec->track[i] == TRACK_TH_ANY)
+			continue;
+
+		if (mux_refresh(&th->track[i].mux) != 0) {
+			err("mux_refresh failed");
+			return -1;
+		}
+	}
+
+	if (model_pvt_bind_thread(emu, systh, id) != 0) {
+		err("model_pvt_bind_thread failed");
+		return -1;
+	}
+
+	if (refresh_cpu(systh, id) != 0) {
+		err("refresh_cpu failed");
+		return -1;
+	}
+
+	if (th->spec->materialize == NULL)
+		return 0;
+
+	if (th->spec->materialize(emu, systh) != 0) {
+		err("materialize hook failed");
+		return -1;
+	}
+
+	/* Propagate the initial values now, so the event that caused the
+	 * channels to be created can write them again */
+	if (bay_propagate(th->bay) != 0) {
+		err("bay_propagate failed");
 		return -1;
 	}
 
@@ -7,11 +7,18 @@
 #include <stddef.h>
 #include "common.h"
 struct emu;
+struct thread;
+
+typedef int (model_thread_hook_t)(struct emu *emu, struct thread *th);
 
 struct model_thread_spec {
 	size_t size;
 	const struct model_chan_spec *chan;
 	const struct model_spec *model;
+
+	/* Sets the initial values of the channels once they are created,
+	 * may be NULL */
+	model_thread_hook_t *materialize;
 };
 
 struct model_thread {
@@ -23,5 +30,6 @@ struct model_thread {
 
 USE_RET int model_thread_create(struct emu *emu, const struct model_thread_spec *spec);
 USE_RET int model_thread_connect(struct emu *emu, const struct model_thread_spec *spec);
+USE_RET int model_thread_materialize(struct emu *emu, struct thread *systh, int id);
 
 #endif /* MODEL_THREAD_H */
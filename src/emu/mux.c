@@ -4,9 +4,62 @@
 #include "mux.h"
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "bay.h"
 #include "chan.h"
 
+/* Called when the input channel changes its value and is selected */
+static int cb_input(struct chan *in_chan, void *ptr);
+
+/* Creates the input of a sparse mux, only done the first time the index
+ * is selected. The input func may return no channel if it doesn't exist
+ * yet, then no input is created so it is requested again the next time. */
+static int
+add_sparse_input(struct mux *mux, int64_t index, struct mux_input **pinput)
+{
+	struct chan *chan = NULL;
+	if (mux->input_func(mux, index, &chan) != 0) {
+		err("input_func failed for index %"PRIi64, index);
+		return -1;
+	}
+
+	*pinput = NULL;
+	if (chan == NULL)
+		return 0;
+
+	if (chan == mux->output) {
+		err("cannot use same input channel as output");
+		return -1;
+	}
+
+	struct mux_input *input = arena_calloc(mux->bay->arena, 1,
+			sizeof(struct mux_input));
+	if (input == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
+
+	input->index = index;
+	input->chan = chan;
+	input->output = mux->output;
+
+	input->cb = bay_add_cb(mux->bay, BAY_CB_DIRTY, chan, cb_input, input, 0);
+	if (input->cb == NULL) {
+		err("bay_add_cb failed");
+		return -1;
+	}
+
+	if (bay_dep_input(mux->dep, chan) != 0) {
+		err("bay_dep_input failed");
+		return -1;
+	}
+
+	HASH_ADD(hh, mux->sparse, index, sizeof(input->index), input);
+	*pinput = input;
+
+	return 0;
+}
+
 static int
 default_select(struct mux *mux,
 		struct value key,
@@ -29,7 +82,14 @@ default_select(struct mux *mux,
 		return -1;
 	}
 
-	struct mux_input *input = &mux->inputs[index];
+	struct mux_input *input = mux_get_input(mux, index);
+
+	if (input == NULL && mux->input_func != NULL) {
+		if (add_sparse_input(mux, index, &input) != 0) {
+			err("add_sparse_input failed");
+			return -1;
+		}
+	}
 
 	*pinput = input;
 
@@ -54,25 +114,27 @@ select_input(struct mux *mux,
 	return 0;
 }
 
-/** Called when the select channel changes its value */
+/* Selects the input from the value of the select channel and sets the
+ * output to the value of the input. Unless forced, the output is only
+ * written when the value changes. */
 static int
-cb_select(struct chan *sel_chan, void *ptr)
+reselect(struct mux *mux, int force)
 {
-	struct mux *mux = ptr;
-
 	dbg("selecting input for output chan chan=%s", mux->output->name);
 
 	struct value sel_value;
-	if (chan_read(sel_chan, &sel_value) != 0) {
+	if (chan_read(mux->select, &sel_value) != 0) {
 		err("chan_read(select) failed");
 		return -1;
 	}
 
 	/* Clear previous selected input */
 	if (mux->selected >= 0) {
-		struct mux_input *old_input = &mux->inputs[mux->selected];
-		bay_disable_cb(old_input->cb);
-		old_input->selected = 0;
+		struct mux_input *old_input = mux_get_input(mux, mux->selected);
+		if (old_input != NULL) {
+			bay_disable_cb(old_input->cb);
+			old_input->selected = 0;
+		}
 		mux->selected = -1;
 	}
 
@@ -99,6 +161,17 @@ cb_select(struct chan *sel_chan, void *ptr)
 		return -1;
 	}
 
+	if (!force) {
+		struct value cur_value;
+		if (chan_read(mux->output, &cur_value) != 0) {
+			err("chan_read() failed");
+			return -1;
+		}
+
+		if (value_is_equal(&cur_value, &out_value))
+			return 0;
+	}
+
 	dbg("setting output chan %s to %s",
 			mux->output->name, value_str(out_value));
 
@@ -110,7 +183,16 @@ cb_select(struct chan *sel_chan, void *ptr)
 	return 0;
 }
 
-/** Called when the input channel changes its value and is selected */
+/** Called when the select channel changes its value */
+static int
+cb_select(struct chan *sel_chan, void *ptr)
+{
+	UNUSED(sel_chan);
+	struct mux *mux = ptr;
+
+	return reselect(mux, 1);
+}
+
 static int
 cb_input(struct chan *in_chan, void *ptr)
 {
@@ -177,12 +259,16 @@ mux_init(struct mux *mux,
 	mux->select = select;
 	mux->output = output;
 	mux->ninputs = ninputs;
-	mux->inputs = calloc((size_t) ninputs, sizeof(struct mux_input));
 	mux->def = value_null();
 
-	if (mux->inputs == NULL) {
-		err("calloc failed:");
-		return -1;
+	/* Sparse muxes have no inputs here */
+	if (ninputs > 0) {
+		mux->inputs = arena_calloc(bay->arena, (size_t) ninputs,
+				sizeof(struct mux_input));
+		if (mux->inputs == NULL) {
+			err("calloc failed:");
+			return -1;
+		}
 	}
 
 	mux->select_func = select_func;
@@ -194,13 +280,57 @@ mux_init(struct mux *mux,
 		return -1;
 	}
 
+	if ((mux->dep = bay_add_dep(bay, output, 1)) == NULL) {
+		err("bay_add_dep failed");
+		return -1;
+	}
+
+	if (bay_dep_input(mux->dep, select) != 0) {
+		err("bay_dep_input failed");
+		return -1;
+	}
+
 	return 0;
 }
 
+/** Initializes a sparse mux, which has no inputs set. Instead, the
+ * input_func is called to get the input channel the first time an index is
+ * selected, so only the inputs that are selected use memory and
+ * callbacks. */
+int
+mux_init_sparse(struct mux *mux,
+		struct bay *bay,
+		struct chan *select,
+		struct chan *output,
+		mux_input_func_t input_func,
+		void *input_arg,
+		int64_t ninputs)
+{
+	/* No inputs allocated */
+	if (mux_init(mux, bay, select, output, NULL, 0) != 0) {
+		err("mux_init failed");
+		return -1;
+	}
+
+	mux->ninputs = ninputs;
+	mux->input_func = input_func;
+	mux->input_arg = input_arg;
+
+	return 0;
+}
+
+/** Returns the input at index, or NULL in sparse muxes if the input has
+ * not been selected yet. */
 struct mux_input *
 mux_get_input(struct mux *mux, int64_t index)
 {
-	return &mux->inputs[index];
+	if (mux->input_func == NULL)
+		return &mux->inputs[index];
+
+	struct mux_input *input = NULL;
+	HASH_FIND(hh, mux->sparse, &index, sizeof(index), input);
+
+	return input;
 }
 
 int
@@ -211,6 +341,11 @@ mux_set_input(struct mux *mux, int64_t index, struct chan *chan)
 		return -1;
 	}
 
+	if (mux->input_func != NULL) {
+		err("cannot set inputs in sparse mux");
+		return -1;
+	}
+
 	struct mux_input *input = &mux->inputs[index];
 
 	if (input->chan != NULL) {
@@ -229,6 +364,25 @@ mux_set_input(struct mux *mux, int64_t index, struct chan *chan)
 		return -1;
 	}
 
+	if (bay_dep_input(mux->dep, chan) != 0) {
+		err("bay_dep_input failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Selects the input again with the current value of the select channel,
+ * after the input channels have changed, like a sparse input that had no
+ * channel before. The output is only written if its value changes. */
+int
+mux_refresh(struct mux *mux)
+{
+	if (reselect(mux, 0) != 0) {
+		err("reselect failed for %s", mux->output->name);
+		return -1;
+	}
+
 	return 0;
 }
 
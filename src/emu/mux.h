@@ -6,8 +6,10 @@
 
 #include <stdint.h>
 #include "common.h"
+#include "uthash.h"
 #include "value.h"
 struct bay;
+struct bay_dep;
 struct chan;
 struct mux;
 
@@ -17,12 +19,18 @@ struct mux_input {
 	int selected;
 	struct chan *output;
 	struct bay_cb *cb;
+	UT_hash_handle hh; /* Only in sparse muxes */
 };
 
 typedef int (* mux_select_func_t)(struct mux *mux,
 		struct value value,
 		struct mux_input **input);
 
+/* Returns the channel of the input index in a sparse mux */
+typedef int (* mux_input_func_t)(struct mux *mux,
+		int64_t index,
+		struct chan **chan);
+
 struct mux {
 	struct bay *bay;
 	int64_t ninputs;
@@ -32,6 +40,14 @@ struct mux {
 	struct chan *select;
 	struct chan *output;
 	struct value def;
+
+	/* Declares the inputs and select channels that write the output */
+	struct bay_dep *dep;
+
+	/* Sparse muxes create the inputs when first selected */
+	mux_input_func_t input_func;
+	void *input_arg;
+	struct mux_input *sparse;
 };
 
 void mux_input_init(struct mux_input *mux,
@@ -45,6 +61,14 @@ USE_RET int mux_init(struct mux *mux,
 		mux_select_func_t select_func,
 		int64_t ninputs);
 
+USE_RET int mux_init_sparse(struct mux *mux,
+		struct bay *bay,
+		struct chan *select,
+		struct chan *output,
+		mux_input_func_t input_func,
+		void *input_arg,
+		int64_t ninputs);
+
 USE_RET int mux_set_input(struct mux *mux,
 		int64_t index,
 		struct chan *input);
@@ -55,6 +79,8 @@ USE_RET struct mux_input *mux_get_input(struct mux *mux,
 USE_RET int mux_register(struct mux *mux,
 		struct bay *bay);
 
+USE_RET int mux_refresh(struct mux *mux);
+
 void mux_set_default(struct mux *mux, struct value def);
 
 #endif /* MUX_H */
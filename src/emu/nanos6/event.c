@@ -243,6 +243,7 @@ chan_task_switch(struct emu *emu,
 	return 0;
 }
 
+/* Returns 1 if the event is ignored, as the task is unknown */
 static int
 update_task_state(struct emu *emu)
 {
@@ -259,9 +260,15 @@ update_task_state(struct emu *emu)
 	struct task_info *info = &proc->task_info;
 	struct task_stack *stack = &th->task_stack;
 
-	struct task *task = task_find(info->tasks, task_id);
+	struct task *task = task_find(info, task_id);
 
 	if (task == NULL) {
+		/* Created in the events lost by the flight recorder */
+		if (emu->proc->is_truncated) {
+			dbg("ignoring unknown task with id %u", task_id);
+			return 1;
+		}
+
 		err("cannot find task with id %u", task_id);
 		return -1;
 	}
@@ -410,9 +417,12 @@ update_task(struct emu *emu)
 	struct task *prev = bprev == NULL ? NULL : body_get_task(bprev);
 
 	/* Update the emulator state, but don't modify the channels */
-	if (update_task_state(emu) != 0) {
+	int ret = update_task_state(emu);
+	if (ret < 0) {
 		err("update_task_state failed");
 		return -1;
+	} else if (ret > 0) {
+		return 0;
 	}
 
 	struct body *bnext = task_get_running(stack);
@@ -467,6 +477,13 @@ create_task(struct emu *emu)
 	 * task, so we relax the model to allow this for now. */
 	flags |= TASK_FLAG_RELAX_NESTING;
 
+	/* The type was created in the events lost by the flight recorder, so
+	 * the task events are ignored too */
+	if (emu->proc->is_truncated && task_type_find(info->types, type_id) == NULL) {
+		dbg("ignoring task %u of unknown type %u", task_id, type_id);
+		return 0;
+	}
+
 	if (task_create(info, type_id, task_id, (uint32_t) flags) != 0) {
 		err("task_create failed");
 		return -1;
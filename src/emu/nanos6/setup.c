@@ -254,10 +254,27 @@ static const struct model_cpu_spec cpu_spec = {
 	.model = &model_nanos6,
 };
 
+/* By default set all threads as Progressing, once they use the model */
+static int
+thread_materialize(struct emu *emu, struct thread *systh)
+{
+	UNUSED(emu);
+
+	struct nanos6_thread *th = EXT(systh, model_id);
+	struct chan *idle = &th->m.ch[CH_IDLE];
+	if (chan_set(idle, value_int64(ST_PROGRESSING)) != 0) {
+		err("chan_set idle failed");
+		return -1;
+	}
+
+	return 0;
+}
+
 static const struct model_thread_spec th_spec = {
 	.size = sizeof(struct nanos6_thread),
 	.chan = &th_chan,
 	.model = &model_nanos6,
+	.materialize = thread_materialize,
 };
 
 /* ----------------------------------------------------- */
@@ -338,16 +355,6 @@ model_nanos6_connect(struct emu *emu)
 		return -1;
 	}
 
-	for (struct thread *th = emu->system.threads; th; th = th->gnext) {
-		struct nanos6_thread *mth = EXT(th, model_id);
-		struct chan *idle = &mth->m.ch[CH_IDLE];
-		/* By default set all threads as Progressing */
-		if (chan_set(idle, value_int64(ST_PROGRESSING)) != 0) {
-			err("chan_push idle failed");
-			return -1;
-		}
-	}
-
 	for (struct cpu *cpu = emu->system.cpus; cpu; cpu = cpu->next) {
 		struct nanos6_cpu *mcpu = EXT(cpu, model_id);
 		struct mux *mux = &mcpu->m.track[CH_IDLE].mux;
@@ -371,6 +378,15 @@ end_lint(struct emu *emu)
 	/* Ensure we run out of subsystem states */
 	for (struct thread *t = sys->threads; t; t = t->gnext) {
 		struct nanos6_thread *th = EXT(t, model_id);
+
+		/* Never used by the thread */
+		if (th->m.ch == NULL)
+			continue;
+
+		/* The pops may be lost in the flight recorder */
+		if (t->is_truncated)
+			continue;
+
 		struct chan *ch = &th->m.ch[CH_SUBSYSTEM];
 		int stacked = ch->data.stack.n;
 		if (stacked > 0) {
@@ -266,6 +266,7 @@ chan_body_switch(struct emu *emu, struct body *bprev, struct body *bnext)
 	return 0;
 }
 
+/* Returns 1 if the event is ignored, as the task is unknown */
 static int
 update_task_state(struct emu *emu)
 {
@@ -285,9 +286,15 @@ update_task_state(struct emu *emu)
 	struct nosv_proc *proc = EXT(emu->proc, 'V');
 	struct task_info *info = &proc->task_info;
 	struct task_stack *stack = &th->task_stack;
-	struct task *task = task_find(info->tasks, task_id);
+	struct task *task = task_find(info, task_id);
 
 	if (task == NULL) {
+		/* Created in the events lost by the flight recorder */
+		if (emu->proc->is_truncated) {
+			dbg("ignoring unknown task with id %u", task_id);
+			return 1;
+		}
+
 		err("cannot find task with id %u", task_id);
 		return -1;
 	}
@@ -449,9 +456,12 @@ update_task(struct emu *emu)
 	struct body *prev = task_get_running(stack);
 
 	/* Update the emulator state, but don't modify the channels */
-	if (update_task_state(emu) != 0) {
+	int ret = update_task_state(emu);
+	if (ret < 0) {
 		err("update_task_state failed");
 		return -1;
+	} else if (ret > 0) {
+		return 0;
 	}
 
 	struct body *next = task_get_running(stack);
@@ -508,6 +518,13 @@ create_task(struct emu *emu, char value)
 	struct nosv_proc *proc = EXT(emu->proc, 'V');
 	struct task_info *info = &proc->task_info;
 
+	/* The type was created in the events lost by the flight recorder, so
+	 * the task events are ignored too */
+	if (emu->proc->is_truncated && task_type_find(info->types, type_id) == NULL) {
+		dbg("ignoring task %u of unknown type %u", task_id, type_id);
+		return 0;
+	}
+
 	if (task_create(info, type_id, task_id, flags) != 0) {
 		err("task_create failed");
 		return -1;
@@ -1,5 +1,6 @@
 #include "hwc.h"
 
+#include "arena.h"
 #include "chan.h"
 #include "cpu.h"
 #include "emu.h"
@@ -14,10 +15,13 @@
 #include "pv/pcf.h"
 #include "pv/prv.h"
 #include "pv/pvt.h"
+#include "pv/summary.h"
+#include "task.h"
 #include "thread.h"
 #include "track.h"
 #include "uthash.h"
 #include <errno.h>
+#include <stdio.h>
 
 static int
 parse_hwc(struct nosv_hwc_emu *hwc_emu, const char *indexstr, JSON_Value *hwcval)
@@ -116,6 +120,156 @@ scan_thread(struct nosv_hwc_emu *hwc_emu, struct thread *t)
 	return 0;
 }
 
+/* Only enabled when the counters are available */
+static const char *default_metrics =
+	"IPC_x1000=PAPI_TOT_INS/PAPI_TOT_CYC*1000;"
+	"L1D_MPKI_x1000=PAPI_L1_DCM/PAPI_TOT_INS*1000000;"
+	"L2_MPKI_x1000=PAPI_L2_TCM/PAPI_TOT_INS*1000000;"
+	"L3_MPKI_x1000=PAPI_L3_TCM/PAPI_TOT_INS*1000000;"
+	"L3_MBps=PAPI_L3_TCM/ns*64000";
+
+/* Returns the counter index, HWC_NS for the time or -2 if not found */
+static long
+find_operand(struct nosv_hwc_emu *hwc_emu, const char *name)
+{
+	if (strcmp(name, "ns") == 0)
+		return HWC_NS;
+
+	for (size_t i = 0; i < hwc_emu->n; i++) {
+		if (strcmp(hwc_emu->name[i], name) == 0)
+			return (long) i;
+	}
+
+	return -2;
+}
+
+static int
+is_name_used(struct nosv_hwc_emu *hwc_emu, const char *name)
+{
+	if (find_operand(hwc_emu, name) != -2)
+		return 1;
+
+	for (size_t i = 0; i < hwc_emu->nmetrics; i++) {
+		if (strcmp(hwc_emu->metrics[i].name, name) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Parses a metric with the form NAME=NUM/DEN[*MUL]. Unless strict,
+ * metrics with unknown counters are ignored. */
+static int
+parse_metric(struct nosv_hwc_emu *hwc_emu, const char *spec, int strict)
+{
+	char buf[MAX_LABEL];
+	if (snprintf(buf, MAX_LABEL, "%s", spec) >= MAX_LABEL) {
+		err("HWC metric too long: %s", spec);
+		return -1;
+	}
+
+	char *name = buf;
+	char *num = strchr(buf, '=');
+	char *den = num ? strchr(num, '/') : NULL;
+	if (num == NULL || den == NULL || num == name) {
+		err("invalid HWC metric '%s', expecting NAME=NUM/DEN[*MUL]", spec);
+		return -1;
+	}
+	*num++ = '\0';
+	*den++ = '\0';
+
+	/* The name is used in the cfg path */
+	if (strchr(name, '/') != NULL) {
+		err("invalid HWC metric name '%s'", name);
+		return -1;
+	}
+
+	double mul = 1.0;
+	char *star = strchr(den, '*');
+	if (star != NULL) {
+		*star++ = '\0';
+		char *end = NULL;
+		errno = 0;
+		mul = strtod(star, &end);
+		if (errno != 0 || end == star || *end != '\0' || !(mul > 0.0)) {
+			err("invalid multiplier in HWC metric '%s'", spec);
+			return -1;
+		}
+	}
+
+	long inum = find_operand(hwc_emu, num);
+	long iden = find_operand(hwc_emu, den);
+	if (inum == -2 || iden == -2) {
+		if (!strict) {
+			dbg("ignoring HWC metric %s", name);
+			return 0;
+		}
+		err("unknown counter in HWC metric '%s'", spec);
+		return -1;
+	}
+
+	if (is_name_used(hwc_emu, name)) {
+		err("HWC metric name '%s' already in use", name);
+		return -1;
+	}
+
+	if (hwc_emu->nmetrics >= HWC_MAX_METRICS) {
+		err("too many HWC metrics, maximum is %d", HWC_MAX_METRICS);
+		return -1;
+	}
+
+	size_t n = hwc_emu->nmetrics + 1;
+	struct nosv_hwc_metric *metrics = realloc(hwc_emu->metrics,
+			n * sizeof(struct nosv_hwc_metric));
+	if (metrics == NULL) {
+		err("realloc failed:");
+		return -1;
+	}
+	hwc_emu->metrics = metrics;
+
+	struct nosv_hwc_metric *m = &metrics[hwc_emu->nmetrics];
+	if ((m->name = strdup(name)) == NULL) {
+		err("strdup failed:");
+		return -1;
+	}
+	m->num = inum;
+	m->den = iden;
+	m->mul = mul;
+	hwc_emu->nmetrics = n;
+
+	dbg("HWC metric %s = %s / %s * %g", name, num, den, mul);
+
+	return 0;
+}
+
+/* Parses the metrics separated by ';' or the default ones if NULL */
+static int
+init_metrics(struct nosv_hwc_emu *hwc_emu, const char *specs)
+{
+	int strict = (specs != NULL);
+	if (specs == NULL)
+		specs = default_metrics;
+
+	char *copy = strdup(specs);
+	if (copy == NULL) {
+		err("strdup failed:");
+		return -1;
+	}
+
+	char *saveptr = NULL;
+	for (char *tok = strtok_r(copy, ";", &saveptr); tok != NULL;
+			tok = strtok_r(NULL, ";", &saveptr)) {
+		if (parse_metric(hwc_emu, tok, strict) != 0) {
+			err("parse_metric failed");
+			free(copy);
+			return -1;
+		}
+	}
+
+	free(copy);
+	return 0;
+}
+
 static int
 create_thread_chan(struct nosv_hwc_emu *emu, struct bay *bay, struct thread *th)
 {
@@ -123,13 +277,14 @@ create_thread_chan(struct nosv_hwc_emu *emu, struct bay *bay, struct thread *th)
 	struct nosv_hwc_thread *t = &nosv_thread->hwc;
 
 	/* Create as many channels as required */
-	t->chan = calloc(emu->n, sizeof(struct chan));
+	t->chan = arena_calloc(bay->arena, emu->nchan, sizeof(struct chan));
 	if (t->chan == NULL) {
 		err("calloc failed:");
 		return -1;
 	}
 
-	t->n = emu->n;
+	t->n = emu->nchan;
+	t->last_clock = -1;
 
 	for (size_t i = 0; i < t->n; i++) {
 		struct chan *ch = &t->chan[i];
@@ -146,7 +301,7 @@ create_thread_chan(struct nosv_hwc_emu *emu, struct bay *bay, struct thread *th)
 	}
 
 	/* Setup tracking */
-	t->track = calloc(t->n, sizeof(struct track));
+	t->track = arena_calloc(bay->arena, t->n, sizeof(struct track));
 	if (t->track == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -173,13 +328,19 @@ init_cpu(struct nosv_hwc_emu *emu, struct bay *bay, struct cpu *cpu)
 	struct nosv_hwc_cpu *c = &nosv_cpu->hwc;
 
 	/* Setup tracking */
-	c->track = calloc(emu->n, sizeof(struct track));
+	c->track = arena_calloc(bay->arena, emu->nchan, sizeof(struct track));
 	if (c->track == NULL) {
 		err("calloc failed:");
 		return -1;
 	}
 
-	c->n = emu->n;
+	c->n = emu->nchan;
+
+	c->acc.sum = arena_calloc(bay->arena, emu->n, sizeof(int64_t));
+	if (c->acc.sum == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
 
 	for (size_t i = 0; i < c->n; i++) {
 		struct track *track = &c->track[i];
@@ -221,6 +382,19 @@ hwc_create(struct emu *emu)
 		return -1;
 	}
 
+	if (init_metrics(hwc_emu, emu->args.hwc_metrics) != 0) {
+		err("init_metrics failed");
+		return -1;
+	}
+
+	hwc_emu->nchan = hwc_emu->n + hwc_emu->nmetrics;
+	hwc_emu->results = calloc(hwc_emu->nmetrics + 1, sizeof(double));
+	hwc_emu->notask.sum = calloc(hwc_emu->n, sizeof(int64_t));
+	if (hwc_emu->results == NULL || hwc_emu->notask.sum == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
+
 	/* Once we know how many HWC we have, allocate the channels for threads
 	 * and CPUs. */
 
@@ -241,8 +415,28 @@ hwc_create(struct emu *emu)
 	return 0;
 }
 
+/* The counters are followed by the derived metrics */
+static long
+chan_prvtype(struct nosv_hwc_emu *hwc_emu, size_t i)
+{
+	if (i < hwc_emu->n)
+		return (long) (PRV_NOSV_HWC + i);
+	else
+		return (long) (PRV_NOSV_HWC_METRIC + i - hwc_emu->n);
+}
+
+static const char *
+chan_label(struct nosv_hwc_emu *hwc_emu, size_t i)
+{
+	if (i < hwc_emu->n)
+		return hwc_emu->name[i];
+	else
+		return hwc_emu->metrics[i - hwc_emu->n].name;
+}
+
 static int
-connect_thread_prv(struct bay *bay, struct thread *systh, struct prv *prv)
+connect_thread_prv(struct nosv_hwc_emu *hwc_emu, struct bay *bay,
+		struct thread *systh, struct prv *prv)
 {
 	struct nosv_thread *nosv_thread = EXT(systh, 'V');
 	struct nosv_hwc_thread *t = &nosv_thread->hwc;
@@ -263,7 +457,7 @@ connect_thread_prv(struct bay *bay, struct thread *systh, struct prv *prv)
 		struct chan *out = track_get_output(track);
 		long row = (long) systh->gindex;
 		long flags = PRV_SKIPDUPNULL | PRV_ZERO;
-		long prvtype = (long) (PRV_NOSV_HWC + i);
+		long prvtype = chan_prvtype(hwc_emu, i);
 		if (prv_register(prv, row, prvtype, bay, out, flags)) {
 			err("prv_register failed");
 			return -1;
@@ -279,9 +473,9 @@ init_pcf(struct emu *emu, struct pcf *pcf)
 	struct nosv_emu *nosv_emu = EXT(emu, 'V');
 	struct nosv_hwc_emu *hwc_emu = &nosv_emu->hwc;
 
-	for (size_t i = 0; i < hwc_emu->n; i++) {
-		long prvtype = (long) (PRV_NOSV_HWC + i);
-		const char *name = hwc_emu->name[i];
+	for (size_t i = 0; i < hwc_emu->nchan; i++) {
+		long prvtype = chan_prvtype(hwc_emu, i);
+		const char *name = chan_label(hwc_emu, i);
 		struct pcf_type *pcftype = pcf_add_type(pcf, (int) prvtype, name);
 		if (pcftype == NULL) {
 			err("pcf_add_type failed");
@@ -301,10 +495,13 @@ connect_thread(struct emu *emu)
 		return -1;
 	}
 
+	struct nosv_emu *nosv_emu = EXT(emu, 'V');
+	struct nosv_hwc_emu *hwc_emu = &nosv_emu->hwc;
+
 	/* Connect thread channels to PRV */
 	struct prv *prv = pvt_get_prv(pvt);
 	for (struct thread *t = emu->system.threads; t; t = t->gnext) {
-		if (connect_thread_prv(&emu->bay, t, prv) != 0) {
+		if (connect_thread_prv(hwc_emu, &emu->bay, t, prv) != 0) {
 			err("connect_thread_prv failed");
 			return -1;
 		}
@@ -320,6 +517,15 @@ connect_thread(struct emu *emu)
 	return 0;
 }
 
+static struct chan *
+thread_hwc_chan(struct thread *t, void *arg, int64_t index)
+{
+	UNUSED(arg);
+	struct nosv_thread *nosv_thread = EXT(t, 'V');
+
+	return &nosv_thread->hwc.chan[index];
+}
+
 static int
 connect_cpu_prv(struct emu *emu, struct cpu *syscpu, struct prv *prv)
 {
@@ -329,36 +535,23 @@ connect_cpu_prv(struct emu *emu, struct cpu *syscpu, struct prv *prv)
 	struct nosv_cpu *nosv_cpu = EXT(syscpu, 'V');
 	struct nosv_hwc_cpu *hwc_cpu = &nosv_cpu->hwc;
 
-	for (size_t i = 0; i < hwc_emu->n; i++) {
+	for (size_t i = 0; i < hwc_emu->nchan; i++) {
 		struct track *track = &hwc_cpu->track[i];
-		struct chan *sel = cpu_get_th_chan(syscpu);
 
+		/* Only the threads that run in the CPU are connected */
 		int64_t nthreads = (int64_t) emu->system.nthreads;
-		if (track_set_select(track, sel, NULL, nthreads) != 0) {
-			err("track_select failed");
+		if (track_set_cpu_running(track, syscpu, nthreads,
+					thread_hwc_chan, NULL, (int64_t) i) != 0) {
+			err("track_set_cpu_running failed");
 			return -1;
 		}
 
-		/* Add each thread as input */
-		for (struct thread *t = emu->system.threads; t; t = t->gnext) {
-			struct nosv_thread *nosv_thread = EXT(t, 'V');
-			struct nosv_hwc_thread *hwc_thread = &nosv_thread->hwc;
-
-			/* Use the input thread directly */
-			struct chan *inp = &hwc_thread->chan[i];
-
-			if (track_set_input(track, t->gindex, inp) != 0) {
-				err("track_add_input failed");
-				return -1;
-			}
-		}
-
 		/* Then connect the output of the tracking module to the prv
 		 * trace for the current cpu */
 		struct chan *out = track_get_output(track);
 		long row = (long) syscpu->gindex;
 		long flags = PRV_SKIPDUPNULL | PRV_ZERO;
-		long prvtype = (long) (PRV_NOSV_HWC + i);
+		long prvtype = chan_prvtype(hwc_emu, i);
 		if (prv_register(prv, row, prvtype, &emu->bay, out, flags)) {
 			err("prv_register failed");
 			return -1;
@@ -421,6 +614,69 @@ hwc_connect(struct emu *emu)
 	return 0;
 }
 
+static int
+acc_add(struct nosv_hwc_acc *acc, const int64_t *delta, size_t n, int64_t dt)
+{
+	int64_t *restrict sum = acc->sum;
+
+	/* Plain loop over contiguous arrays, so it can be vectorized */
+	for (size_t i = 0; i < n; i++)
+		sum[i] += delta[i];
+
+	acc->time += dt;
+
+	return 0;
+}
+
+/* Returns the accumulator of the task type running in the thread, or the
+ * one outside of tasks */
+static struct nosv_hwc_acc *
+running_acc(struct nosv_hwc_emu *hwc_emu, struct nosv_thread *th)
+{
+	struct body *body = task_get_running(&th->task_stack);
+	if (body == NULL)
+		return &hwc_emu->notask;
+
+	struct task_type *type = body_get_task(body)->type;
+	struct nosv_hwc_type *t = NULL;
+	HASH_FIND(hh, hwc_emu->types, &type->gid, sizeof(uint32_t), t);
+	if (t != NULL)
+		return &t->acc;
+
+	t = calloc(1, sizeof(struct nosv_hwc_type));
+	if (t == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	t->gid = type->gid;
+	t->label = strdup(type->label);
+	t->acc.sum = calloc(hwc_emu->n, sizeof(int64_t));
+	if (t->label == NULL || t->acc.sum == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	HASH_ADD(hh, hwc_emu->types, gid, sizeof(uint32_t), t);
+
+	return &t->acc;
+}
+
+/* Computes the derived metrics from the counters and the time. A zero
+ * denominator gives zero. */
+static void
+compute_metrics(struct nosv_hwc_emu *hwc_emu, const int64_t *values,
+		int64_t dt, double *results)
+{
+	for (size_t i = 0; i < hwc_emu->nmetrics; i++) {
+		struct nosv_hwc_metric *m = &hwc_emu->metrics[i];
+		double num = (double) (m->num == HWC_NS ? dt : values[m->num]);
+		double den = (double) (m->den == HWC_NS ? dt : values[m->den]);
+
+		results[i] = den != 0.0 ? num / den * m->mul : 0.0;
+	}
+}
+
 static int
 event_hwc_count(struct emu *emu)
 {
@@ -444,10 +700,16 @@ event_hwc_count(struct emu *emu)
 	/* Use memcpy to align array */
 	memcpy(hwc_emu->values, &emu->ev->payload->jumbo.data[0], array_size);
 
+	struct nosv_thread *nosv_thread = EXT(emu->thread, 'V');
+	struct nosv_hwc_thread *hwc_thread = &nosv_thread->hwc;
+
+	/* The counters are the deltas since the previous read in the
+	 * same thread, so they cover the time since then */
+	int64_t last_clock = hwc_thread->last_clock;
+	hwc_thread->last_clock = emu->ev->dclock;
+
 	/* Update all HWC channels for the given thread */
 	for (size_t i = 0; i < hwc_emu->n; i++) {
-		struct nosv_thread *nosv_thread = EXT(emu->thread, 'V');
-		struct nosv_hwc_thread *hwc_thread = &nosv_thread->hwc;
 		struct chan *ch = &hwc_thread->chan[i];
 		if (chan_set(ch, value_int64(hwc_emu->values[i])) != 0) {
 			err("chan_set failed for hwc channel %s", ch->name);
@@ -455,6 +717,40 @@ event_hwc_count(struct emu *emu)
 		}
 	}
 
+	/* The interval of the first read is unknown, so it only starts
+	 * the next one and is left out of the totals and metrics */
+	if (last_clock < 0)
+		return 0;
+
+	int64_t dt = emu->ev->dclock - last_clock;
+
+	/* Attributed to the body running when the counters are read */
+	struct nosv_hwc_acc *acc = running_acc(hwc_emu, nosv_thread);
+	if (acc == NULL) {
+		err("running_acc failed");
+		return -1;
+	}
+	acc_add(acc, hwc_emu->values, hwc_emu->n, dt);
+
+	struct cpu *cpu = emu->thread->cpu;
+	if (cpu != NULL) {
+		struct nosv_cpu *nosv_cpu = EXT(cpu, 'V');
+		acc_add(&nosv_cpu->hwc.acc, hwc_emu->values, hwc_emu->n, dt);
+	}
+
+	double *results = hwc_emu->results;
+	compute_metrics(hwc_emu, hwc_emu->values, dt, results);
+
+	for (size_t i = 0; i < hwc_emu->nmetrics; i++) {
+		struct chan *ch = &hwc_thread->chan[hwc_emu->n + i];
+		/* Rounded, the values are never negative */
+		int64_t v = (int64_t) (results[i] + 0.5);
+		if (chan_set(ch, value_int64(v)) != 0) {
+			err("chan_set failed for hwc channel %s", ch->name);
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
@@ -482,15 +778,13 @@ hwc_event(struct emu *emu)
 }
 
 static int
-write_cfg(const char *path, size_t i, const char *fmt, const char *name)
+write_cfg(const char *path, long type, const char *fmt, const char *name)
 {
 	char title[MAX_LABEL];
 
 	/* May truncate silently, but is safe */
 	snprintf(title, MAX_LABEL, fmt, name);
 
-	long type = (long) (PRV_NOSV_HWC + i);
-
 	struct cfg_file cf;
 	cfg_file_init(&cf, type, title);
 	cfg_file_color_mode(&cf, CFG_NGRAD);
@@ -504,6 +798,89 @@ write_cfg(const char *path, size_t i, const char *fmt, const char *name)
 	return 0;
 }
 
+static void
+write_acc(FILE *f, struct nosv_hwc_emu *hwc_emu, const char *level,
+		long id, const char *label, struct nosv_hwc_acc *acc)
+{
+	fprintf(f, "%s,", level);
+	if (id >= 0)
+		fprintf(f, "%ld", id);
+	fputc(',', f);
+	summary_write_str(f, label);
+	fprintf(f, ",%"PRIi64, acc->time);
+
+	for (size_t i = 0; i < hwc_emu->n; i++)
+		fprintf(f, ",%"PRIi64, acc->sum[i]);
+
+	compute_metrics(hwc_emu, acc->sum, acc->time, hwc_emu->results);
+	for (size_t i = 0; i < hwc_emu->nmetrics; i++)
+		fprintf(f, ",%.3f", hwc_emu->results[i]);
+
+	fputc('\n', f);
+}
+
+/* Writes the counters and metrics accumulated per task type and CPU */
+static int
+write_table(struct emu *emu, struct nosv_hwc_emu *hwc_emu)
+{
+	char path[PATH_MAX];
+	if (snprintf(path, PATH_MAX, "%s/nosv-hwc.csv", emu->args.tracedir) >= PATH_MAX) {
+		err("hwc table path too long");
+		return -1;
+	}
+
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		err("cannot open HWC table '%s':", path);
+		return -1;
+	}
+
+	fprintf(f, "level,id,label,time_ns");
+	for (size_t i = 0; i < hwc_emu->nchan; i++) {
+		fputc(',', f);
+		summary_write_str(f, chan_label(hwc_emu, i));
+	}
+	fputc('\n', f);
+
+	for (struct nosv_hwc_type *t = hwc_emu->types; t; t = t->hh.next)
+		write_acc(f, hwc_emu, "type", t->gid, t->label, &t->acc);
+
+	write_acc(f, hwc_emu, "notask", -1, "", &hwc_emu->notask);
+
+	for (struct cpu *cpu = emu->system.cpus; cpu; cpu = cpu->next) {
+		struct nosv_cpu *nosv_cpu = EXT(cpu, 'V');
+		write_acc(f, hwc_emu, "cpu", cpu->gindex, cpu->name, &nosv_cpu->hwc.acc);
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+static void
+free_hwc(struct nosv_hwc_emu *hwc_emu)
+{
+	struct nosv_hwc_type *t, *tmp;
+	HASH_ITER(hh, hwc_emu->types, t, tmp) {
+		HASH_DEL(hwc_emu->types, t);
+		free(t->label);
+		free(t->acc.sum);
+		free(t);
+	}
+
+	for (size_t i = 0; i < hwc_emu->nmetrics; i++)
+		free(hwc_emu->metrics[i].name);
+
+	for (size_t i = 0; i < hwc_emu->n; i++)
+		free(hwc_emu->name[i]);
+
+	free(hwc_emu->name);
+	free(hwc_emu->values);
+	free(hwc_emu->metrics);
+	free(hwc_emu->results);
+	free(hwc_emu->notask.sum);
+}
+
 int
 hwc_finish(struct emu *emu)
 {
@@ -513,11 +890,23 @@ hwc_finish(struct emu *emu)
 	if (hwc_emu->n == 0)
 		return 0;
 
-	/* Write CFG files with HWC names. */
+	if (write_table(emu, hwc_emu) != 0) {
+		err("write_table failed");
+		return -1;
+	}
 
-	for (size_t i = 0; i < hwc_emu->n; i++) {
+	/* No trace, so no cfg is needed */
+	if (emu->args.summary) {
+		free_hwc(hwc_emu);
+		return 0;
+	}
+
+	/* Write CFG files with HWC and metric names. */
+
+	for (size_t i = 0; i < hwc_emu->nchan; i++) {
 		const char *dir = emu->args.tracedir;
-		const char *name = hwc_emu->name[i];
+		const char *name = chan_label(hwc_emu, i);
+		long type = chan_prvtype(hwc_emu, i);
 		char path[PATH_MAX];
 
 		/* Create thread configs */
@@ -525,7 +914,7 @@ hwc_finish(struct emu *emu)
 			err("hwc thread cfg path too long");
 			return -1;
 		}
-		if (write_cfg(path, i, "Thread: nOS-V %s of the ACTIVE thread", name) != 0) {
+		if (write_cfg(path, type, "Thread: nOS-V %s of the ACTIVE thread", name) != 0) {
 			err("write_cfg failed");
 			return -1;
 		}
@@ -535,11 +924,13 @@ hwc_finish(struct emu *emu)
 			err("hwc cpu cfg path too long");
 			return -1;
 		}
-		if (write_cfg(path, i, "CPU: nOS-V %s of the RUNNING thread", name) != 0) {
+		if (write_cfg(path, type, "CPU: nOS-V %s of the RUNNING thread", name) != 0) {
 			err("write_cfg failed");
 			return -1;
 		}
 	}
 
+	free_hwc(hwc_emu);
+
 	return 0;
 }
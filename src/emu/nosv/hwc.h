@@ -1,27 +1,69 @@
 #ifndef HWC_H
 #define HWC_H
 
+#include <stdint.h>
 #include "common.h"
+#include "uthash.h"
 
 struct emu;
 struct chan;
 
+/* Operand of a derived metric which is the elapsed time in ns */
+#define HWC_NS (-1)
+
+/* Maximum number of derived metrics */
+#define HWC_MAX_METRICS 50
+
+/* Derived metric computed as num / den * mul from the counter deltas */
+struct nosv_hwc_metric {
+	char *name;
+	long num; /* Counter index or HWC_NS */
+	long den;
+	double mul;
+};
+
+/* Deltas of the counters and the time accumulated */
+struct nosv_hwc_acc {
+	int64_t time;
+	int64_t *sum;
+};
+
+/* Accumulated counters of all the bodies of a task type */
+struct nosv_hwc_type {
+	uint32_t gid;
+	char *label;
+	struct nosv_hwc_acc acc;
+	UT_hash_handle hh;
+};
+
 /* Store each HWC channel per emu */
 struct nosv_hwc_emu {
 	char **name;
 	size_t n;
 	int64_t *values;
+
+	/* Derived metrics, after the counters in the channels */
+	struct nosv_hwc_metric *metrics;
+	size_t nmetrics;
+	size_t nchan; /* Counters and metrics */
+	double *results;
+
+	/* Per task type, and outside of any task */
+	struct nosv_hwc_type *types;
+	struct nosv_hwc_acc notask;
 };
 
 struct nosv_hwc_thread {
 	struct track *track;
 	struct chan *chan;
 	size_t n;
+	int64_t last_clock; /* Of the last read, -1 if none */
 };
 
 struct nosv_hwc_cpu {
 	struct track *track;
 	size_t n;
+	struct nosv_hwc_acc acc;
 };
 
 USE_RET int hwc_create(struct emu *emu);
@@ -187,7 +187,7 @@ update_task(struct emu *emu)
 	struct task_info *info = &proc->task_info;
 	struct task_stack *stack = &th->task_stack;
 
-	struct task *task = task_find(info->tasks, taskid);
+	struct task *task = task_find(info, taskid);
 
 	if (task == NULL) {
 		err("cannot find task with id %u", taskid);
@@ -365,6 +365,15 @@ end_lint(struct emu *emu)
 	/* Ensure we run out of function states */
 	for (struct thread *t = sys->threads; t; t = t->gnext) {
 		struct openmp_thread *th = EXT(t, model_id);
+
+		/* Never used by the thread */
+		if (th->m.ch == NULL)
+			continue;
+
+		/* The pops may be lost in the flight recorder */
+		if (t->is_truncated)
+			continue;
+
 		struct chan *ch = &th->m.ch[CH_SUBSYSTEM];
 		int stacked = ch->data.stack.n;
 		if (stacked > 0) {
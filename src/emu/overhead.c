@@ -0,0 +1,193 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "overhead.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "parson.h"
+#include "pv/prv.h"
+#include "pv/pvt.h"
+#include "recorder.h"
+#include "system.h"
+#include "thread.h"
+
+/* An overall overhead above this percentage is warned */
+#define OVERHEAD_WARN 5.0
+
+static struct prv *
+find_prv(struct recorder *rec, const char *name)
+{
+	struct pvt *pvt = recorder_find_pvt(rec, name);
+	if (pvt == NULL) {
+		err("cannot find %s pvt", name);
+		return NULL;
+	}
+
+	return pvt_get_prv(pvt);
+}
+
+/** Loads the calibrated emit cost of each thread from the metadata. If
+ * compensate is set, the overhead is subtracted from the summary of the
+ * thread and CPU rows, so the recorder must be in summary mode. */
+int
+overhead_init(struct overhead *oh, struct system *sys, struct recorder *rec, int compensate)
+{
+	memset(oh, 0, sizeof(*oh));
+
+	oh->compensate = compensate;
+	oh->nthreads = sys->nthreads;
+	oh->th = calloc(oh->nthreads ? oh->nthreads : 1, sizeof(struct overhead_thread));
+	if (oh->th == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
+
+	for (struct thread *th = sys->threads; th; th = th->gnext) {
+		double emit_ns = json_object_dotget_number(th->meta, "ovni.calib.emit_ns");
+		if (emit_ns > 0.0) {
+			oh->th[th->gindex].emit_ns = emit_ns;
+			oh->ncalibrated++;
+		}
+	}
+
+	if (!compensate)
+		return 0;
+
+	if ((oh->thread_prv = find_prv(rec, "thread")) == NULL)
+		return -1;
+	if ((oh->cpu_prv = find_prv(rec, "cpu")) == NULL)
+		return -1;
+
+	if (!oh->thread_prv->summary || !oh->cpu_prv->summary) {
+		err("the overhead can only be compensated in summary mode");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+discount(struct overhead *oh, struct thread *th, int64_t ns)
+{
+	if (prv_discount(oh->thread_prv, (long) th->gindex, ns) != 0) {
+		err("prv_discount failed for thread %s", th->id);
+		return -1;
+	}
+
+	/* Only when the thread is the one running on the CPU */
+	struct cpu *cpu = th->cpu;
+	if (cpu == NULL || cpu->th_running != th)
+		return 0;
+
+	if (prv_discount(oh->cpu_prv, (long) cpu->gindex, ns) != 0) {
+		err("prv_discount failed for cpu %s", cpu->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Accounts the cost of one event emitted by the thread at the given
+ * clock */
+int
+overhead_event(struct overhead *oh, struct thread *th, int64_t clock)
+{
+	struct overhead_thread *t = &oh->th[th->gindex];
+
+	if (t->nevents++ == 0)
+		t->first_clock = clock;
+	t->last_clock = clock;
+
+	if (!oh->compensate || t->emit_ns == 0.0)
+		return 0;
+
+	/* Only whole ns are discounted, the rest is carried */
+	t->carry += t->emit_ns;
+	int64_t ns = (int64_t) t->carry;
+	if (ns == 0)
+		return 0;
+
+	t->carry -= (double) ns;
+
+	return discount(oh, th, ns);
+}
+
+/** Accounts a flush of ns nanoseconds of the thread */
+int
+overhead_flush(struct overhead *oh, struct thread *th, int64_t ns)
+{
+	oh->th[th->gindex].flush_ns += ns;
+
+	if (!oh->compensate)
+		return 0;
+
+	return discount(oh, th, ns);
+}
+
+/** Writes the overhead of each thread over its lifetime in overhead.csv
+ * in the trace directory and reports the aggregate of all threads */
+int
+overhead_finish(struct overhead *oh, struct system *sys, const char *tracedir)
+{
+	int ret = -1;
+	FILE *f = NULL;
+
+	if (oh->ncalibrated == 0)
+		info("no emit cost calibration in the trace, only the flushes are accounted");
+
+	char path[PATH_MAX];
+	if (snprintf(path, PATH_MAX, "%s/overhead.csv", tracedir) >= PATH_MAX) {
+		err("overhead table path too long");
+		goto out;
+	}
+
+	if ((f = fopen(path, "w")) == NULL) {
+		err("cannot open overhead table '%s':", path);
+		goto out;
+	}
+
+	fprintf(f, "thread,tid,events,emit_ns,flush_ns,lifetime_ns,overhead_pct\n");
+
+	double total_ns = 0.0;
+	double total_oh = 0.0;
+	for (struct thread *th = sys->threads; th; th = th->gnext) {
+		struct overhead_thread *t = &oh->th[th->gindex];
+		int64_t lifetime = t->last_clock - t->first_clock;
+		if (lifetime <= 0)
+			continue;
+
+		double emit_ns = t->emit_ns * (double) t->nevents;
+		double ns = emit_ns + (double) t->flush_ns;
+		double pct = 100.0 * ns / (double) lifetime;
+
+		fprintf(f, "%s,%d,%"PRIi64",%.0f,%"PRIi64",%"PRIi64",%.3f\n",
+				th->id, th->tid, t->nevents, emit_ns,
+				t->flush_ns, lifetime, pct);
+
+		total_ns += (double) lifetime;
+		total_oh += ns;
+	}
+
+	if (total_ns > 0.0) {
+		double pct = 100.0 * total_oh / total_ns;
+		info("instrumentation overhead: %.2f%% of the thread time, see %s", pct, path);
+		if (pct > OVERHEAD_WARN)
+			warn("large instrumentation overhead of %.2f%%", pct);
+	}
+
+	if (oh->compensate)
+		info("the overhead was subtracted from the thread and cpu summary");
+
+	ret = 0;
+
+out:
+	if (f != NULL)
+		fclose(f);
+	free(oh->th);
+	oh->th = NULL;
+
+	return ret;
+}
@@ -0,0 +1,43 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#ifndef OVERHEAD_H
+#define OVERHEAD_H
+
+/* Estimates the time each thread spends in the instrumentation, from the
+ * emit cost calibrated by libovni and the duration of the flushes. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+struct prv;
+struct recorder;
+struct system;
+struct thread;
+
+struct overhead_thread {
+	double emit_ns; /* Calibrated cost of one event, 0 if unknown */
+	double carry; /* Emit cost not discounted yet, below 1 ns */
+	int64_t nevents;
+	int64_t flush_ns;
+	int64_t first_clock;
+	int64_t last_clock;
+};
+
+struct overhead {
+	/* Subtract the overhead from the summary of the threads and CPUs */
+	int compensate;
+	struct prv *thread_prv;
+	struct prv *cpu_prv;
+
+	size_t nthreads;
+	struct overhead_thread *th; /* Indexed by the thread gindex */
+	size_t ncalibrated;
+};
+
+USE_RET int overhead_init(struct overhead *oh, struct system *sys, struct recorder *rec, int compensate);
+USE_RET int overhead_event(struct overhead *oh, struct thread *th, int64_t clock);
+USE_RET int overhead_flush(struct overhead *oh, struct thread *th, int64_t ns);
+USE_RET int overhead_finish(struct overhead *oh, struct system *sys, const char *tracedir);
+
+#endif /* OVERHEAD_H */
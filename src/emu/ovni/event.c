@@ -291,6 +291,12 @@ pre_affinity_remote(struct emu *emu)
 	}
 
 	if (remote_th->state == TH_ST_UNKNOWN) {
+		/* The stream of the remote thread may not have begun yet */
+		if (remote_th->is_truncated) {
+			dbg("ignoring affinity of truncated thread %d", tid);
+			return 0;
+		}
+
 		err("thread %d in state unknown", tid);
 		return -1;
 	}
@@ -434,6 +440,10 @@ pre_flush(struct emu *emu)
 				return -1;
 			}
 			int64_t flush_ns = emu->ev->dclock - th->flush_start;
+			if (overhead_flush(&emu->overhead, emu->thread, flush_ns) != 0) {
+				err("overhead_flush failed");
+				return -1;
+			}
 			double flush_ms = (double) flush_ns * 1e-6;
 			/* Avoid last flush warnings */
 			if (flush_ms > 10.0 && emu->thread->is_running)
@@ -1,5 +1,6 @@
 #include "mark.h"
 
+#include "arena.h"
 #include "chan.h"
 #include "cpu.h"
 #include "emu.h"
@@ -303,7 +304,7 @@ create_thread_chan(struct ovni_mark_emu *m, struct bay *bay, struct thread *th)
 	struct ovni_mark_thread *t = &oth->mark;
 
 	/* Create as many channels as required */
-	t->channels = calloc((size_t) m->ntypes, sizeof(struct chan));
+	t->channels = arena_calloc(bay->arena, (size_t) m->ntypes, sizeof(struct chan));
 	if (t->channels == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -330,7 +331,7 @@ create_thread_chan(struct ovni_mark_emu *m, struct bay *bay, struct thread *th)
 	}
 
 	/* Setup tracking */
-	t->track = calloc((size_t) m->ntypes, sizeof(struct track));
+	t->track = arena_calloc(bay->arena, (size_t) m->ntypes, sizeof(struct track));
 	if (t->track == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -358,7 +359,7 @@ init_cpu(struct ovni_mark_emu *m, struct bay *bay, struct cpu *cpu)
 	struct ovni_mark_cpu *c = &ocpu->mark;
 
 	/* Setup tracking */
-	c->track = calloc((size_t) m->ntypes, sizeof(struct track));
+	c->track = arena_calloc(bay->arena, (size_t) m->ntypes, sizeof(struct track));
 	if (c->track == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -518,6 +519,15 @@ connect_thread(struct emu *emu)
 	return 0;
 }
 
+static struct chan *
+thread_mark_chan(struct thread *t, void *arg, int64_t index)
+{
+	UNUSED(arg);
+	struct ovni_thread *oth = EXT(t, 'O');
+
+	return &oth->mark.channels[index];
+}
+
 static int
 connect_cpu_prv(struct emu *emu, struct cpu *scpu, struct prv *prv)
 {
@@ -532,28 +542,15 @@ connect_cpu_prv(struct emu *emu, struct cpu *scpu, struct prv *prv)
 		 * avoid the double hash access in events */
 		long i = type->index;
 		struct track *track = &mcpu->track[i];
-		struct chan *sel = cpu_get_th_chan(scpu);
 
+		/* Only the threads that run in the CPU are connected */
 		int64_t nthreads = (int64_t) emu->system.nthreads;
-		if (track_set_select(track, sel, NULL, nthreads) != 0) {
-			err("track_select failed");
+		if (track_set_cpu_running(track, scpu, nthreads,
+					thread_mark_chan, NULL, i) != 0) {
+			err("track_set_cpu_running failed");
 			return -1;
 		}
 
-		/* Add each thread as input */
-		for (struct thread *t = emu->system.threads; t; t = t->gnext) {
-			struct ovni_thread *oth = EXT(t, 'O');
-			struct ovni_mark_thread *mth = &oth->mark;
-
-			/* Use the input thread directly */
-			struct chan *inp = &mth->channels[i];
-
-			if (track_set_input(track, t->gindex, inp) != 0) {
-				err("track_add_input failed");
-				return -1;
-			}
-		}
-
 		/* Then connect the output of the tracking module to the prv
 		 * trace for the current cpu */
 		struct chan *out = track_get_output(track);
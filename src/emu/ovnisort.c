@@ -369,6 +369,12 @@ stream_winsort(struct stream *stream, struct ring *r)
 
 	ring_reset(r);
 
+	/* The ring keeps pointers to previous events */
+	if (stream_map_all(stream) != 0) {
+		err("stream_map_all failed");
+		return -1;
+	}
+
 	struct sortplan sp = {0};
 	sp.r = r;
 	sp.fd = fd;
@@ -492,7 +498,20 @@ process_trace(struct trace *trace)
 	for (struct stream *stream = trace->streams; stream; stream = stream->next) {
 		stream_allow_unsorted(stream);
 
+		/* Nothing to sort in streams without events */
+		if (!stream->active)
+			continue;
+
 		if (operation_mode == SORT) {
+			/* The chunks of other threads are interleaved in
+			 * the container, so the stream cannot be sorted in
+			 * place */
+			if (stream->container) {
+				err("cannot sort stream %s in a process container",
+						stream->relpath);
+				return -1;
+			}
+
 			dbg("sorting stream %s", stream->relpath);
 			if (stream_winsort(stream, &ring) != 0) {
 				err("sort stream %s failed", stream->relpath);
@@ -188,6 +188,9 @@ proc_add_thread(struct proc *proc, struct thread *thread)
 	HASH_ADD_INT(proc->threads, tid, thread);
 	proc->nthreads++;
 
+	if (thread->is_truncated)
+		proc->is_truncated = 1;
+
 	thread_set_proc(thread, proc);
 
 	return 0;
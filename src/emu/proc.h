@@ -27,6 +27,10 @@ struct proc {
 	int nthreads;
 	struct thread *threads;
 
+	/* Some thread stream begins in the middle of the execution, so
+	 * the tasks or types it created may be unknown */
+	int is_truncated;
+
 	/* Required to find if a thread belongs to the same loom as a
 	 * CPU */
 	struct loom *loom;
@@ -47,7 +47,18 @@ copy_file(const char *src, const char *dst)
 }
 
 static int
-copy_recursive(const char *src, const char *dst)
+is_skipped(const char *name, const char *const *skip)
+{
+	for (int i = 0; skip != NULL && skip[i] != NULL; i++) {
+		if (strcmp(name, skip[i]) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int
+copy_recursive(const char *src, const char *dst, const char *const *skip)
 {
 	DIR *dir;
 	int failed = 0;
@@ -110,7 +121,11 @@ copy_recursive(const char *src, const char *dst)
 		}
 
 		if (S_ISDIR(st.st_mode)) {
-			if (copy_recursive(newsrc, newdst) != 0) {
+			/* The configurations are grouped by model */
+			if (is_skipped(dirent->d_name, skip))
+				continue;
+
+			if (copy_recursive(newsrc, newdst, skip) != 0) {
 				failed = 1;
 			}
 		} else {
@@ -133,8 +148,10 @@ copy_recursive(const char *src, const char *dst)
 	return 0;
 }
 
+/** Copies the configuration files into the trace, except the directories
+ * of the models in the NULL terminated skip list, which may be NULL. */
 int
-cfg_generate(const char *tracedir)
+cfg_generate(const char *tracedir, const char *const *skip)
 {
 	/* TODO: generate the configuration files dynamically instead of
 	 * copying them from a directory */
@@ -158,7 +175,7 @@ cfg_generate(const char *tracedir)
 		return 0;
 	}
 
-	if (copy_recursive(src, dst) != 0) {
+	if (copy_recursive(src, dst, skip) != 0) {
 		err("cannot copy config files: recursive copy failed");
 		return -1;
 	}
@@ -6,6 +6,6 @@
 
 #include "common.h"
 
-USE_RET int cfg_generate(const char *tracedir);
+USE_RET int cfg_generate(const char *tracedir, const char *const *skip);
 
 #endif /* CFG_H */
@@ -0,0 +1,470 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "gzout.h"
+#include "config.h"
+
+#ifdef HAVE_ZLIB
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* Size of the uncompressed blocks */
+#define BLOCK_SIZE (1L << 20)
+
+/* Blocks in flight per worker, bounds the memory used */
+#define BLOCKS_PER_WORKER 4
+
+struct gzblock {
+	struct gzout *out;
+	uint64_t seq;
+	char *buf;
+	size_t len;
+	uint8_t *zbuf;
+	size_t zlen;
+	struct gzblock *next;
+};
+
+struct gzout {
+	int fd;
+
+	/* Block being filled by the emulator */
+	struct gzblock *cur;
+
+	/* Sequence number of the next block to be submitted and written */
+	uint64_t seq_next;
+	uint64_t seq_write;
+
+	/* Compressed blocks waiting for the previous ones, sorted by seq */
+	struct gzblock *done;
+
+	/* Size of the first member, with the header */
+	size_t hsize;
+
+	int error;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/* Shared among all files */
+static struct {
+	int nworkers;
+	pthread_t *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t cond_job;
+	pthread_cond_t cond_space;
+	struct gzblock *head;
+	struct gzblock *tail;
+	int inflight;
+	int max_inflight;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond_job = PTHREAD_COND_INITIALIZER,
+	.cond_space = PTHREAD_COND_INITIALIZER,
+};
+
+int
+gzout_available(void)
+{
+	return 1;
+}
+
+static int
+write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			err("write failed:");
+			return -1;
+		}
+		buf += n;
+		len -= (size_t) n;
+	}
+
+	return 0;
+}
+
+/* Compresses the buffer as a complete gzip member */
+static int
+compress_member(const char *buf, size_t len, int level,
+		uint8_t **zbuf, size_t *zlen)
+{
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+
+	/* The 16 adds the gzip header and trailer */
+	if (deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 8,
+				Z_DEFAULT_STRATEGY) != Z_OK) {
+		err("deflateInit2 failed");
+		return -1;
+	}
+
+	uLong bound = deflateBound(&z, (uLong) len);
+	*zbuf = malloc(bound);
+	if (*zbuf == NULL) {
+		err("malloc failed:");
+		deflateEnd(&z);
+		return -1;
+	}
+
+	z.next_in = (Bytef *) buf;
+	z.avail_in = (uInt) len;
+	z.next_out = *zbuf;
+	z.avail_out = (uInt) bound;
+
+	if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+		err("deflate failed");
+		deflateEnd(&z);
+		free(*zbuf);
+		return -1;
+	}
+
+	*zlen = (size_t) z.total_out;
+	deflateEnd(&z);
+
+	return 0;
+}
+
+static void
+block_free(struct gzblock *b)
+{
+	free(b->buf);
+	free(b->zbuf);
+	free(b);
+}
+
+/* Writes the compressed blocks that follow the last written, in order.
+ * Must be called with the lock of the file held. */
+static int
+write_ready(struct gzout *out)
+{
+	int nwritten = 0;
+	while (out->done != NULL && out->done->seq == out->seq_write) {
+		struct gzblock *b = out->done;
+		out->done = b->next;
+
+		/* Not compressed due to an error */
+		if (b->zbuf == NULL)
+			out->error = 1;
+		else if (!out->error && write_all(out->fd, b->zbuf, b->zlen) != 0)
+			out->error = 1;
+
+		block_free(b);
+		out->seq_write++;
+		nwritten++;
+	}
+
+	return nwritten;
+}
+
+static void
+block_done(struct gzblock *b)
+{
+	struct gzout *out = b->out;
+
+	pthread_mutex_lock(&out->lock);
+
+	/* Insert sorted by seq */
+	struct gzblock **p = &out->done;
+	while (*p != NULL && (*p)->seq < b->seq)
+		p = &(*p)->next;
+	b->next = *p;
+	*p = b;
+
+	int nwritten = write_ready(out);
+	pthread_cond_broadcast(&out->cond);
+	pthread_mutex_unlock(&out->lock);
+
+	if (nwritten > 0) {
+		pthread_mutex_lock(&pool.lock);
+		pool.inflight -= nwritten;
+		pthread_cond_broadcast(&pool.cond_space);
+		pthread_mutex_unlock(&pool.lock);
+	}
+}
+
+static void *
+worker(void *arg)
+{
+	UNUSED(arg);
+
+	while (1) {
+		pthread_mutex_lock(&pool.lock);
+		while (pool.head == NULL)
+			pthread_cond_wait(&pool.cond_job, &pool.lock);
+
+		struct gzblock *b = pool.head;
+		pool.head = b->next;
+		if (pool.head == NULL)
+			pool.tail = NULL;
+		pthread_mutex_unlock(&pool.lock);
+
+		b->next = NULL;
+		if (compress_member(b->buf, b->len, Z_DEFAULT_COMPRESSION,
+					&b->zbuf, &b->zlen) != 0) {
+			err("cannot compress block %"PRIu64, b->seq);
+			b->zbuf = NULL;
+			b->zlen = 0;
+		}
+
+		block_done(b);
+	}
+
+	return NULL;
+}
+
+/** Sets the number of workers, which are started on the first call. */
+int
+gzout_set_workers(int nworkers)
+{
+	if (pool.workers != NULL)
+		return 0;
+
+	if (nworkers < 1)
+		nworkers = 1;
+
+	pool.workers = calloc((size_t) nworkers, sizeof(pthread_t));
+	if (pool.workers == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
+
+	for (int i = 0; i < nworkers; i++) {
+		if (pthread_create(&pool.workers[i], NULL, worker, NULL) != 0) {
+			err("pthread_create failed");
+			return -1;
+		}
+
+		/* Never joined, they wait for jobs until the end */
+		pthread_detach(pool.workers[i]);
+	}
+
+	pool.nworkers = nworkers;
+	pool.max_inflight = BLOCKS_PER_WORKER * nworkers;
+
+	return 0;
+}
+
+static struct gzblock *
+block_new(struct gzout *out)
+{
+	struct gzblock *b = calloc(1, sizeof(*b));
+	if (b == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	b->buf = malloc(BLOCK_SIZE);
+	if (b->buf == NULL) {
+		err("malloc failed:");
+		free(b);
+		return NULL;
+	}
+
+	b->out = out;
+	b->seq = out->seq_next++;
+
+	return b;
+}
+
+/* Queues the current block to be compressed, waiting if there are too many
+ * blocks in flight, so the memory is bounded */
+static void
+submit(struct gzout *out)
+{
+	struct gzblock *b = out->cur;
+	out->cur = NULL;
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.inflight >= pool.max_inflight)
+		pthread_cond_wait(&pool.cond_space, &pool.lock);
+
+	pool.inflight++;
+	if (pool.tail == NULL)
+		pool.head = b;
+	else
+		pool.tail->next = b;
+	pool.tail = b;
+
+	pthread_cond_signal(&pool.cond_job);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/** Opens the gzip file. The header is stored uncompressed in the first
+ * member, so it can be replaced later with one of the same length. */
+struct gzout *
+gzout_open(const char *path, const char *header, size_t hlen)
+{
+	if (pool.workers == NULL && gzout_set_workers(1) != 0) {
+		err("gzout_set_workers failed");
+		return NULL;
+	}
+
+	struct gzout *out = calloc(1, sizeof(*out));
+	if (out == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out->fd < 0) {
+		err("open %s failed:", path);
+		free(out);
+		return NULL;
+	}
+
+	pthread_mutex_init(&out->lock, NULL);
+	pthread_cond_init(&out->cond, NULL);
+
+	uint8_t *zbuf;
+	if (compress_member(header, hlen, 0, &zbuf, &out->hsize) != 0) {
+		err("cannot compress header");
+		goto error;
+	}
+
+	int ret = write_all(out->fd, zbuf, out->hsize);
+	free(zbuf);
+
+	if (ret != 0) {
+		err("cannot write header to %s", path);
+		goto error;
+	}
+
+	return out;
+
+error:
+	close(out->fd);
+	pthread_mutex_destroy(&out->lock);
+	pthread_cond_destroy(&out->cond);
+	free(out);
+	return NULL;
+}
+
+/** Returns a pointer to write up to len bytes, which are added with
+ * gzout_commit(). */
+char *
+gzout_reserve(struct gzout *out, size_t len)
+{
+	if (len > BLOCK_SIZE) {
+		err("reserve of %zu bytes exceeds the block size", len);
+		return NULL;
+	}
+
+	if (out->cur != NULL && out->cur->len + len > BLOCK_SIZE)
+		submit(out);
+
+	if (out->cur == NULL && (out->cur = block_new(out)) == NULL) {
+		err("block_new failed");
+		return NULL;
+	}
+
+	return out->cur->buf + out->cur->len;
+}
+
+void
+gzout_commit(struct gzout *out, size_t len)
+{
+	out->cur->len += len;
+}
+
+/** Waits for all blocks to be written, replaces the header and closes the
+ * file. The new header must have the same length as the original. */
+int
+gzout_close(struct gzout *out, const char *header, size_t hlen)
+{
+	if (out->cur != NULL)
+		submit(out);
+
+	pthread_mutex_lock(&out->lock);
+	while (out->seq_write < out->seq_next)
+		pthread_cond_wait(&out->cond, &out->lock);
+	int ret = out->error ? -1 : 0;
+	pthread_mutex_unlock(&out->lock);
+
+	/* Stored without compression, so the size only depends on the
+	 * length of the header */
+	uint8_t *zbuf;
+	size_t zlen;
+	if (compress_member(header, hlen, 0, &zbuf, &zlen) != 0) {
+		err("cannot compress header");
+		ret = -1;
+	} else {
+		if (zlen != out->hsize) {
+			err("header size changed from %zu to %zu", out->hsize, zlen);
+			ret = -1;
+		} else if (pwrite(out->fd, zbuf, zlen, 0) != (ssize_t) zlen) {
+			err("pwrite failed:");
+			ret = -1;
+		}
+		free(zbuf);
+	}
+
+	if (close(out->fd) != 0) {
+		err("close failed:");
+		ret = -1;
+	}
+
+	pthread_mutex_destroy(&out->lock);
+	pthread_cond_destroy(&out->cond);
+	free(out);
+
+	return ret;
+}
+
+#else /* HAVE_ZLIB */
+
+int
+gzout_available(void)
+{
+	return 0;
+}
+
+int
+gzout_set_workers(int nworkers)
+{
+	UNUSED(nworkers);
+	err("compiled without zlib");
+	return -1;
+}
+
+struct gzout *
+gzout_open(const char *path, const char *header, size_t hlen)
+{
+	UNUSED(path);
+	UNUSED(header);
+	UNUSED(hlen);
+	err("compiled without zlib");
+	return NULL;
+}
+
+char *
+gzout_reserve(struct gzout *out, size_t len)
+{
+	UNUSED(out);
+	UNUSED(len);
+	return NULL;
+}
+
+void
+gzout_commit(struct gzout *out, size_t len)
+{
+	UNUSED(out);
+	UNUSED(len);
+}
+
+int
+gzout_close(struct gzout *out, const char *header, size_t hlen)
+{
+	UNUSED(out);
+	UNUSED(header);
+	UNUSED(hlen);
+	return -1;
+}
+
+#endif /* HAVE_ZLIB */
@@ -0,0 +1,22 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#ifndef GZOUT_H
+#define GZOUT_H
+
+/* Writes a gzip file as a sequence of independent members, so the blocks
+ * can be compressed in parallel by a pool of workers while the emulator
+ * continues, and read back as a single stream. */
+
+#include <stddef.h>
+#include "common.h"
+struct gzout;
+
+USE_RET int gzout_available(void);
+USE_RET int gzout_set_workers(int nworkers);
+USE_RET struct gzout *gzout_open(const char *path, const char *header, size_t hlen);
+USE_RET char *gzout_reserve(struct gzout *out, size_t len);
+        void gzout_commit(struct gzout *out, size_t len);
+USE_RET int gzout_close(struct gzout *out, const char *header, size_t hlen);
+
+#endif /* GZOUT_H */
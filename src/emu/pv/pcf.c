@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "common.h"
 
 /* clang-format off */
@@ -106,22 +107,44 @@ write_type(FILE *f, struct pcf_type *type)
 	fprintf(f, "0 %-10d %s\n", type->id, type->label);
 	fprintf(f, "VALUES\n");
 
-	for (struct pcf_value *v = type->values; v != NULL; v = v->hh.next)
+	for (int i = 0; i < type->nvalues; i++) {
+		struct pcf_value *v = &type->values[i];
 		fprintf(f, "%-4d %s\n", v->value, v->label);
+	}
 }
 
 static void
-write_types(struct pcf *pcf)
+free_values(struct pcf_type *type)
 {
-	for (struct pcf_type *t = pcf->types; t != NULL; t = t->hh.next)
-		write_type(pcf->f, t);
+	free(type->values);
+	free(type->sorted);
+	type->values = NULL;
+	type->sorted = NULL;
+	type->nvalues = 0;
+	type->maxvalues = 0;
+}
+
+static void
+write_header_once(struct pcf *pcf)
+{
+	if (pcf->is_header_written)
+		return;
+
+	write_header(pcf->f);
+	write_colors(pcf->f, pcf_palette, pcf_palette_len);
+	pcf->is_header_written = 1;
 }
 
-/** Open the given PCF file and create the default events. */
+/** Open the given PCF file and create the default events. If the path is
+ * NULL, the types are only kept in memory and no file is written. */
 int
 pcf_open(struct pcf *pcf, char *path)
 {
 	memset(pcf, 0, sizeof(*pcf));
+	strtab_init(&pcf->labels);
+
+	if (path == NULL)
+		return 0;
 
 	pcf->f = fopen(path, "w");
 
@@ -133,6 +156,13 @@ pcf_open(struct pcf *pcf, char *path)
 	return 0;
 }
 
+/** Allocates the types from the arena */
+void
+pcf_set_arena(struct pcf *pcf, struct arena *arena)
+{
+	pcf->arena = arena;
+}
+
 struct pcf_type *
 pcf_find_type(struct pcf *pcf, int type_id)
 {
@@ -158,19 +188,23 @@ pcf_add_type(struct pcf *pcf, int type_id, const char *label)
 		return NULL;
 	}
 
-	pcftype = calloc(1, sizeof(struct pcf_type));
+	if (strlen(label) >= MAX_PCF_LABEL) {
+		err("PCF type label too long");
+		return NULL;
+	}
+
+	pcftype = arena_calloc(pcf->arena, 1, sizeof(struct pcf_type));
 	if (pcftype == NULL) {
 		err("calloc failed:");
 		return NULL;
 	}
 
 	pcftype->id = type_id;
-	pcftype->values = NULL;
-	pcftype->nvalues = 0;
-
-	int len = snprintf(pcftype->label, MAX_PCF_LABEL, "%s", label);
-	if (len >= MAX_PCF_LABEL) {
-		err("PCF type label too long");
+	pcftype->pcf = pcf;
+	pcftype->label = strtab_intern(&pcf->labels, label);
+	if (pcftype->label == NULL) {
+		err("strtab_intern failed");
+		arena_free(pcf->arena, pcftype);
 		return NULL;
 	}
 
@@ -179,60 +213,174 @@ pcf_add_type(struct pcf *pcf, int type_id, const char *label)
 	return pcftype;
 }
 
+/** Removes the type and its values, so it is not written. */
+void
+pcf_del_type(struct pcf *pcf, struct pcf_type *type)
+{
+	free_values(type);
+	HASH_DEL(pcf->types, type);
+	arena_free(pcf->arena, type);
+}
+
+/* Returns the position in the sorted index where the value is or would
+ * be inserted */
+static int
+lower_bound(struct pcf_type *type, int value)
+{
+	int lo = 0;
+	int hi = type->nvalues;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (type->values[type->sorted[mid]].value < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/** Finds the value in the type. The pointer is only valid until the next
+ * value is added to the type. */
 struct pcf_value *
 pcf_find_value(struct pcf_type *type, int value)
 {
-	struct pcf_value *pcfvalue;
+	int i = lower_bound(type, value);
 
-	HASH_FIND_INT(type->values, &value, pcfvalue);
+	if (i == type->nvalues)
+		return NULL;
 
-	return pcfvalue;
+	struct pcf_value *v = &type->values[type->sorted[i]];
+	if (v->value != value)
+		return NULL;
+
+	return v;
+}
+
+static int
+grow_values(struct pcf_type *type)
+{
+	int n = type->maxvalues ? 2 * type->maxvalues : 16;
+
+	struct pcf_value *values = realloc(type->values,
+			(size_t) n * sizeof(struct pcf_value));
+	if (values == NULL) {
+		err("realloc failed:");
+		return -1;
+	}
+	type->values = values;
+
+	int *sorted = realloc(type->sorted, (size_t) n * sizeof(int));
+	if (sorted == NULL) {
+		err("realloc failed:");
+		return -1;
+	}
+	type->sorted = sorted;
+
+	type->maxvalues = n;
+
+	return 0;
 }
 
 /** Adds a new value to the given pcf_type. The label can be disposed
  * after return.
  *
- * @return The new pcf_value created
+ * @return The new pcf_value created, only valid until the next value is
+ * added to the type.
  */
 struct pcf_value *
 pcf_add_value(struct pcf_type *type, int value, const char *label)
 {
-	struct pcf_value *pcfvalue = pcf_find_value(type, value);
+	if (type->is_written) {
+		err("PCF type %d already written", type->id);
+		return NULL;
+	}
 
-	if (pcfvalue != NULL) {
+	/* Values are often added in order, so the common case appends */
+	int pos = type->nvalues;
+	if (pos > 0 && type->values[type->sorted[pos - 1]].value >= value)
+		pos = lower_bound(type, value);
+
+	if (pos < type->nvalues && type->values[type->sorted[pos]].value == value) {
 		err("PCF value %d already in type %d", value, type->id);
 		return NULL;
 	}
 
-	pcfvalue = calloc(1, sizeof(struct pcf_value));
-	if (pcfvalue == NULL) {
-		err("calloc failed:");
+	if (strlen(label) >= MAX_PCF_LABEL) {
+		err("PCF value label too long");
 		return NULL;
 	}
 
-	pcfvalue->value = value;
+	if (type->nvalues == type->maxvalues && grow_values(type) != 0) {
+		err("grow_values failed");
+		return NULL;
+	}
 
-	int len = snprintf(pcfvalue->label, MAX_PCF_LABEL, "%s", label);
-	if (len >= MAX_PCF_LABEL) {
-		err("PCF value label too long");
+	const char *interned = strtab_intern(&type->pcf->labels, label);
+	if (interned == NULL) {
+		err("strtab_intern failed");
 		return NULL;
 	}
 
-	HASH_ADD_INT(type->values, value, pcfvalue);
+	int index = type->nvalues++;
+	struct pcf_value *pcfvalue = &type->values[index];
+	pcfvalue->value = value;
+	pcfvalue->label = interned;
 
-	type->nvalues++;
+	memmove(&type->sorted[pos + 1], &type->sorted[pos],
+			(size_t) (index - pos) * sizeof(int));
+	type->sorted[pos] = index;
 
 	return pcfvalue;
 }
 
-/** Writes the defined event and values to the PCF file and closes the file. */
+/** Writes the types that already have values and releases them, so no
+ * more values can be added to those types. The types without values are
+ * written when the file is closed. Does nothing if there is no file, as
+ * the values are needed for the summary. */
+int
+pcf_flush(struct pcf *pcf)
+{
+	if (pcf->f == NULL)
+		return 0;
+
+	write_header_once(pcf);
+
+	for (struct pcf_type *t = pcf->types; t != NULL; t = t->hh.next) {
+		if (t->is_written || t->nvalues == 0)
+			continue;
+
+		write_type(pcf->f, t);
+		free_values(t);
+		t->is_written = 1;
+	}
+
+	return 0;
+}
+
+/** Writes the remaining types and values to the PCF file and closes the
+ * file. */
 int
 pcf_close(struct pcf *pcf)
 {
-	write_header(pcf->f);
-	write_colors(pcf->f, pcf_palette, pcf_palette_len);
-	write_types(pcf);
+	if (pcf->f != NULL) {
+		write_header_once(pcf);
+
+		for (struct pcf_type *t = pcf->types; t != NULL; t = t->hh.next) {
+			if (!t->is_written)
+				write_type(pcf->f, t);
+		}
+
+		fclose(pcf->f);
+		pcf->f = NULL;
+	}
+
+	struct pcf_type *t, *tmp;
+	HASH_ITER(hh, pcf->types, t, tmp)
+		pcf_del_type(pcf, t);
+
+	strtab_destroy(&pcf->labels);
 
-	fclose(pcf->f);
 	return 0;
 }
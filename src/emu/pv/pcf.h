@@ -4,9 +4,12 @@
 #ifndef PCF_H
 #define PCF_H
 
+#include <stddef.h>
 #include <stdio.h>
 #include "common.h"
+#include "strtab.h"
 #include "uthash.h"
+struct arena;
 
 #define MAX_PCF_LABEL 512
 
@@ -16,17 +19,23 @@ enum pcf_values {
 
 struct pcf_value {
 	int value;
-	char label[MAX_PCF_LABEL];
-
-	UT_hash_handle hh;
+	const char *label; /* Interned in the pcf labels */
 };
 
 struct pcf_type {
 	int id;
-	char label[MAX_PCF_LABEL];
+	const char *label; /* Interned in the pcf labels */
 
+	/* In insertion order, which is the order they are written */
 	int nvalues;
+	int maxvalues;
 	struct pcf_value *values;
+	int *sorted; /* Indices of values sorted by value */
+
+	/* Already written to the file, no more values can be added */
+	int is_written;
+
+	struct pcf *pcf;
 
 	UT_hash_handle hh;
 };
@@ -34,7 +43,10 @@ struct pcf_type {
 struct pcf {
 	FILE *f;
 	int pcf_ntypes;
+	int is_header_written;
 	struct pcf_type *types;
+	struct strtab labels;
+	struct arena *arena;
 };
 
 /* Only used to generate tables */
@@ -44,10 +56,13 @@ struct pcf_value_label {
 };
 
 USE_RET int pcf_open(struct pcf *pcf, char *path);
+USE_RET int pcf_flush(struct pcf *pcf);
 USE_RET int pcf_close(struct pcf *pcf);
+        void pcf_set_arena(struct pcf *pcf, struct arena *arena);
 
 USE_RET struct pcf_type *pcf_find_type(struct pcf *pcf, int type_id);
 USE_RET struct pcf_type *pcf_add_type(struct pcf *pcf, int type_id, const char *label);
+        void pcf_del_type(struct pcf *pcf, struct pcf_type *type);
 USE_RET struct pcf_value *pcf_add_value(struct pcf_type *type, int value, const char *label);
 USE_RET struct pcf_value *pcf_find_value(struct pcf_type *type, int value);
 
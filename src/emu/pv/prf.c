@@ -7,14 +7,15 @@
 #include <stdlib.h>
 #include "common.h"
 
+/** Opens the ROW file. If the path is NULL, the labels are only kept in
+ * memory and no file is written. */
 int
 prf_open(struct prf *prf, const char *path, long nrows)
 {
 	memset(prf, 0, sizeof(*prf));
+	strtab_init(&prf->labels);
 
-	prf->f = fopen(path, "w");
-
-	if (prf->f == NULL) {
+	if (path != NULL && (prf->f = fopen(path, "w")) == NULL) {
 		err("cannot open ROW file '%s':", path);
 		return -1;
 	}
@@ -33,40 +34,74 @@ prf_open(struct prf *prf, const char *path, long nrows)
 int
 prf_add(struct prf *prf, long index, const char *label)
 {
+	if (prf->is_written) {
+		err("ROW file already written");
+		return -1;
+	}
+
 	if (index < 0 || index >= prf->nrows) {
 		err("index out of bounds");
 		return -1;
 	}
 
 	struct prf_row *row = &prf->rows[index];
-	if (row->set) {
+	if (row->label != NULL) {
 		err("row %ld already set to '%s'", index, row->label);
 		return -1;
 	}
 
-	int n = snprintf(row->label, MAX_PRF_LABEL, "%s", label);
-
-	if (n >= MAX_PRF_LABEL) {
+	if (strlen(label) >= MAX_PRF_LABEL) {
 		err("label '%s' too long", label);
 		return -1;
 	}
 
-	row->set = 1;
+	if ((row->label = strtab_intern(&prf->labels, label)) == NULL) {
+		err("strtab_intern failed");
+		return -1;
+	}
+
+	prf->nset++;
 	return 0;
 }
 
+/** Sets the group of the row, used to aggregate the rows in the summary. */
 int
-prf_close(struct prf *prf)
+prf_set_group(struct prf *prf, long index, const char *group)
 {
-	for (long i = 0; i < prf->nrows; i++) {
-		struct prf_row *row = &prf->rows[i];
-		if (!row->set) {
-			err("row %ld not set", i);
-			return -1;
-		}
+	if (prf->is_written) {
+		err("ROW file already written");
+		return -1;
+	}
+
+	if (index < 0 || index >= prf->nrows) {
+		err("index out of bounds");
+		return -1;
+	}
+
+	if (strlen(group) >= MAX_PRF_GROUP) {
+		err("group '%s' too long", group);
+		return -1;
+	}
+
+	struct prf_row *row = &prf->rows[index];
+	if (group[0] == '\0') {
+		row->group = NULL;
+		return 0;
+	}
+
+	if ((row->group = strtab_intern(&prf->labels, group)) == NULL) {
+		err("strtab_intern failed");
+		return -1;
 	}
 
+	return 0;
+}
+
+static void
+write_rows(struct prf *prf)
+{
 	FILE *f = prf->f;
+
 	fprintf(f, "LEVEL NODE SIZE 1\n");
 	fprintf(f, "hostname\n");
 	fprintf(f, "\n");
@@ -79,6 +114,51 @@ prf_close(struct prf *prf)
 	}
 
 	fclose(f);
+	prf->f = NULL;
+}
+
+static void
+release_rows(struct prf *prf)
+{
+	free(prf->rows);
+	prf->rows = NULL;
+	strtab_destroy(&prf->labels);
+}
+
+/** Writes the ROW file and releases the labels if all the rows are
+ * already set. Does nothing if there is no file, as the labels are
+ * needed for the summary. */
+int
+prf_flush(struct prf *prf)
+{
+	if (prf->f == NULL || prf->is_written || prf->nset < prf->nrows)
+		return 0;
+
+	write_rows(prf);
+	release_rows(prf);
+	prf->is_written = 1;
+
+	return 0;
+}
+
+int
+prf_close(struct prf *prf)
+{
+	if (prf->is_written)
+		return 0;
+
+	for (long i = 0; i < prf->nrows; i++) {
+		struct prf_row *row = &prf->rows[i];
+		if (row->label == NULL) {
+			err("row %ld not set", i);
+			return -1;
+		}
+	}
+
+	if (prf->f != NULL)
+		write_rows(prf);
+
+	release_rows(prf);
 
 	return 0;
 }
@@ -5,23 +5,33 @@
 #define PRF_H
 
 #include "common.h"
+#include "strtab.h"
 #include <stdio.h>
 
 #define MAX_PRF_LABEL 512
+#define MAX_PRF_GROUP 64
 
+/* Both strings are interned in the prf labels */
 struct prf_row {
-	char label[MAX_PRF_LABEL];
-	int set;
+	const char *label; /* NULL if not set */
+	const char *group; /* NULL if none */
 };
 
 struct prf {
 	FILE *f;
 	long nrows;
+	long nset;
 	struct prf_row *rows;
+	struct strtab labels;
+
+	/* The rows are already written and released */
+	int is_written;
 };
 
 USE_RET int prf_open(struct prf *prf, const char *path, long nrows);
 USE_RET int prf_add(struct prf *prf, long index, const char *name);
+USE_RET int prf_set_group(struct prf *prf, long index, const char *group);
+USE_RET int prf_flush(struct prf *prf);
 USE_RET int prf_close(struct prf *prf);
 
 
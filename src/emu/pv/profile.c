@@ -0,0 +1,262 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "profile.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Each rule has the form "<trace> <key> <list>", where the key is one of
+ * "type", "skip" or "row", and the list is a comma separated list of values
+ * or ranges "min-max". Rules with the same trace and key are accumulated. */
+
+void
+profile_init(struct profile *profile)
+{
+	memset(profile, 0, sizeof(*profile));
+}
+
+static int
+list_add(struct profile_list *list, long min, long max)
+{
+	struct profile_range *r = realloc(list->r,
+			(size_t) (list->n + 1) * sizeof(struct profile_range));
+	if (r == NULL) {
+		err("realloc failed:");
+		return -1;
+	}
+
+	r[list->n].min = min;
+	r[list->n].max = max;
+	list->r = r;
+	list->n++;
+
+	return 0;
+}
+
+static int
+list_contains(const struct profile_list *list, long v)
+{
+	for (int i = 0; i < list->n; i++) {
+		if (v >= list->r[i].min && v <= list->r[i].max)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int
+parse_long(const char *str, long *v)
+{
+	char *end = NULL;
+	errno = 0;
+	*v = strtol(str, &end, 10);
+
+	if (errno != 0 || end == str || *end != '\0' || *v < 0)
+		return -1;
+
+	return 0;
+}
+
+static int
+parse_list(struct profile_list *list, char *str)
+{
+	char *saveptr = NULL;
+	for (char *tok = strtok_r(str, ",", &saveptr); tok != NULL;
+			tok = strtok_r(NULL, ",", &saveptr)) {
+		long min, max;
+		char *dash = strchr(tok, '-');
+
+		if (dash != NULL) {
+			*dash = '\0';
+			if (parse_long(tok, &min) != 0 || parse_long(dash + 1, &max) != 0) {
+				err("invalid range: %s-%s", tok, dash + 1);
+				return -1;
+			}
+		} else {
+			if (parse_long(tok, &min) != 0) {
+				err("invalid value: %s", tok);
+				return -1;
+			}
+			max = min;
+		}
+
+		if (min > max) {
+			err("empty range: %ld-%ld", min, max);
+			return -1;
+		}
+
+		if (list_add(list, min, max) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static struct profile_sel *
+get_sel(struct profile *profile, const char *name)
+{
+	struct profile_sel *sel = profile_find(profile, name);
+	if (sel != NULL)
+		return sel;
+
+	sel = calloc(1, sizeof(*sel));
+	if (sel == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	if (snprintf(sel->name, MAX_PROFILE_NAME, "%s", name) >= MAX_PROFILE_NAME) {
+		err("trace name too long: %s", name);
+		free(sel);
+		return NULL;
+	}
+
+	HASH_ADD_STR(profile->sels, name, sel);
+
+	return sel;
+}
+
+static int
+parse_rule(struct profile *profile, char *rule)
+{
+	/* Remove comments */
+	char *hash = strchr(rule, '#');
+	if (hash != NULL)
+		*hash = '\0';
+
+	char *saveptr = NULL;
+	char *name = strtok_r(rule, " \t\n", &saveptr);
+
+	/* Empty rule */
+	if (name == NULL)
+		return 0;
+
+	char *key = strtok_r(NULL, " \t\n", &saveptr);
+	char *list = strtok_r(NULL, " \t\n", &saveptr);
+
+	if (key == NULL || list == NULL || strtok_r(NULL, " \t\n", &saveptr) != NULL) {
+		err("expecting '<trace> <type|skip|row> <list>'");
+		return -1;
+	}
+
+	struct profile_sel *sel = get_sel(profile, name);
+	if (sel == NULL)
+		return -1;
+
+	struct profile_list *l;
+	if (strcmp(key, "type") == 0) {
+		l = &sel->types;
+	} else if (strcmp(key, "skip") == 0) {
+		l = &sel->skip;
+	} else if (strcmp(key, "row") == 0) {
+		l = &sel->rows;
+	} else {
+		err("unknown key '%s'", key);
+		return -1;
+	}
+
+	if (parse_list(l, list) != 0) {
+		err("cannot parse list '%s'", list);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Adds the rules from a string, separated by semicolons or newlines. */
+int
+profile_parse(struct profile *profile, const char *rules)
+{
+	char *copy = strdup(rules);
+	if (copy == NULL) {
+		err("strdup failed:");
+		return -1;
+	}
+
+	int ret = 0;
+	char *saveptr = NULL;
+	for (char *rule = strtok_r(copy, ";\n", &saveptr); rule != NULL;
+			rule = strtok_r(NULL, ";\n", &saveptr)) {
+		if (parse_rule(profile, rule) != 0) {
+			err("bad profile rule: %s", rule);
+			ret = -1;
+			break;
+		}
+	}
+
+	free(copy);
+	return ret;
+}
+
+/** Adds the rules from a file, one per line. */
+int
+profile_load(struct profile *profile, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		err("fopen %s failed:", path);
+		return -1;
+	}
+
+	char line[4096];
+	int lineno = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		if (parse_rule(profile, line) != 0) {
+			err("%s:%d: bad profile rule", path, lineno);
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+struct profile_sel *
+profile_find(struct profile *profile, const char *name)
+{
+	struct profile_sel *sel = NULL;
+	HASH_FIND_STR(profile->sels, name, sel);
+
+	return sel;
+}
+
+/** Returns 1 if the type is written, 0 otherwise. */
+int
+profile_sel_type(const struct profile_sel *sel, long type)
+{
+	if (list_contains(&sel->skip, type))
+		return 0;
+
+	if (sel->types.n > 0 && !list_contains(&sel->types, type))
+		return 0;
+
+	return 1;
+}
+
+/** Returns 1 if the type is written in the given row, 0 otherwise. */
+int
+profile_sel_match(const struct profile_sel *sel, long row, long type)
+{
+	if (sel->rows.n > 0 && !list_contains(&sel->rows, row))
+		return 0;
+
+	return profile_sel_type(sel, type);
+}
+
+void
+profile_free(struct profile *profile)
+{
+	struct profile_sel *sel, *tmp;
+	HASH_ITER(hh, profile->sels, sel, tmp) {
+		HASH_DEL(profile->sels, sel);
+		free(sel->types.r);
+		free(sel->skip.r);
+		free(sel->rows.r);
+		free(sel);
+	}
+}
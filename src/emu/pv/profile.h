@@ -0,0 +1,47 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Output profile: selects which PRV types and rows are written in each
+ * Paraver trace */
+
+#include "common.h"
+#include "uthash.h"
+
+#define MAX_PROFILE_NAME 64
+
+/* Inclusive range */
+struct profile_range {
+	long min;
+	long max;
+};
+
+struct profile_list {
+	struct profile_range *r;
+	int n;
+};
+
+/* Selection of one trace, by name ("thread", "cpu", ...) */
+struct profile_sel {
+	char name[MAX_PROFILE_NAME];
+	struct profile_list types; /* Empty selects all types */
+	struct profile_list skip;  /* Types never written */
+	struct profile_list rows;  /* Empty selects all rows */
+	UT_hash_handle hh;
+};
+
+struct profile {
+	struct profile_sel *sels;
+};
+
+        void profile_init(struct profile *profile);
+USE_RET int profile_parse(struct profile *profile, const char *rules);
+USE_RET int profile_load(struct profile *profile, const char *path);
+USE_RET struct profile_sel *profile_find(struct profile *profile, const char *name);
+USE_RET int profile_sel_type(const struct profile_sel *sel, long type);
+USE_RET int profile_sel_match(const struct profile_sel *sel, long row, long type);
+        void profile_free(struct profile *profile);
+
+#endif /* PROFILE_H */
@@ -5,15 +5,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "bay.h"
 #include "chan.h"
 #include "common.h"
+#include "gzout.h"
+#include "profile.h"
+
+/* Longest line written, for the compressed output */
+#define MAX_LINE 128
+
+/* The duration has a fixed width, so the header can be rewritten in place
+ * with the same length */
+static int
+format_header(char *buf, size_t len, long long duration, int nrows)
+{
+	return snprintf(buf, len, "#Paraver (19/01/38 at 03:14):%020lld_ns:0:1:1(%d:1)\n",
+			duration, nrows);
+}
 
 static void
 write_header(FILE *f, long long duration, int nrows)
 {
-	fprintf(f, "#Paraver (19/01/38 at 03:14):%020lld_ns:0:1:1(%d:1)\n",
-			duration, nrows);
+	char buf[MAX_LINE];
+	format_header(buf, MAX_LINE, duration, nrows);
+	fputs(buf, f);
 }
 
 int
@@ -43,9 +59,116 @@ prv_open(struct prv *prv, long nrows, const char *path)
 	return prv_open_file(prv, nrows, f);
 }
 
+/** Opens a gzip compressed PRV file, which is compressed in parallel by the
+ * gzout workers. */
+int
+prv_open_gz(struct prv *prv, long nrows, const char *path)
+{
+	memset(prv, 0, sizeof(struct prv));
+
+	prv->nrows = nrows;
+
+	/* Reserve the header, fixed at the end */
+	char header[MAX_LINE];
+	int len = format_header(header, MAX_LINE, 0LL, (int) nrows);
+
+	prv->gz = gzout_open(path, header, (size_t) len);
+	if (prv->gz == NULL) {
+		err("cannot open compressed file '%s'", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Opens a PRV in summary mode, which writes no file and only accumulates
+ * the time each channel holds each value. The times are kept in the
+ * channels after closing it. */
+int
+prv_open_summary(struct prv *prv, long nrows)
+{
+	memset(prv, 0, sizeof(struct prv));
+
+	prv->nrows = nrows;
+	prv->summary = 1;
+
+	return 0;
+}
+
+static int64_t
+row_discount(struct prv *prv, long row_base1)
+{
+	if (prv->discount == NULL)
+		return 0;
+
+	return prv->discount[row_base1 - 1];
+}
+
+static int
+accumulate(struct prv_chan *rchan, int64_t time)
+{
+	if (rchan->held_value == 0)
+		return 0;
+
+	/* Remove the time discounted in the row while held */
+	int64_t dt = time - rchan->held_since;
+	dt -= row_discount(rchan->prv, rchan->row_base1) - rchan->discount_since;
+	if (dt < 0)
+		dt = 0;
+
+	int64_t value = rchan->held_value;
+	struct prv_acc *acc = NULL;
+	HASH_FIND(hh, rchan->acc, &value, sizeof(value), acc);
+	if (acc == NULL) {
+		acc = calloc(1, sizeof(struct prv_acc));
+		if (acc == NULL) {
+			err("calloc failed:");
+			return -1;
+		}
+		acc->value = value;
+		HASH_ADD(hh, rchan->acc, value, sizeof(acc->value), acc);
+	}
+
+	acc->time += dt;
+
+	return 0;
+}
+
+/* Ends the value held by each channel at the current time */
+static int
+close_summary(struct prv *prv)
+{
+	for (struct prv_chan *rchan = prv->channels; rchan; rchan = rchan->hh.next) {
+		if (accumulate(rchan, prv->time) != 0) {
+			err("accumulate failed for channel %s", rchan->chan->name);
+			return -1;
+		}
+		rchan->held_value = 0;
+	}
+
+	free(prv->discount);
+	prv->discount = NULL;
+
+	return 0;
+}
+
 int
 prv_close(struct prv *prv)
 {
+	if (prv->summary)
+		return close_summary(prv);
+
+	if (prv->gz != NULL) {
+		char header[MAX_LINE];
+		int len = format_header(header, MAX_LINE, prv->time, (int) prv->nrows);
+		if (gzout_close(prv->gz, header, (size_t) len) != 0) {
+			err("gzout_close failed");
+			return -1;
+		}
+		prv->gz = NULL;
+		return 0;
+	}
+
 	/* Fix the header with the current duration */
 	fseek(prv->file, 0, SEEK_SET);
 	write_header(prv->file, prv->time, (int) prv->nrows);
@@ -68,11 +191,26 @@ find_prv_chan(struct prv *prv, long id)
 	return rchan;
 }
 
-static void
+static int
 write_line(struct prv *prv, long row_base1, int64_t type, int64_t value)
 {
-	fprintf(prv->file, "2:0:1:1:%ld:%"PRIi64":%"PRIi64":%"PRIi64"\n",
+	if (prv->gz == NULL) {
+		fprintf(prv->file, "2:0:1:1:%ld:%"PRIi64":%"PRIi64":%"PRIi64"\n",
+				row_base1, prv->time, type, value);
+		return 0;
+	}
+
+	char *buf = gzout_reserve(prv->gz, MAX_LINE);
+	if (buf == NULL) {
+		err("gzout_reserve failed");
+		return -1;
+	}
+
+	int n = snprintf(buf, MAX_LINE, "2:0:1:1:%ld:%"PRIi64":%"PRIi64":%"PRIi64"\n",
 			row_base1, prv->time, type, value);
+	gzout_commit(prv->gz, (size_t) n);
+
+	return 0;
 }
 
 static int
@@ -134,7 +272,19 @@ emit(struct prv *prv, struct prv_chan *rchan)
 		return -1;
 	}
 
-	write_line(prv, rchan->row_base1, rchan->type, val);
+	/* Like in Paraver, the value 0 ends the previous one */
+	if (prv->summary) {
+		if (accumulate(rchan, prv->time) != 0) {
+			err("accumulate failed for channel %s", chan->name);
+			return -1;
+		}
+		rchan->held_value = val;
+		rchan->held_since = prv->time;
+		rchan->discount_since = row_discount(prv, rchan->row_base1);
+	} else if (write_line(prv, rchan->row_base1, rchan->type, val) != 0) {
+		err("write_line failed for channel %s", chan->name);
+		return -1;
+	}
 
 	dbg("written %s for chan %s", value_str(value), chan->name);
 
@@ -172,9 +322,23 @@ check_flags(long flags)
 	return 0;
 }
 
+/** Only write the channels with the types and rows selected by the output
+ * profile. Must be set before registering the channels. */
+void
+prv_select(struct prv *prv, const struct profile_sel *sel)
+{
+	prv->sel = sel;
+}
+
 int
 prv_register(struct prv *prv, long row, long type, struct bay *bay, struct chan *chan, long flags)
 {
+	/* Not connected to the bay, so there is no emit callback to run */
+	if (prv->sel != NULL && !profile_sel_match(prv->sel, row, type)) {
+		prv->nskipped++;
+		return 0;
+	}
+
 	long id = get_id(prv, type, row);
 	struct prv_chan *rchan = find_prv_chan(prv, id);
 	if (rchan != NULL) {
@@ -183,7 +347,7 @@ prv_register(struct prv *prv, long row, long type, struct bay *bay, struct chan
 		return -1;
 	}
 
-	rchan = calloc(1, sizeof(struct prv_chan));
+	rchan = arena_calloc(bay->arena, 1, sizeof(struct prv_chan));
 	if (rchan == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -204,7 +368,8 @@ prv_register(struct prv *prv, long row, long type, struct bay *bay, struct chan
 	rchan->flags = flags;
 
 	/* Add emit callback */
-	if (bay_add_cb(bay, BAY_CB_EMIT, chan, cb_prv, rchan, 1) == NULL) {
+	rchan->cb = bay_add_cb(bay, BAY_CB_EMIT, chan, cb_prv, rchan, 1);
+	if (rchan->cb == NULL) {
 		err("bay_add_cb failed");
 		return -1;
 	}
@@ -215,6 +380,34 @@ prv_register(struct prv *prv, long row, long type, struct bay *bay, struct chan
 	return 0;
 }
 
+/** Moves the row and type registered in another channel to the given
+ * channel, which continues from the last value emitted. */
+int
+prv_rebind(struct prv *prv, long row, long type, struct bay *bay, struct chan *chan)
+{
+	/* Never registered */
+	if (prv->sel != NULL && !profile_sel_match(prv->sel, row, type))
+		return 0;
+
+	long id = get_id(prv, type, row);
+	struct prv_chan *rchan = find_prv_chan(prv, id);
+	if (rchan == NULL) {
+		err("row=%ld type=%ld has no channel registered", row, type);
+		return -1;
+	}
+
+	bay_remove_cb(rchan->cb);
+
+	rchan->chan = chan;
+	rchan->cb = bay_add_cb(bay, BAY_CB_EMIT, chan, cb_prv, rchan, 1);
+	if (rchan->cb == NULL) {
+		err("bay_add_cb failed");
+		return -1;
+	}
+
+	return 0;
+}
+
 int
 prv_advance(struct prv *prv, int64_t time)
 {
@@ -226,3 +419,31 @@ prv_advance(struct prv *prv, int64_t time)
 	prv->time = time;
 	return 0;
 }
+
+/** Discounts ns nanoseconds from the time accumulated by the channels of
+ * the given row, in summary mode. The discount applies to the values
+ * held at the current time, without going below zero. */
+int
+prv_discount(struct prv *prv, long row, int64_t ns)
+{
+	if (!prv->summary) {
+		err("only supported in summary mode");
+		return -1;
+	}
+
+	if (row < 0 || row >= prv->nrows) {
+		err("row %ld out of range", row);
+		return -1;
+	}
+
+	if (prv->discount == NULL) {
+		prv->discount = calloc((size_t) prv->nrows, sizeof(int64_t));
+		if (prv->discount == NULL) {
+			err("calloc failed:");
+			return -1;
+		}
+	}
+
+	prv->discount[row] += ns;
+	return 0;
+}
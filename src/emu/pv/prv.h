@@ -10,7 +10,10 @@
 #include "uthash.h"
 #include "value.h"
 struct bay;
+struct bay_cb;
 struct chan;
+struct gzout;
+struct profile_sel;
 
 enum prv_flags {
 	PRV_EMITDUP     = 1<<0, /* Emit duplicates (no error, emit) */
@@ -20,29 +23,58 @@ enum prv_flags {
 	PRV_SKIPDUPNULL = 1<<4, /* Skip duplicates if the value is null (no error, no emit) */
 };
 
+/* Time a channel held a value, in summary mode */
+struct prv_acc {
+	int64_t value;
+	int64_t time;
+	UT_hash_handle hh;
+};
+
 struct prv_chan {
 	struct prv *prv;
 	struct chan *chan;
+	struct bay_cb *cb;
 	long id;
 	long row_base1;
 	long type;
 	long flags;
 	int last_value_set;
 	struct value last_value;
+
+	/* Summary mode: value held since the given time, 0 if none */
+	int64_t held_value;
+	int64_t held_since;
+	int64_t discount_since; /* Discount of the row when set */
+	struct prv_acc *acc;
+
 	UT_hash_handle hh; /* Indexed by chan->name */
 };
 
 struct prv {
 	FILE *file;
+	struct gzout *gz; /* Instead of file when compressed */
+	int summary; /* Only accumulate the time of each value */
 	int64_t time;
 	long nrows;
 	struct prv_chan *channels;
+
+	/* Summary mode: time discounted per row, NULL if none */
+	int64_t *discount;
+
+	/* Channels written, NULL for all */
+	const struct profile_sel *sel;
+	long nskipped;
 };
 
 USE_RET int prv_open(struct prv *prv, long nrows, const char *path);
 USE_RET int prv_open_file(struct prv *prv, long nrows, FILE *file);
+USE_RET int prv_open_gz(struct prv *prv, long nrows, const char *path);
+USE_RET int prv_open_summary(struct prv *prv, long nrows);
+        void prv_select(struct prv *prv, const struct profile_sel *sel);
 USE_RET int prv_register(struct prv *prv, long row, long type, struct bay *bay, struct chan *chan, long flags);
+USE_RET int prv_rebind(struct prv *prv, long row, long type, struct bay *bay, struct chan *chan);
 USE_RET int prv_advance(struct prv *prv, int64_t time);
+USE_RET int prv_discount(struct prv *prv, long row, int64_t ns);
 USE_RET int prv_close(struct prv *prv);
 
 #endif /* PRV_H */
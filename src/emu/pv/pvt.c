@@ -6,13 +6,42 @@
 #include <string.h>
 #include "pv/pcf.h"
 #include "pv/prf.h"
+#include "pv/profile.h"
 #include "pv/prv.h"
+#include "pv/summary.h"
 
+/* Only keeps the PCF types and ROW labels in memory, for the summary */
+static int
+open_summary(struct pvt *pvt, long nrows)
+{
+	if (prv_open_summary(&pvt->prv, nrows) != 0) {
+		err("prv_open_summary failed");
+		return -1;
+	}
+
+	if (pcf_open(&pvt->pcf, NULL) != 0) {
+		err("pcf_open failed");
+		return -1;
+	}
+
+	if (prf_open(&pvt->prf, NULL, nrows) != 0) {
+		err("prf_open failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Opens the Paraver trace files. With PVT_PRV_GZ the PRV file is written
+ * compressed with gzip, with the .prv.gz extension. With PVT_SUMMARY no
+ * trace is written, only the summary CSV file when closed. */
 int
-pvt_open(struct pvt *pvt, long nrows, const char *dir, const char *name)
+pvt_open(struct pvt *pvt, long nrows, const char *dir, const char *name, enum pvt_mode mode)
 {
 	memset(pvt, 0, sizeof(struct pvt));
 
+	pvt->mode = mode;
+
 	if (snprintf(pvt->dir, PATH_MAX, "%s", dir) >= PATH_MAX) {
 		err("snprintf failed: name too long");
 		return -1;
@@ -23,13 +52,22 @@ pvt_open(struct pvt *pvt, long nrows, const char *dir, const char *name)
 		return -1;
 	}
 
+	if (mode == PVT_SUMMARY)
+		return open_summary(pvt, nrows);
+
 	char prvpath[PATH_MAX];
-	if (snprintf(prvpath, PATH_MAX, "%s/%s.prv", dir, name) >= PATH_MAX) {
+	const char *ext = mode == PVT_PRV_GZ ? "prv.gz" : "prv";
+	if (snprintf(prvpath, PATH_MAX, "%s/%s.%s", dir, name, ext) >= PATH_MAX) {
 		err("snprintf failed: path too long");
 		return -1;
 	}
-	
-	if (prv_open(&pvt->prv, nrows, prvpath) != 0) {
+
+	if (mode == PVT_PRV_GZ) {
+		if (prv_open_gz(&pvt->prv, nrows, prvpath) != 0) {
+			err("prv_open_gz failed");
+			return -1;
+		}
+	} else if (prv_open(&pvt->prv, nrows, prvpath) != 0) {
 		err("prv_open failed");
 		return -1;
 	}
@@ -83,14 +121,65 @@ pvt_advance(struct pvt *pvt, int64_t time)
 	return prv_advance(&pvt->prv, time);
 }
 
+/* Removes the PCF types not selected by the output profile */
+static void
+select_types(struct pvt *pvt)
+{
+	const struct profile_sel *sel = pvt->prv.sel;
+	if (sel == NULL)
+		return;
+
+	struct pcf_type *t, *tmp;
+	HASH_ITER(hh, pvt->pcf.types, t, tmp) {
+		if (!profile_sel_type(sel, t->id))
+			pcf_del_type(&pvt->pcf, t);
+	}
+}
+
+/** Writes the PCF types and ROW labels that are already complete, so
+ * they don't need to be kept until the end. */
+int
+pvt_flush(struct pvt *pvt)
+{
+	select_types(pvt);
+
+	if (pcf_flush(&pvt->pcf) != 0) {
+		err("pcf_flush failed for '%s'", pvt->name);
+		return -1;
+	}
+
+	if (prf_flush(&pvt->prf) != 0) {
+		err("prf_flush failed for '%s'", pvt->name);
+		return -1;
+	}
+
+	return 0;
+}
+
 int
 pvt_close(struct pvt *pvt)
 {
+	select_types(pvt);
+
 	if (prv_close(&pvt->prv) != 0) {
 		err("prv_close failed for '%s'", pvt->name);
 		return -1;
 	}
 
+	if (pvt->mode == PVT_SUMMARY) {
+		char path[PATH_MAX];
+		if (snprintf(path, PATH_MAX, "%s/%s.summary.csv",
+					pvt->dir, pvt->name) >= PATH_MAX) {
+			err("snprintf failed: path too long");
+			return -1;
+		}
+
+		if (summary_write(&pvt->prv, &pvt->pcf, &pvt->prf, path) != 0) {
+			err("summary_write failed for '%s'", pvt->name);
+			return -1;
+		}
+	}
+
 	if (pcf_close(&pvt->pcf) != 0) {
 		err("pcf_close failed for '%s'", pvt->name);
 		return -1;
@@ -12,21 +12,29 @@
 #include "prv.h"
 #include "uthash.h"
 
+enum pvt_mode {
+	PVT_PRV = 0,  /* Paraver trace */
+	PVT_PRV_GZ,   /* Paraver trace with the PRV compressed */
+	PVT_SUMMARY,  /* Only the time in each value, no Paraver trace */
+};
+
 struct pvt {
 	char dir[PATH_MAX];
 	char name[PATH_MAX]; /* Without .prv extension */
 	struct prv prv;
 	struct pcf pcf;
 	struct prf prf;
+	enum pvt_mode mode;
 
 	struct UT_hash_handle hh; /* For recorder */
 };
 
-USE_RET int pvt_open(struct pvt *pvt, long nrows, const char *dir, const char *name);
+USE_RET int pvt_open(struct pvt *pvt, long nrows, const char *dir, const char *name, enum pvt_mode mode);
 USE_RET struct prv *pvt_get_prv(struct pvt *pvt);
 USE_RET struct pcf *pvt_get_pcf(struct pvt *pvt);
 USE_RET struct prf *pvt_get_prf(struct pvt *pvt);
 USE_RET int pvt_advance(struct pvt *pvt, int64_t time);
+USE_RET int pvt_flush(struct pvt *pvt);
 USE_RET int pvt_close(struct pvt *pvt);
 
 #endif /* PVT_H */
@@ -0,0 +1,102 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "strtab.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_SLOTS 64
+
+void
+strtab_init(struct strtab *tab)
+{
+	memset(tab, 0, sizeof(struct strtab));
+	arena_init(&tab->store);
+}
+
+/* FNV-1a */
+static size_t
+hash_str(const char *str)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (const unsigned char *p = (const unsigned char *) str; *p; p++) {
+		h ^= *p;
+		h *= 1099511628211ULL;
+	}
+
+	return (size_t) h;
+}
+
+static const char **
+find_slot(const char **slots, size_t nslots, const char *str)
+{
+	size_t mask = nslots - 1;
+	size_t i = hash_str(str) & mask;
+
+	while (slots[i] != NULL && strcmp(slots[i], str) != 0)
+		i = (i + 1) & mask;
+
+	return &slots[i];
+}
+
+static int
+grow(struct strtab *tab)
+{
+	size_t nslots = tab->nslots ? 2 * tab->nslots : MIN_SLOTS;
+	const char **slots = calloc(nslots, sizeof(char *));
+	if (slots == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
+
+	for (size_t i = 0; i < tab->nslots; i++) {
+		const char *str = tab->slots[i];
+		if (str != NULL)
+			*find_slot(slots, nslots, str) = str;
+	}
+
+	free(tab->slots);
+	tab->slots = slots;
+	tab->nslots = nslots;
+
+	return 0;
+}
+
+/** Returns the stored copy of the string, which is added the first time.
+ * The copy lives until strtab_destroy(). Returns NULL on failure. */
+const char *
+strtab_intern(struct strtab *tab, const char *str)
+{
+	/* Keep the load under 1/2 */
+	if (2 * (tab->n + 1) > tab->nslots && grow(tab) != 0) {
+		err("grow failed");
+		return NULL;
+	}
+
+	const char **slot = find_slot(tab->slots, tab->nslots, str);
+	if (*slot != NULL)
+		return *slot;
+
+	size_t len = strlen(str) + 1;
+	char *copy = arena_calloc(&tab->store, len, 1);
+	if (copy == NULL) {
+		err("arena_calloc failed:");
+		return NULL;
+	}
+
+	memcpy(copy, str, len);
+	*slot = copy;
+	tab->n++;
+
+	return copy;
+}
+
+/** Frees all the strings */
+void
+strtab_destroy(struct strtab *tab)
+{
+	free(tab->slots);
+	arena_destroy(&tab->store);
+	strtab_init(tab);
+}
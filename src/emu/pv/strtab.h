@@ -0,0 +1,24 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#ifndef STRTAB_H
+#define STRTAB_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "common.h"
+
+/* Stores each different string once, so the labels repeated in many rows
+ * or types share the same memory */
+struct strtab {
+	const char **slots; /* Open addressing, power of two */
+	size_t nslots;
+	size_t n;
+	struct arena store; /* For the strings */
+};
+
+        void strtab_init(struct strtab *tab);
+USE_RET const char *strtab_intern(struct strtab *tab, const char *str);
+        void strtab_destroy(struct strtab *tab);
+
+#endif /* STRTAB_H */
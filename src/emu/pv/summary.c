@@ -0,0 +1,253 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "summary.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pcf.h"
+#include "prf.h"
+#include "prv.h"
+#include "uthash.h"
+
+struct entry {
+	long key; /* Row or group */
+	long row;
+	long type;
+	int64_t value;
+	int64_t time;
+};
+
+/* Assigns consecutive ids to the group labels */
+struct group {
+	const char *label;
+	long id;
+	UT_hash_handle hh;
+};
+
+static int
+cmp_entry(const void *a, const void *b)
+{
+	const struct entry *ea = a;
+	const struct entry *eb = b;
+
+	if (ea->key != eb->key)
+		return ea->key < eb->key ? -1 : 1;
+	if (ea->type != eb->type)
+		return ea->type < eb->type ? -1 : 1;
+	if (ea->value != eb->value)
+		return ea->value < eb->value ? -1 : 1;
+
+	return 0;
+}
+
+static struct entry *
+collect(struct prv *prv, size_t *n)
+{
+	size_t count = 0;
+	for (struct prv_chan *rchan = prv->channels; rchan; rchan = rchan->hh.next)
+		count += HASH_COUNT(rchan->acc);
+
+	/* At least one, so it is never an empty allocation */
+	struct entry *entries = calloc(count + 1, sizeof(struct entry));
+	if (entries == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	size_t i = 0;
+	for (struct prv_chan *rchan = prv->channels; rchan; rchan = rchan->hh.next) {
+		for (struct prv_acc *acc = rchan->acc; acc; acc = acc->hh.next) {
+			struct entry *e = &entries[i++];
+			e->row = rchan->row_base1 - 1;
+			e->key = e->row;
+			e->type = rchan->type;
+			e->value = acc->value;
+			e->time = acc->time;
+		}
+	}
+
+	*n = count;
+	return entries;
+}
+
+/** Writes a string as a quoted CSV field, as labels may have commas or
+ * quotes */
+void
+summary_write_str(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"')
+			fputc('"', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+static void
+write_entry(FILE *f, const char *level, long id, const char *label,
+		struct pcf *pcf, struct entry *e)
+{
+	fprintf(f, "%s,", level);
+	if (id >= 0)
+		fprintf(f, "%ld", id);
+	fputc(',', f);
+	summary_write_str(f, label);
+	fprintf(f, ",%ld,", e->type);
+
+	const char *tlabel = "";
+	const char *vlabel = "";
+	struct pcf_type *t = pcf_find_type(pcf, (int) e->type);
+	if (t != NULL) {
+		tlabel = t->label;
+		struct pcf_value *v = pcf_find_value(t, (int) e->value);
+		if (v != NULL)
+			vlabel = v->label;
+	}
+
+	summary_write_str(f, tlabel);
+	fprintf(f, ",%"PRIi64",", e->value);
+	summary_write_str(f, vlabel);
+	fprintf(f, ",%"PRIi64"\n", e->time);
+}
+
+/* Sorts the entries by key and merges the ones with the same key, type
+ * and value, adding the time. Returns the number of entries left. */
+static size_t
+merge(struct entry *entries, size_t n)
+{
+	if (n == 0)
+		return 0;
+
+	qsort(entries, n, sizeof(struct entry), cmp_entry);
+
+	size_t last = 0;
+	for (size_t i = 1; i < n; i++) {
+		if (cmp_entry(&entries[last], &entries[i]) == 0) {
+			entries[last].time += entries[i].time;
+		} else {
+			entries[++last] = entries[i];
+		}
+	}
+
+	return last + 1;
+}
+
+static int
+write_groups(FILE *f, struct pcf *pcf, struct prf *prf,
+		struct entry *entries, size_t n)
+{
+	struct group *groups = NULL;
+	struct group *it, *tmp;
+	long ngroups = 0;
+	int ret = 0;
+	const char **labels = calloc((size_t) prf->nrows + 1, sizeof(char *));
+	if (labels == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
+
+	/* Entries are sorted by row, so groups get the order of their
+	 * first row */
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		const char *label = prf->rows[entries[i].row].group;
+		if (label == NULL)
+			continue;
+
+		struct group *g = NULL;
+		HASH_FIND_STR(groups, label, g);
+		if (g == NULL) {
+			g = calloc(1, sizeof(struct group));
+			if (g == NULL) {
+				err("calloc failed:");
+				ret = -1;
+				goto out;
+			}
+			g->label = label;
+			g->id = ngroups;
+			labels[ngroups++] = label;
+			HASH_ADD_KEYPTR(hh, groups, g->label, strlen(g->label), g);
+		}
+
+		entries[m] = entries[i];
+		entries[m++].key = g->id;
+	}
+
+	m = merge(entries, m);
+	for (size_t i = 0; i < m; i++)
+		write_entry(f, "group", -1, labels[entries[i].key], pcf, &entries[i]);
+
+out:
+	HASH_ITER(hh, groups, it, tmp) {
+		HASH_DEL(groups, it);
+		free(it);
+	}
+	free(labels);
+
+	return ret;
+}
+
+/** Writes the accumulated time of each value in the CSV file. The rows
+ * are labeled with the ROW labels and the values with the PCF labels. */
+int
+summary_write(struct prv *prv, struct pcf *pcf, struct prf *prf, const char *path)
+{
+	size_t n;
+	struct entry *entries = collect(prv, &n);
+	if (entries == NULL) {
+		err("collect failed");
+		return -1;
+	}
+
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		err("cannot open summary file '%s':", path);
+		free(entries);
+		return -1;
+	}
+
+	fprintf(f, "level,row,label,type,type_label,value,value_label,time_ns\n");
+
+	n = merge(entries, n);
+	for (size_t i = 0; i < n; i++) {
+		struct entry *e = &entries[i];
+		write_entry(f, "row", e->row, prf->rows[e->row].label, pcf, e);
+	}
+
+	/* Groups modify the entries, so use a copy */
+	struct entry *copy = calloc(n + 1, sizeof(struct entry));
+	if (copy == NULL) {
+		err("calloc failed:");
+		fclose(f);
+		free(entries);
+		return -1;
+	}
+	memcpy(copy, entries, n * sizeof(struct entry));
+
+	if (write_groups(f, pcf, prf, copy, n) != 0) {
+		err("write_groups failed");
+		fclose(f);
+		free(copy);
+		free(entries);
+		return -1;
+	}
+
+	for (size_t i = 0; i < n; i++)
+		entries[i].key = 0;
+
+	n = merge(entries, n);
+	for (size_t i = 0; i < n; i++)
+		write_entry(f, "all", -1, "", pcf, &entries[i]);
+
+	free(copy);
+	free(entries);
+
+	if (fclose(f) != 0) {
+		err("fclose failed:");
+		return -1;
+	}
+
+	return 0;
+}
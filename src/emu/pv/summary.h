@@ -0,0 +1,19 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+/* Writes the time spent in each value of the channels of a PRV opened in
+ * summary mode, per row, per group of rows and for all rows, as CSV. */
+
+#include <stdio.h>
+#include "common.h"
+struct pcf;
+struct prf;
+struct prv;
+
+USE_RET int summary_write(struct prv *prv, struct pcf *pcf, struct prf *prf, const char *path);
+        void summary_write_str(FILE *f, const char *s);
+
+#endif /* SUMMARY_H */
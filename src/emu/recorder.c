@@ -6,11 +6,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "pv/cfg.h"
+#include "pv/gzout.h"
+#include "pv/pcf.h"
 #include "pv/pvt.h"
 #include "uthash.h"
 
+/** Initializes the recorder to place the traces in dir. In summary mode
+ * the Paraver traces and configurations are not written, only the time
+ * spent in each value of the channels. */
 int
-recorder_init(struct recorder *rec, const char *dir)
+recorder_init(struct recorder *rec, const char *dir, const char *const *skip_cfg, int summary)
 {
 	memset(rec, 0, sizeof(struct recorder));
 
@@ -19,12 +24,54 @@ recorder_init(struct recorder *rec, const char *dir)
 		return -1;
 	}
 
+	rec->summary = summary;
+
 	/* TODO: Use configs per pvt */
-	if (cfg_generate(rec->dir) != 0) {
+	if (!summary && cfg_generate(rec->dir, skip_cfg) != 0) {
 		err("cfg_generate failed");
 		return -1;
 	}
 
+	profile_init(&rec->profile);
+
+	return 0;
+}
+
+/** Writes the PRV files of the traces added later compressed with gzip,
+ * using the given number of workers to compress them. */
+int
+recorder_compress(struct recorder *rec, int nworkers)
+{
+	if (!gzout_available()) {
+		err("cannot compress the traces, compiled without zlib");
+		return -1;
+	}
+
+	if (gzout_set_workers(nworkers) != 0) {
+		err("gzout_set_workers failed");
+		return -1;
+	}
+
+	rec->compress = 1;
+
+	return 0;
+}
+
+/** Loads the output profile from the file and the rules, which can be NULL.
+ * Must be called before adding the traces. */
+int
+recorder_load_profile(struct recorder *rec, const char *path, const char *rules)
+{
+	if (path != NULL && profile_load(&rec->profile, path) != 0) {
+		err("cannot load output profile %s", path);
+		return -1;
+	}
+
+	if (rules != NULL && profile_parse(&rec->profile, rules) != 0) {
+		err("cannot parse output profile rules");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -52,16 +99,36 @@ recorder_add_pvt(struct recorder *rec, const char *name, long nrows)
 		return NULL;
 	}
 
-	if (pvt_open(pvt, nrows, rec->dir, name) != 0) {
+	enum pvt_mode mode = PVT_PRV;
+	if (rec->summary)
+		mode = PVT_SUMMARY;
+	else if (rec->compress)
+		mode = PVT_PRV_GZ;
+
+	if (pvt_open(pvt, nrows, rec->dir, name, mode) != 0) {
 		err("pvt_open failed");
 		return NULL;
 	}
 
+	struct profile_sel *sel = profile_find(&rec->profile, name);
+	if (sel != NULL)
+		prv_select(pvt_get_prv(pvt), sel);
+
+	pcf_set_arena(pvt_get_pcf(pvt), rec->arena);
+
 	HASH_ADD_STR(rec->pvt, name, pvt);
 
 	return pvt;
 }
 
+/** Allocates the PCF types and values of the traces from the arena. Must
+ * be set before adding the traces. */
+void
+recorder_set_arena(struct recorder *rec, struct arena *arena)
+{
+	rec->arena = arena;
+}
+
 int
 recorder_advance(struct recorder *rec, int64_t time)
 {
@@ -75,17 +142,56 @@ recorder_advance(struct recorder *rec, int64_t time)
 	return 0;
 }
 
+/* Warns about the profile selections of traces that are not written, as
+ * with a typo in the name, which would be ignored otherwise */
+static void
+check_profile(struct recorder *rec)
+{
+	for (struct profile_sel *sel = rec->profile.sels; sel; sel = sel->hh.next) {
+		if (recorder_find_pvt(rec, sel->name) == NULL)
+			warn("output profile selects unknown trace '%s', ignored", sel->name);
+	}
+}
+
+/** Writes the parts of the traces which are already final, called once
+ * all the models are connected. */
+int
+recorder_flush(struct recorder *rec)
+{
+	check_profile(rec);
+
+	for (struct pvt *pvt = rec->pvt; pvt; pvt = pvt->hh.next) {
+		if (pvt_flush(pvt) != 0) {
+			err("pvt_flush failed");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 int
 recorder_finish(struct recorder *rec)
 {
-	info("writing traces to disk, please wait");
+	if (rec->summary)
+		info("writing summaries to disk");
+	else
+		info("writing traces to disk, please wait");
 
 	for (struct pvt *pvt = rec->pvt; pvt; pvt = pvt->hh.next) {
+		long nskipped = pvt_get_prv(pvt)->nskipped;
+		if (nskipped > 0) {
+			info("%ld channels not written in %s by the output profile",
+					nskipped, pvt->name);
+		}
+
 		if (pvt_close(pvt) != 0) {
 			err("pvt_close failed");
 			return -1;
 		}
 	}
 
+	profile_free(&rec->profile);
+
 	return 0;
 }
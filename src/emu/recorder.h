@@ -9,16 +9,26 @@
 #include <limits.h>
 #include <stdint.h>
 #include "common.h"
+#include "pv/profile.h"
+struct arena;
 
 struct recorder {
 	char dir[PATH_MAX]; /* To place the traces */
 	struct pvt *pvt; /* Hash table by name */
+	struct profile profile; /* Channels written in each trace */
+	int compress; /* Write the PRV files compressed */
+	int summary; /* Only write the time in each value */
+	struct arena *arena; /* For the PCF types and values */
 };
 
-USE_RET int recorder_init(struct recorder *rec, const char *dir);
+USE_RET int recorder_init(struct recorder *rec, const char *dir, const char *const *skip_cfg, int summary);
+USE_RET int recorder_compress(struct recorder *rec, int nworkers);
+USE_RET int recorder_load_profile(struct recorder *rec, const char *path, const char *rules);
 USE_RET struct pvt *recorder_find_pvt(struct recorder *rec, const char *name);
 USE_RET struct pvt *recorder_add_pvt(struct recorder *rec, const char *name, long nrows);
+        void recorder_set_arena(struct recorder *rec, struct arena *arena);
 USE_RET int recorder_advance(struct recorder *rec, int64_t time);
+USE_RET int recorder_flush(struct recorder *rec);
 USE_RET int recorder_finish(struct recorder *rec);
 
 #endif /* RECORDER_H */
@@ -4,6 +4,7 @@
 #include "sort.h"
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "bay.h"
 #include "chan.h"
 #include "value.h"
@@ -22,8 +23,61 @@ cmp_int64(const void *a, const void *b)
 		return 0;
 }
 
+/* Returns the index of the first element not less than value */
+static int64_t
+lower_bound(const int64_t *arr, int64_t n, int64_t value)
+{
+	int64_t lo = 0;
+	int64_t hi = n;
+
+	while (lo < hi) {
+		int64_t mid = lo + (hi - lo) / 2;
+		if (arr[mid] < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Same as sort_replace() but also returns the range of positions [lo, hi]
+ * that may have changed. */
+static void
+replace(int64_t *arr, int64_t n, int64_t old, int64_t new,
+		int64_t *lo, int64_t *hi)
+{
+	/* Find old, must be found */
+	int64_t i = lower_bound(arr, n, old);
+
+	if (old < new) {
+		*lo = i;
+
+		/* Shift left the section replacing old */
+		for (; i < n - 1 && arr[i + 1] <= new; i++)
+			arr[i] = arr[i + 1];
+
+		*hi = i;
+	} else {
+		*hi = i;
+
+		/* Shift right to replace old */
+		for (; i > 0 && arr[i - 1] > new; i--)
+			arr[i] = arr[i - 1];
+
+		*lo = i;
+	}
+
+	/* Invariant: the elements before i are <= new and the elements
+	 * after i are >= new */
+
+	/* Place new */
+	arr[i] = new;
+}
+
 /** Replaces the value old in the array arr by new, while keeping the
- * array arr sorted.
+ * array arr sorted. The old value is found with a binary search and only
+ * the elements between the old and new positions are moved.
  *
  * Preconditions:
  *  - arr is sorted
@@ -36,42 +90,36 @@ sort_replace(int64_t *arr, int64_t n, int64_t old, int64_t new)
 	if (unlikely(old == new))
 		die("old == new");
 
-	/* Remove the old first then insert the new */
-	if (old < new) {
-		int64_t i = 0;
-
-		/* Quick jump to middle if less than old */
-		int64_t m = n / 2;
-		if (arr[m] < old)
-			i = m;
-
-		/* Skip content until old, no need to copy */
-		for (; arr[i] < old; i++)
-			;
-
-		/* Copy middle section replacing old */
-		for (; i < n - 1 && arr[i + 1] <= new; i++)
-			arr[i] = arr[i + 1];
-
-		/* Place new */
-		arr[i] = new;
-	} else { /* new < old */
-		int64_t i = 0;
+	int64_t lo, hi;
+	replace(arr, n, old, new, &lo, &hi);
+}
 
-		/* Find old, must be found */
-		for (; arr[i] < old; i++)
-			;
+/* Writes the sorted values in the outputs in the range [lo, hi] */
+static int
+update_outputs(struct sort *sort, int64_t lo, int64_t hi)
+{
+	for (int64_t i = lo; i <= hi; i++) {
+		struct value val = value_int64(sort->sorted[i]);
+		struct value last;
+		if (chan_read(&sort->outputs[i], &last) != 0) {
+			err("chan_read failed");
+			return -1;
+		}
 
-		/* Shift right to replace old */
-		for (; i > 0 && arr[i - 1] > new; i--)
-			arr[i] = arr[i - 1];
+		if (value_is_equal(&last, &val))
+			continue;
 
-		/* Invariant: Either i == 0 or arr[i] <= new
-		 * and the element arr[i] must be gone */
+		dbg("writting value %s into channel %s",
+				value_str(val),
+				sort->outputs[i].name);
 
-		/* Place new */
-		arr[i] = new;
+		if (chan_set(&sort->outputs[i], val) != 0) {
+			err("chan_set failed");
+			return -1;
+		}
 	}
+
+	return 0;
 }
 
 /** Called when an input channel changes its value */
@@ -103,33 +151,20 @@ sort_cb_input(struct chan *in_chan, void *ptr)
 	/* Otherwise recompute the outputs */
 	sort->values[index] = new;
 
+	/* Only the outputs between the old and new positions change */
+	int64_t lo = 0;
+	int64_t hi = sort->n - 1;
 	if (likely(sort->copied)) {
-		sort_replace(sort->sorted, sort->n, old, new);
+		replace(sort->sorted, sort->n, old, new, &lo, &hi);
 	} else {
 		memcpy(sort->sorted, sort->values, (size_t) sort->n * sizeof(int64_t));
 		qsort(sort->sorted, (size_t) sort->n, sizeof(int64_t), cmp_int64);
 		sort->copied = 1;
 	}
 
-	for (int64_t i = 0; i < sort->n; i++) {
-		struct value val = value_int64(sort->sorted[i]);
-		struct value last;
-		if (chan_read(&sort->outputs[i], &last) != 0) {
-			err("chan_read failed");
-			return -1;
-		}
-
-		if (value_is_equal(&last, &val))
-			continue;
-
-		dbg("writting value %s into channel %s",
-				value_str(val),
-				sort->outputs[i].name);
-
-		if (chan_set(&sort->outputs[i], val) != 0) {
-			err("chan_set failed");
-			return -1;
-		}
+	if (update_outputs(sort, lo, hi) != 0) {
+		err("update_outputs failed");
+		return -1;
 	}
 
 	return 0;
@@ -141,22 +176,22 @@ sort_init(struct sort *sort, struct bay *bay, int64_t n, const char *name)
 	memset(sort, 0, sizeof(struct sort));
 	sort->bay = bay;
 	sort->n = n;
-	sort->inputs = calloc((size_t) n, sizeof(struct sort_input));
+	sort->inputs = arena_calloc(bay->arena, (size_t) n, sizeof(struct sort_input));
 	if (sort->inputs == NULL) {
 		err("calloc failed:");
 		return -1;
 	}
-	sort->outputs = calloc((size_t) n, sizeof(struct chan));
+	sort->outputs = arena_calloc(bay->arena, (size_t) n, sizeof(struct chan));
 	if (sort->outputs == NULL) {
 		err("calloc failed:");
 		return -1;
 	}
-	sort->values = calloc((size_t) n, sizeof(int64_t));
+	sort->values = arena_calloc(bay->arena, (size_t) n, sizeof(int64_t));
 	if (sort->values == NULL) {
 		err("calloc failed:");
 		return -1;
 	}
-	sort->sorted = calloc((size_t) n, sizeof(int64_t));
+	sort->sorted = arena_calloc(bay->arena, (size_t) n, sizeof(int64_t));
 	if (sort->sorted == NULL) {
 		err("calloc failed:");
 		return -1;
@@ -181,6 +216,12 @@ sort_init(struct sort *sort, struct bay *bay, int64_t n, const char *name)
 		}
 	}
 
+	/* Any input may write any output */
+	if ((sort->dep = bay_add_dep(bay, sort->outputs, n)) == NULL) {
+		err("bay_add_dep failed");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -203,6 +244,11 @@ sort_set_input(struct sort *sort, int64_t index, struct chan *chan)
 		return -1;
 	}
 
+	if (bay_dep_input(sort->dep, chan) != 0) {
+		err("bay_dep_input failed");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include "common.h"
 struct bay;
+struct bay_dep;
 struct chan;
 
 struct sort_input {
@@ -23,6 +24,7 @@ struct sort {
 	int64_t *sorted;
 	int copied;
 	struct bay *bay;
+	struct bay_dep *dep;
 };
 
 USE_RET int sort_init(struct sort *sort, struct bay *bay, int64_t n, const char *name);
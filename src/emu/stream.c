@@ -2,28 +2,348 @@
  * SPDX-License-Identifier: GPL-3.0-or-later */
 
 #include "stream.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include "ovni.h"
 #include "path.h"
+#include "utlist.h"
+
+/* The streams are read through a window of the file which slides as the
+ * events are consumed, so only a bounded amount of memory is mapped and a
+ * bounded number of files are kept open, regardless of the number of
+ * streams. The least recently used streams are unmapped or closed when the
+ * limits are reached, and reopened when needed. */
+static struct {
+	int64_t window;
+	int64_t max_mapped;
+	int max_fds;
+
+	/* Bytes to request ahead of the stream offset */
+	int64_t prefetch;
+
+	/* Bytes requested at load, bounded by the mapped limit */
+	int64_t initial;
+
+	/* Time spent touching new pages of the streams */
+	int64_t stall_ns;
+
+	int64_t pagesize;
+	int64_t mapped;
+	int nfds;
+
+	/* Most recently used first */
+	struct stream *maps;
+	struct stream *fds;
+} reader = {
+	.window = 1LL << 20, /* 1 MiB */
+	.max_mapped = 4LL << 30, /* 4 GiB */
+	.max_fds = 256,
+	.prefetch = 4LL << 20, /* 4 MiB */
+};
+
+/** Sets the maximum number of bytes mapped and open files among all streams.
+ * A value of zero keeps the current limit. The limits can be exceeded to
+ * hold the current event of a stream. */
+void
+stream_set_limits(int64_t max_mapped, int max_fds)
+{
+	if (max_mapped > 0)
+		reader.max_mapped = max_mapped;
+
+	if (max_fds > 0)
+		reader.max_fds = max_fds;
+
+	if (reader.window > reader.max_mapped)
+		reader.window = reader.max_mapped;
+}
+
+/** Sets the number of bytes that are requested to the kernel ahead of the
+ * offset of each stream, or 0 to disable the prefetch. */
+void
+stream_set_prefetch(int64_t prefetch)
+{
+	reader.prefetch = prefetch;
+}
+
+/** Returns the time in seconds spent waiting for the first access to each
+ * page of the streams, which includes the page faults. */
+double
+stream_stall_time(void)
+{
+	return (double) reader.stall_ns * 1e-9;
+}
+
+static int64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t
+get_pagesize(void)
+{
+	if (reader.pagesize == 0) {
+		long pagesize = sysconf(_SC_PAGESIZE);
+		if (pagesize <= 0)
+			die("sysconf failed:");
+		reader.pagesize = pagesize;
+	}
+
+	return reader.pagesize;
+}
 
 static int
-check_stream_header(struct stream *stream)
+close_fd(struct stream *stream)
 {
-	int ret = 0;
+	DL_DELETE2(reader.fds, stream, fd_prev, fd_next);
+	reader.nfds--;
 
-	if (stream->size < (int64_t) sizeof(struct ovni_stream_header)) {
-		err("stream '%s': incomplete stream header",
-				stream->path);
+	int fd = stream->fd;
+	stream->fd = -1;
+
+	if (close(fd) != 0) {
+		err("close failed:");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+open_fd(struct stream *stream)
+{
+	if (stream->fd >= 0) {
+		/* Move to the front */
+		DL_DELETE2(reader.fds, stream, fd_prev, fd_next);
+		DL_PREPEND2(reader.fds, stream, fd_prev, fd_next);
+		return 0;
+	}
+
+	/* Close the least recently used */
+	while (reader.nfds >= reader.max_fds) {
+		struct stream *last = reader.fds->fd_prev;
+		if (close_fd(last) != 0) {
+			err("close_fd failed");
+			return -1;
+		}
+	}
+
+	if ((stream->fd = open(stream->obspath, O_RDONLY)) == -1) {
+		err("open %s failed:", stream->obspath);
+		return -1;
+	}
+
+	DL_PREPEND2(reader.fds, stream, fd_prev, fd_next);
+	reader.nfds++;
+
+	return 0;
+}
+
+static int
+unmap(struct stream *stream)
+{
+	if (stream->buf == NULL)
+		return 0;
+
+	if (munmap(stream->buf, (size_t) stream->buf_len) != 0) {
+		err("munmap failed:");
+		return -1;
+	}
+
+	DL_DELETE2(reader.maps, stream, map_prev, map_next);
+	reader.mapped -= stream->buf_len;
+
+	stream->buf = NULL;
+	stream->buf_off = 0;
+	stream->buf_len = 0;
+
+	return 0;
+}
+
+/* Releases the mapping and file of a stream */
+static int
+release(struct stream *stream)
+{
+	if (stream->full)
+		return 0;
+
+	if (unmap(stream) != 0) {
+		err("unmap failed");
+		return -1;
+	}
+
+	if (stream->fd >= 0 && close_fd(stream) != 0) {
+		err("close_fd failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Returns a pointer to the stream file at the given offset, ensuring that
+ * len bytes are mapped. The pointer is only valid until the next call. */
+static uint8_t *
+map_range(struct stream *stream, int64_t off, int64_t len)
+{
+	int64_t end = off + len;
+
+	/* Already mapped */
+	if (stream->buf != NULL && off >= stream->buf_off
+			&& end <= stream->buf_off + stream->buf_len) {
+		if (!stream->full && reader.maps != stream) {
+			DL_DELETE2(reader.maps, stream, map_prev, map_next);
+			DL_PREPEND2(reader.maps, stream, map_prev, map_next);
+		}
+		return stream->buf + (off - stream->buf_off);
+	}
+
+	if (stream->full) {
+		err("offset %"PRIi64" out of the stream '%s'",
+				off, stream->relpath);
+		return NULL;
+	}
+
+	if (unmap(stream) != 0) {
+		err("unmap failed");
+		return NULL;
+	}
+
+	int64_t pagesize = get_pagesize();
+	int64_t start = off - (off % pagesize);
+	int64_t maplen = reader.window;
+
+	/* Large events may need a bigger window */
+	if (end - start > maplen)
+		maplen = end - start;
+
+	if (start + maplen > stream->size)
+		maplen = stream->size - start;
+
+	/* Unmap the least recently used, but never the current one */
+	while (reader.maps != NULL && reader.mapped + maplen > reader.max_mapped) {
+		if (unmap(reader.maps->map_prev) != 0) {
+			err("unmap failed");
+			return NULL;
+		}
+	}
+
+	if (open_fd(stream) != 0) {
+		err("open_fd failed");
+		return NULL;
+	}
+
+	void *buf = mmap(NULL, (size_t) maplen, PROT_READ, MAP_PRIVATE,
+			stream->fd, (off_t) start);
+
+	if (buf == MAP_FAILED) {
+		err("mmap failed:");
+		return NULL;
+	}
+
+	/* The streams are consumed interleaved, so the pages are not read in
+	 * order and the kernel readahead may not detect the pattern */
+	if (reader.prefetch > 0)
+		posix_madvise(buf, (size_t) maplen, POSIX_MADV_WILLNEED);
+
+	stream->buf = buf;
+	stream->buf_off = start;
+	stream->buf_len = maplen;
+	reader.mapped += maplen;
+	DL_PREPEND2(reader.maps, stream, map_prev, map_next);
+
+	return stream->buf + (off - start);
+}
+
+/* Asks the kernel to read the next part of the file in the background, so
+ * it is in the page cache when the window reaches it */
+static int
+prefetch(struct stream *stream)
+{
+	if (reader.prefetch == 0 || stream->full)
+		return 0;
+
+	/* Keep at least half of the prefetch size ahead */
+	if (stream->offset + reader.prefetch / 2 < stream->prefetched)
+		return 0;
+
+	if (stream->prefetched >= stream->size)
+		return 0;
+
+	if (open_fd(stream) != 0) {
+		err("open_fd failed");
 		return -1;
 	}
 
-	struct ovni_stream_header *h =
-			(struct ovni_stream_header *) stream->buf;
+	int64_t off = stream->prefetched;
+	if (off < stream->offset)
+		off = stream->offset;
+
+	/* Only a hint, errors are not fatal */
+	posix_fadvise(stream->fd, (off_t) off, (off_t) reader.prefetch,
+			POSIX_FADV_WILLNEED);
+
+	stream->prefetched = off + reader.prefetch;
+
+	return 0;
+}
+
+/** Maps the whole stream file writable, so the events can be accessed
+ * by pointer at any offset, as needed to sort them. The mapping is not
+ * accounted in the limits. */
+int
+stream_map_all(struct stream *stream)
+{
+	if (stream->full)
+		return 0;
+
+	if (release(stream) != 0) {
+		err("release failed");
+		return -1;
+	}
+
+	if (stream->size == 0)
+		return 0;
+
+	int fd = open(stream->obspath, O_RDWR);
+	if (fd == -1) {
+		err("open %s failed:", stream->obspath);
+		return -1;
+	}
+
+	int prot = PROT_READ | PROT_WRITE;
+	void *buf = mmap(NULL, (size_t) stream->size, prot, MAP_PRIVATE, fd, 0);
+
+	if (buf == MAP_FAILED) {
+		err("mmap failed:");
+		return -1;
+	}
+
+	/* No need to keep the fd open */
+	if (close(fd) != 0) {
+		err("close failed:");
+		return -1;
+	}
+
+	stream->buf = buf;
+	stream->buf_off = 0;
+	stream->buf_len = stream->size;
+	stream->full = 1;
+
+	return 0;
+}
+
+static int
+check_stream_header(struct stream *stream, struct ovni_stream_header *h)
+{
+	int ret = 0;
 
 	if (memcmp(h->magic, OVNI_STREAM_MAGIC, 4) != 0) {
 		char magic[5];
@@ -58,15 +378,40 @@ load_stream_fd(struct stream *stream, int fd)
 		return -1;
 	}
 
-	int prot = PROT_READ | PROT_WRITE;
-	stream->buf = mmap(NULL, (size_t) st.st_size, prot, MAP_PRIVATE, fd, 0);
+	stream->size = st.st_size;
 
-	if (stream->buf == MAP_FAILED) {
-		err("mmap failed:");
+	if (stream->size < (int64_t) sizeof(struct ovni_stream_header)) {
+		err("stream '%s': incomplete stream header",
+				stream->path);
 		return -1;
 	}
 
-	stream->size = st.st_size;
+	/* Only read the header, the events are mapped when stepping */
+	struct ovni_stream_header header;
+	ssize_t n = pread(fd, &header, sizeof(header), 0);
+
+	if (n != (ssize_t) sizeof(header)) {
+		err("pread failed:");
+		return -1;
+	}
+
+	if (check_stream_header(stream, &header) != 0) {
+		err("stream has bad header: %s", stream->path);
+		return -1;
+	}
+
+	/* Start reading the beginning of the streams, as they will be needed
+	 * at the same time, but only as many as would fit in the mapped
+	 * limit. The rest are requested when stepping. */
+	int64_t len = reader.prefetch;
+	if (len > stream->size)
+		len = stream->size;
+
+	if (len > 0 && reader.initial + len <= reader.max_mapped) {
+		posix_fadvise(fd, 0, (off_t) len, POSIX_FADV_WILLNEED);
+		stream->prefetched = len;
+		reader.initial += len;
+	}
 
 	return 0;
 }
@@ -75,7 +420,15 @@ static int
 load_obs(struct stream *stream, const char *path)
 {
 	int fd;
-	if ((fd = open(path, O_RDWR)) == -1) {
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		/* The runtime only creates the stream file on the first
+		 * flush, so a thread that ends abruptly may not have it */
+		if (errno == ENOENT) {
+			warn("stream '%s' has no stream.obs file", stream->relpath);
+			stream->active = 0;
+			return 0;
+		}
+
 		err("open %s failed:", path);
 		return -1;
 	}
@@ -85,14 +438,15 @@ load_obs(struct stream *stream, const char *path)
 		return -1;
 	}
 
-	if (check_stream_header(stream) != 0) {
-		err("stream has bad header: %s", path);
-		return -1;
-	}
-
 	stream->offset = sizeof(struct ovni_stream_header);
 	stream->usize = stream->size - stream->offset;
 
+	/* All the events are in a single segment */
+	stream->seg0.off = stream->offset;
+	stream->seg0.len = stream->usize;
+	stream->segs = &stream->seg0;
+	stream->nsegs = 1;
+
 	if (stream->offset < stream->size) {
 		stream->active = 1;
 	} else if (stream->offset == stream->size) {
@@ -133,12 +487,16 @@ check_version(JSON_Object *meta)
 	return 0;
 }
 
+/* Returns NULL with errno set to ENOENT and without complaining if the
+ * file doesn't exist */
 static JSON_Object *
 load_json(const char *path)
 {
+	errno = 0;
 	JSON_Value *vmeta = json_parse_file_with_comments(path);
 	if (vmeta == NULL) {
-		err("json_parse_file_with_comments() failed");
+		if (errno != ENOENT)
+			err("json_parse_file_with_comments() failed");
 		return NULL;
 	}
 
@@ -160,11 +518,15 @@ load_json(const char *path)
  *
  * The relpath must be pointing to a directory with the stream.json and
  * stream.obs files.
+ *
+ * Returns 1 if the stream.json file doesn't exist, so the caller can decide
+ * if the stream is really missing.
  */
 int
 stream_load(struct stream *stream, const char *tracedir, const char *relpath)
 {
 	memset(stream, 0, sizeof(struct stream));
+	stream->fd = -1;
 
 	if (snprintf(stream->path, PATH_MAX, "%s/%s", tracedir, relpath) >= PATH_MAX) {
 		err("path too long: %s/%s", tracedir, relpath);
@@ -187,6 +549,9 @@ stream_load(struct stream *stream, const char *tracedir, const char *relpath)
 	}
 
 	if ((stream->meta = load_json(stream->jsonpath)) == NULL) {
+		if (errno == ENOENT)
+			return 1;
+
 		err("load_json failed for: %s", stream->jsonpath);
 		return -1;
 	}
@@ -198,12 +563,323 @@ stream_load(struct stream *stream, const char *tracedir, const char *relpath)
 
 	if (load_obs(stream, stream->obspath) != 0) {
 		err("load_obs failed");
+		stream_unload(stream);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Releases the metadata and segments of a stream which has been loaded but
+ * not stepped yet. */
+void
+stream_unload(struct stream *stream)
+{
+	if (stream->meta != NULL)
+		json_value_free(json_object_get_wrapping_value(stream->meta));
+	stream->meta = NULL;
+
+	if (stream->container)
+		free(stream->segs);
+	stream->segs = NULL;
+
+	reader.initial -= stream->prefetched;
+	stream->prefetched = 0;
+}
+
+static int
+cmp_chunk(const void *a, const void *b)
+{
+	const struct ovni_chunk_entry *ca = a;
+	const struct ovni_chunk_entry *cb = b;
+
+	if (ca->tid != cb->tid)
+		return ca->tid < cb->tid ? -1 : +1;
+
+	if (ca->seq != cb->seq)
+		return ca->seq < cb->seq ? -1 : +1;
+
+	return 0;
+}
+
+static struct ovni_chunk_entry *
+load_chunk_table(const char *path, size_t *n)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		if (errno != ENOENT)
+			err("fopen %s failed:", path);
+		return NULL;
+	}
+
+	size_t cap = 1024;
+	struct ovni_chunk_entry *table = malloc(cap * sizeof(*table));
+	if (table == NULL) {
+		err("malloc failed:");
+		fclose(f);
+		return NULL;
+	}
+
+	*n = 0;
+	while (1) {
+		if (*n == cap) {
+			cap *= 2;
+			table = realloc(table, cap * sizeof(*table));
+			if (table == NULL) {
+				err("realloc failed:");
+				fclose(f);
+				return NULL;
+			}
+		}
+
+		size_t nread = fread(&table[*n], sizeof(*table), cap - *n, f);
+		*n += nread;
+
+		if (*n < cap)
+			break;
+	}
+
+	if (ferror(f)) {
+		err("fread %s failed:", path);
+		free(table);
+		fclose(f);
+		return NULL;
+	}
+
+	fclose(f);
+
+	/* Sorted by thread and sequence, so the chunks of a thread are
+	 * together and in order */
+	qsort(table, *n, sizeof(*table), cmp_chunk);
+
+	return table;
+}
+
+static JSON_Object *
+load_json_chunk(int fd, const struct ovni_chunk_entry *e)
+{
+	char *buf = malloc(e->size + 1);
+	if (buf == NULL) {
+		err("malloc failed:");
+		return NULL;
+	}
+
+	ssize_t n = pread(fd, buf, e->size, (off_t) e->offset);
+	if (n < 0 || (uint64_t) n != e->size) {
+		err("pread failed:");
+		free(buf);
+		return NULL;
+	}
+
+	buf[e->size] = '\0';
+
+	JSON_Value *vmeta = json_parse_string(buf);
+	free(buf);
+
+	if (vmeta == NULL) {
+		err("json_parse_string() failed");
+		return NULL;
+	}
+
+	JSON_Object *meta = json_value_get_object(vmeta);
+	if (meta == NULL) {
+		err("json_value_get_object() failed");
+		return NULL;
+	}
+
+	if (check_version(meta) != 0) {
+		err("check_version failed");
+		return NULL;
+	}
+
+	return meta;
+}
+
+/* Fills a stream with the chunks of one thread in the container */
+static int
+load_container_stream(struct stream *stream, const char *tracedir,
+		const char *relproc, int fd, int64_t size,
+		const struct ovni_chunk_entry *chunks, size_t n)
+{
+	memset(stream, 0, sizeof(struct stream));
+	stream->fd = -1;
+	stream->container = 1;
+	stream->size = size;
+
+	int tid = chunks[0].tid;
+
+	if (snprintf(stream->relpath, PATH_MAX, "%s/thread.%d", relproc, tid) >= PATH_MAX) {
+		err("path too long: %s/thread.%d", relproc, tid);
+		return -1;
+	}
+
+	if (snprintf(stream->path, PATH_MAX, "%s/%s", tracedir, stream->relpath) >= PATH_MAX) {
+		err("path too long: %s/%s", tracedir, stream->relpath);
+		return -1;
+	}
+
+	/* The events and metadata are in the container */
+	if (snprintf(stream->obspath, PATH_MAX, "%s/%s/container.obs", tracedir, relproc) >= PATH_MAX) {
+		err("path too long: %s/%s/container.obs", tracedir, relproc);
+		return -1;
+	}
+
+	memcpy(stream->jsonpath, stream->obspath, PATH_MAX);
+
+	size_t nsegs = 0;
+	const struct ovni_chunk_entry *meta = NULL;
+	for (size_t i = 0; i < n; i++) {
+		if (chunks[i].kind == OVNI_CHUNK_METADATA)
+			meta = &chunks[i];
+		else if (chunks[i].kind == OVNI_CHUNK_EVENTS && chunks[i].size > 0)
+			nsegs++;
+	}
+
+	/* The last metadata chunk is the most recent */
+	if (meta == NULL) {
+		err("thread %d has no metadata in container %s", tid, stream->obspath);
 		return -1;
 	}
 
+	if ((stream->meta = load_json_chunk(fd, meta)) == NULL) {
+		err("load_json_chunk failed for thread %d", tid);
+		return -1;
+	}
+
+	stream->segs = calloc(nsegs + 1, sizeof(struct stream_seg));
+	if (stream->segs == NULL) {
+		err("calloc failed:");
+		return -1;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const struct ovni_chunk_entry *c = &chunks[i];
+		if (c->kind != OVNI_CHUNK_EVENTS || c->size == 0)
+			continue;
+
+		if ((int64_t) (c->offset + c->size) > size) {
+			err("chunk of thread %d exceeds container size", tid);
+			return -1;
+		}
+
+		struct stream_seg *seg = &stream->segs[stream->nsegs++];
+		seg->off = (int64_t) c->offset;
+		seg->len = (int64_t) c->size;
+		stream->usize += seg->len;
+	}
+
+	if (stream->nsegs == 0) {
+		warn("stream '%s' has zero events", stream->relpath);
+		stream->active = 0;
+		return 0;
+	}
+
+	stream->offset = stream->segs[0].off;
+	stream->active = 1;
+
 	return 0;
 }
 
+/** Loads the streams of all threads in a process container.
+ *
+ * The container.idx chunk table locates the chunks of each thread in the
+ * container.obs file, which are presented as a single stream per thread.
+ *
+ * Returns 1 if the container.idx file doesn't exist.
+ */
+int
+stream_load_container(const char *tracedir, const char *relproc,
+		struct stream **streams, size_t *nstreams)
+{
+	char path[PATH_MAX];
+	if (snprintf(path, PATH_MAX, "%s/%s/container.idx", tracedir, relproc) >= PATH_MAX) {
+		err("path too long: %s/%s/container.idx", tracedir, relproc);
+		return -1;
+	}
+
+	size_t n = 0;
+	struct ovni_chunk_entry *table = load_chunk_table(path, &n);
+	if (table == NULL) {
+		if (errno == ENOENT)
+			return 1;
+
+		err("cannot load chunk table %s", path);
+		return -1;
+	}
+
+	int ret = -1;
+	int fd = -1;
+	struct stream *s = NULL;
+	size_t nthreads = 0;
+
+	if (snprintf(path, PATH_MAX, "%s/%s/container.obs", tracedir, relproc) >= PATH_MAX) {
+		err("path too long: %s/%s/container.obs", tracedir, relproc);
+		goto out;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err("open %s failed:", path);
+		goto out;
+	}
+
+	struct stream tmp = {0};
+	snprintf(tmp.path, PATH_MAX, "%s", path);
+	if (load_stream_fd(&tmp, fd) != 0) {
+		err("load_stream_fd failed for: %s", path);
+		goto out;
+	}
+
+	/* Count the threads */
+	for (size_t i = 0; i < n; i++) {
+		if (i == 0 || table[i].tid != table[i - 1].tid)
+			nthreads++;
+	}
+
+	s = calloc(nthreads, sizeof(struct stream));
+	if (s == NULL) {
+		err("calloc failed:");
+		goto out;
+	}
+
+	size_t first = 0;
+	size_t ithread = 0;
+	for (size_t i = 1; i <= n; i++) {
+		if (i < n && table[i].tid == table[first].tid)
+			continue;
+
+		if (load_container_stream(&s[ithread], tracedir, relproc, fd,
+					tmp.size, &table[first], i - first) != 0) {
+			err("cannot load thread %d from container %s",
+					table[first].tid, path);
+			goto out;
+		}
+
+		ithread++;
+		first = i;
+	}
+
+	*streams = s;
+	*nstreams = nthreads;
+	s = NULL;
+	ret = 0;
+
+out:
+	/* Only on error, the streams loaded so far are released */
+	if (s != NULL) {
+		for (size_t i = 0; i < nthreads; i++)
+			stream_unload(&s[i]);
+		free(s);
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	free(table);
+
+	return ret;
+}
+
 void
 stream_data_set(struct stream *stream, void *data)
 {
@@ -229,7 +905,7 @@ stream_metadata(struct stream *stream)
 int
 stream_clkoff_set(struct stream *stream, int64_t clkoff)
 {
-	if (stream->cur_ev) {
+	if (stream->cur_size != 0) {
 		err("cannot set clokoff in started stream '%s'",
 				stream->relpath);
 		return -1;
@@ -246,10 +922,18 @@ stream_clkoff_set(struct stream *stream, int64_t clkoff)
 	return 0;
 }
 
+/* The event pointer is only valid until another stream is accessed */
 struct ovni_ev *
 stream_ev(struct stream *stream)
 {
-	return stream->cur_ev;
+	if (stream->cur_size == 0 || !stream->active)
+		return NULL;
+
+	uint8_t *ev = map_range(stream, stream->offset, stream->cur_size);
+	if (ev == NULL)
+		die("cannot map event of stream '%s'", stream->relpath);
+
+	return (struct ovni_ev *) ev;
 }
 
 int64_t
@@ -272,35 +956,83 @@ stream_step(struct stream *stream)
 		return -1;
 	}
 
+	struct stream_seg *seg = &stream->segs[stream->iseg];
+	int64_t end = seg->off + seg->len;
+
 	/* Only step the offset if we have loaded an event */
-	if (stream->cur_ev != NULL) {
-		stream->offset += ovni_ev_size(stream->cur_ev);
+	if (stream->cur_size != 0) {
+		stream->offset += stream->cur_size;
 
 		/* It cannot pass the size, otherwise we are reading garbage */
-		if (stream->offset > stream->size) {
+		if (stream->offset > end) {
 			err("stream offset %"PRIi64" exceeds size %"PRIi64,
-					stream->offset, stream->size);
+					stream->offset, end);
 			return -1;
 		}
 
+		/* Go to the next segment */
+		if (stream->offset == end && stream->iseg + 1 < stream->nsegs) {
+			stream->done += seg->len;
+			seg = &stream->segs[++stream->iseg];
+			end = seg->off + seg->len;
+			stream->offset = seg->off;
+		}
+
 		/* We have reached the end */
-		if (stream->offset == stream->size) {
+		if (stream->offset == end) {
+			stream->done += seg->len;
 			stream->active = 0;
-			stream->cur_ev = NULL;
+			stream->cur_size = 0;
+
+			/* Free the resources as soon as possible */
+			if (release(stream) != 0) {
+				err("release failed");
+				return -1;
+			}
+
 			return +1;
 		}
 	}
 
-	stream->cur_ev = (struct ovni_ev *) &stream->buf[stream->offset];
+	if (prefetch(stream) != 0) {
+		err("prefetch failed");
+		return -1;
+	}
+
+	/* Map the header and the jumbo size, which may be cut at the end */
+	int64_t hlen = (int64_t) sizeof(struct ovni_ev);
+	if (stream->offset + hlen > end)
+		hlen = end - stream->offset;
+
+	struct ovni_ev *ev = (struct ovni_ev *) map_range(stream, stream->offset, hlen);
+	if (ev == NULL) {
+		err("map_range failed");
+		return -1;
+	}
+
+	/* Measure the first access to each page, which is where the
+	 * emulation stalls if the page is not in memory */
+	int64_t pagesize = get_pagesize();
+	if (stream->cur_size == 0 || stream->offset == seg->off
+			|| (stream->offset - stream->cur_size) / pagesize
+			!= stream->offset / pagesize) {
+		int64_t t0 = now_ns();
+		volatile uint8_t touch = *(volatile uint8_t *) ev;
+		(void) touch;
+		reader.stall_ns += now_ns() - t0;
+	}
 
 	/* Ensure the event fits */
-	if (stream->offset + ovni_ev_size(stream->cur_ev) > stream->size) {
+	int64_t size = (int64_t) ovni_ev_size(ev);
+	if (hlen < (int64_t) sizeof(struct ovni_ev_header)
+			|| stream->offset + size > end) {
 		err("stream '%s' ends with incomplete event",
 				stream->relpath);
 		return -1;
 	}
 
-	int64_t clock = stream_evclock(stream, stream->cur_ev);
+	int64_t clock = stream_evclock(stream, ev);
+	stream->cur_size = size;
 
 	/* Ensure the clock grows monotonically if unsorted flag not set */
 	if (stream->unsorted == 0) {
@@ -323,8 +1055,20 @@ stream_step(struct stream *stream)
 void
 stream_progress(struct stream *stream, int64_t *done, int64_t *total)
 {
-	*done = stream->offset - (int64_t) sizeof(struct ovni_stream_header);
 	*total = stream->usize;
+
+	if (stream->nsegs == 0) {
+		*done = 0;
+		return;
+	}
+
+	/* The offset is left at the end of the last segment */
+	if (!stream->active) {
+		*done = stream->done;
+		return;
+	}
+
+	*done = stream->done + stream->offset - stream->segs[stream->iseg].off;
 }
 
 void
@@ -5,15 +5,50 @@
 #define STREAM_H
 
 #include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "common.h"
 #include "heap.h"
 #include "parson.h"
 struct ovni_ev;
 
+/* Contiguous part of the stream file with events */
+struct stream_seg {
+	int64_t off;
+	int64_t len;
+};
+
 struct stream {
-	struct ovni_ev *cur_ev;
+	/* Window of the stream file currently mapped, NULL if unmapped */
 	uint8_t *buf;
+	int64_t buf_off;
+	int64_t buf_len;
+	int full; /* The whole file is mapped and never moves */
+
+	/* Only while open, otherwise -1 */
+	int fd;
+
+	/* Lists of mapped and open streams, most recently used first */
+	struct stream *map_next;
+	struct stream *map_prev;
+	struct stream *fd_next;
+	struct stream *fd_prev;
+
+	/* Offset up to which the file has been requested to the kernel */
+	int64_t prefetched;
+
+	/* Parts of the file with events, only one unless the stream is
+	 * inside a process container */
+	struct stream_seg *segs;
+	struct stream_seg seg0;
+	int nsegs;
+	int iseg;
+	int64_t done; /* Bytes of the previous segments */
+	int container;
+
+	/* Size of the current event, 0 if none loaded yet */
+	int64_t cur_size;
+
 	int64_t size;
 	int64_t lastclock;
 	int64_t deltaclock;
@@ -41,7 +76,14 @@ struct stream {
 	JSON_Object *meta;
 };
 
+        void stream_set_limits(int64_t max_mapped, int max_fds);
+        void stream_set_prefetch(int64_t prefetch);
+        double stream_stall_time(void);
 USE_RET int stream_load(struct stream *stream, const char *tracedir, const char *relpath);
+        void stream_unload(struct stream *stream);
+USE_RET int stream_map_all(struct stream *stream);
+USE_RET int stream_load_container(const char *tracedir, const char *relproc,
+		struct stream **streams, size_t *nstreams);
 USE_RET int stream_clkoff_set(struct stream *stream, int64_t clock_offset);
         void stream_progress(struct stream *stream, int64_t *done, int64_t *total);
 USE_RET int stream_step(struct stream *stream);
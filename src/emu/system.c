@@ -202,6 +202,91 @@ report_libovni_version(struct system *sys)
 	return 0;
 }
 
+/* Serializes the ovni.filter array of the thread metadata into buf as a comma
+ * separated list. Returns 1 if the thread has a filter, 0 if not and -1 on
+ * error. */
+static int
+get_thread_filter(struct thread *th, char *buf, size_t len)
+{
+	JSON_Value *val = json_object_dotget_value(th->meta, "ovni.filter");
+	if (val == NULL)
+		return 0;
+
+	JSON_Array *array = json_value_get_array(val);
+	if (array == NULL) {
+		err("ovni.filter is not an array: %s", th->id);
+		return -1;
+	}
+
+	buf[0] = '\0';
+	size_t n = json_array_get_count(array);
+	for (size_t i = 0; i < n; i++) {
+		const char *mc = json_array_get_string(array, i);
+		if (mc == NULL) {
+			err("ovni.filter has a non-string element: %s", th->id);
+			return -1;
+		}
+
+		size_t used = strlen(buf);
+		const char *sep = (i == 0) ? "" : ",";
+		if (snprintf(buf + used, len - used, "%s%s", sep, mc) >= (int) (len - used)) {
+			err("ovni.filter too long: %s", th->id);
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+/* Informs of the events that have been disabled in the runtime, so they are
+ * known to be intentionally absent from the streams. */
+static int
+report_libovni_filter(struct system *sys)
+{
+	int mixed = 0;
+	int found = 0;
+	char filter[1024];
+	char t_filter[1024];
+	for (struct thread *th = sys->threads; th; th = th->gnext) {
+		int ret = get_thread_filter(th, t_filter, sizeof(t_filter));
+		if (ret < 0) {
+			err("get_thread_filter failed");
+			return -1;
+		} else if (ret == 0) {
+			continue;
+		}
+
+		if (!found) {
+			found = 1;
+			strcpy(filter, t_filter);
+		} else if (strcmp(t_filter, filter) != 0) {
+			warn("thread is using a different runtime filter (%s): %s",
+					t_filter, th->id);
+			mixed = 1;
+		}
+	}
+
+	if (mixed)
+		warn("mixed runtime filters detected");
+	else if (found)
+		info("events filtered at runtime: %s", filter);
+
+	return 0;
+}
+
+static void
+report_truncated_threads(struct system *sys)
+{
+	size_t n = 0;
+	for (struct thread *th = sys->threads; th; th = th->gnext) {
+		if (th->is_truncated)
+			n++;
+	}
+
+	if (n > 0)
+		info("%zu threads begin in the middle of the execution (flight recorder)", n);
+}
+
 static int
 is_thread_stream(struct stream *s)
 {
@@ -608,6 +693,13 @@ system_init(struct system *sys, struct emu_args *args, struct trace *trace)
 		return -1;
 	}
 
+	if (report_libovni_filter(sys) != 0) {
+		err("report_libovni_filter failed");
+		return -1;
+	}
+
+	report_truncated_threads(sys);
+
 	/* Load the clock offsets table */
 	if (load_clock_offsets(&sys->clkoff, args) != 0) {
 		err("load_clock_offsets() failed");
@@ -676,6 +768,17 @@ system_connect(struct system *sys, struct bay *bay, struct recorder *rec)
 			err("prf_add failed for thread '%s'", th->id);
 			return -1;
 		}
+
+		/* Aggregated by process in the summary */
+		if (snprintf(name, 128, "PROC %d.%d", appid, th->proc->pid) >= 128) {
+			err("label too long");
+			return -1;
+		}
+
+		if (prf_set_group(prf, (long) th->gindex, name) != 0) {
+			err("prf_set_group failed for thread '%s'", th->id);
+			return -1;
+		}
 	}
 
 	struct pcf *pcf_th = pvt_get_pcf(pvt_th);
@@ -9,21 +9,146 @@
 #include "pv/pcf.h"
 #include "utlist.h"
 
+/* Number of tasks allocated at once */
+#define TASK_SLAB 1024
+
+/* Marks the slot of a task that was reclaimed, so the id is not reused */
+static struct task ended_task;
+
+/* Shared by all processes */
+static struct {
+	int reclaim;
+	struct task *free;
+	long ncreated;
+	long nreclaimed;
+	long npeak;
+	long nlive;
+} store = {
+	.reclaim = 1,
+};
+
+/** Enables or disables freeing the tasks that cannot run again when they
+ * end. When disabled, running an ended task is reported with the body
+ * state instead of a missing task. */
+void
+task_set_reclaim(int enable)
+{
+	store.reclaim = enable;
+}
+
 uint32_t
 task_get_id(struct task *task)
 {
 	return task->id;
 }
 
+static struct task **
+find_slot(struct task_info *info, uint32_t task_id, int create)
+{
+	uint32_t ipage = task_id >> TASK_PAGE_BITS;
+
+	if (ipage >= info->npages) {
+		if (!create)
+			return NULL;
+
+		/* Grow to at least twice the pages */
+		uint32_t n = info->npages * 2;
+		if (n <= ipage)
+			n = ipage + 1;
+
+		struct task ***pages = realloc(info->pages, n * sizeof(*pages));
+		if (pages == NULL) {
+			err("realloc failed:");
+			return NULL;
+		}
+		memset(pages + info->npages, 0, (n - info->npages) * sizeof(*pages));
+		info->pages = pages;
+		info->npages = n;
+	}
+
+	struct task **page = info->pages[ipage];
+	if (page == NULL) {
+		if (!create)
+			return NULL;
+
+		page = calloc(TASK_PAGE_SIZE, sizeof(struct task *));
+		if (page == NULL) {
+			err("calloc failed:");
+			return NULL;
+		}
+		info->pages[ipage] = page;
+	}
+
+	return &page[task_id & (TASK_PAGE_SIZE - 1)];
+}
+
 struct task *
-task_find(struct task *tasks, uint32_t task_id)
+task_find(struct task_info *info, uint32_t task_id)
+{
+	struct task **slot = find_slot(info, task_id, 0);
+	if (slot == NULL || *slot == &ended_task)
+		return NULL;
+
+	return *slot;
+}
+
+static struct task *
+alloc_task(void)
 {
-	struct task *task = NULL;
-	HASH_FIND_INT(tasks, &task_id, task);
+	if (store.free == NULL) {
+		struct task *slab = calloc(TASK_SLAB, sizeof(struct task));
+		if (slab == NULL) {
+			err("calloc failed:");
+			return NULL;
+		}
+
+		for (long i = 0; i < TASK_SLAB; i++)
+			LL_PREPEND(store.free, &slab[i]);
+	}
+
+	struct task *task = store.free;
+	LL_DELETE(store.free, task);
+	memset(task, 0, sizeof(struct task));
 
 	return task;
 }
 
+/* Frees the tasks that ended since the last call. They are kept until
+ * then, as the models still read them after task_end(). */
+static void
+reclaim_ended(struct task_info *info)
+{
+	while (info->ended != NULL) {
+		struct task *task = info->ended;
+		LL_DELETE(info->ended, task);
+
+		body_free_all(&task->body_info);
+		LL_PREPEND(store.free, task);
+		store.nreclaimed++;
+	}
+}
+
+/* Only the tasks with one body that cannot run again */
+static int
+can_reclaim(struct task *task)
+{
+	if (!store.reclaim)
+		return 0;
+
+	return !(task->flags & (TASK_FLAG_PARALLEL | TASK_FLAG_RESURRECT));
+}
+
+/** Reports the number of tasks created and the peak of tasks alive. */
+void
+task_print_stats(void)
+{
+	if (store.ncreated == 0)
+		return;
+
+	info("created %ld tasks, %ld alive at peak and %ld reclaimed",
+			store.ncreated, store.npeak, store.nreclaimed);
+}
+
 struct task_type *
 task_type_find(struct task_type *types, uint32_t type_id)
 {
@@ -36,8 +161,16 @@ task_type_find(struct task_type *types, uint32_t type_id)
 int
 task_create(struct task_info *info, uint32_t type_id, uint32_t task_id, uint32_t flags)
 {
+	reclaim_ended(info);
+
+	struct task **slot = find_slot(info, task_id, 1);
+	if (slot == NULL) {
+		err("cannot allocate slot for task %u", task_id);
+		return -1;
+	}
+
 	/* Ensure the task id is new */
-	if (task_find(info->tasks, task_id) != NULL) {
+	if (*slot != NULL) {
 		err("task_id %u already exists", task_id);
 		return -1;
 	}
@@ -49,19 +182,25 @@ task_create(struct task_info *info, uint32_t type_id, uint32_t task_id, uint32_t
 		return -1;
 	}
 
-	struct task *task = calloc(1, sizeof(struct task));
-
+	struct task *task = alloc_task();
 	if (task == NULL) {
-		err("calloc failed:");
+		err("alloc_task failed");
 		return -1;
 	}
 
 	task->id = task_id;
 	task->type = type;
 	task->flags = flags;
+	task->info = info;
 
-	/* Add the new task to the hash table */
-	HASH_ADD_INT(info->tasks, id, task);
+	*slot = task;
+
+	if (++info->nlive > info->npeak)
+		info->npeak = info->nlive;
+
+	store.ncreated++;
+	if (++store.nlive > store.npeak)
+		store.npeak = store.nlive;
 
 	dbg("new task created id=%d", task->id);
 	return 0;
@@ -204,6 +343,18 @@ task_end(struct task_stack *stack, struct task *task, uint32_t body_id)
 
 	dbg("body %u of task %u ends", body_id, task->id);
 
+	if (can_reclaim(task)) {
+		struct task_info *info = task->info;
+
+		/* The id cannot be used again */
+		struct task **slot = find_slot(info, task->id, 0);
+		*slot = &ended_task;
+		LL_PREPEND(info->ended, task);
+
+		info->nlive--;
+		store.nlive--;
+	}
+
 	return 0;
 }
 
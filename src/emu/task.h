@@ -31,18 +31,30 @@ struct task {
 	struct body_info body_info;
 	uint32_t flags;
 
-	/* Hash map in task_info */
-	UT_hash_handle hh;
+	/* Where the task is stored */
+	struct task_info *info;
 
-	/* List handle for nested task support */
+	/* List of ended or free tasks */
 	struct task *next;
-	struct task *prev;
 };
 
+/* Tasks are stored in pages indexed by the task id, as they are dense */
+#define TASK_PAGE_BITS 12
+#define TASK_PAGE_SIZE (1U << TASK_PAGE_BITS)
+
 struct task_info {
-	/* Both hash maps of all known tasks and types */
+	/* Hash map of all known types */
 	struct task_type *types;
-	struct task *tasks;
+
+	/* Pages of task pointers, allocated on demand */
+	struct task ***pages;
+	uint32_t npages;
+
+	/* Tasks ended for good, reclaimed on the next task_create() */
+	struct task *ended;
+
+	long nlive;
+	long npeak;
 };
 
 struct task_stack {
@@ -50,7 +62,7 @@ struct task_stack {
 };
 
 USE_RET uint32_t task_get_id(struct task *task);
-USE_RET struct task *task_find(struct task *tasks, uint32_t task_id);
+USE_RET struct task *task_find(struct task_info *info, uint32_t task_id);
 USE_RET int task_create(struct task_info *info, uint32_t type_id, uint32_t task_id, uint32_t flags);
 
 USE_RET int task_execute(struct task_stack *stack, struct task *task, uint32_t body_id);
@@ -65,5 +77,7 @@ USE_RET int task_create_pcf_types(struct pcf_type *pcftype, struct task_type *ty
 USE_RET struct body *task_get_running(struct task_stack *stack);
 USE_RET struct body *task_get_top(struct task_stack *stack);
 USE_RET int task_is_parallel(struct task *task);
+        void task_set_reclaim(int enable);
+        void task_print_stats(void);
 
 #endif /* TASK_H */
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "bay.h"
 #include "cpu.h"
 #include "emu_prv.h"
@@ -209,6 +210,65 @@ thread_connect(struct thread *th, struct bay *bay, struct recorder *rec)
 	return 0;
 }
 
+static int
+cb_null_chan(struct chan *state, void *ptr)
+{
+	UNUSED(state);
+	struct chan *null_chan = ptr;
+
+	if (chan_set(null_chan, value_null()) != 0) {
+		err("chan_set failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Returns a channel set to null each time the state of the thread
+ * changes, which is the output of a running or active track whose input is
+ * never written. The channel is created the first time. */
+struct chan *
+thread_get_null_chan(struct thread *th, struct bay *bay)
+{
+	if (th->null_chan != NULL)
+		return th->null_chan;
+
+	struct chan *ch = arena_calloc(bay->arena, 1, sizeof(struct chan));
+	if (ch == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	chan_init(ch, CHAN_SINGLE, "thread%"PRIi64".null", th->gindex);
+	chan_prop_set(ch, CHAN_ALLOW_DUP, 1);
+
+	if (bay_register(bay, ch) != 0) {
+		err("bay_register failed");
+		return NULL;
+	}
+
+	struct chan *state = &th->chan[TH_CHAN_STATE];
+	if (bay_add_cb(bay, BAY_CB_DIRTY, state, cb_null_chan, ch, 1) == NULL) {
+		err("bay_add_cb failed");
+		return NULL;
+	}
+
+	struct bay_dep *dep = bay_add_dep(bay, ch, 1);
+	if (dep == NULL) {
+		err("bay_add_dep failed");
+		return NULL;
+	}
+
+	if (bay_dep_input(dep, state) != 0) {
+		err("bay_dep_input failed");
+		return NULL;
+	}
+
+	th->null_chan = ch;
+
+	return ch;
+}
+
 int
 thread_create_pcf_types(struct pcf *pcf)
 {
@@ -252,6 +312,10 @@ thread_set_state(struct thread *th, enum thread_state state)
 					? 1
 					: 0;
 
+	/* Keep the occupancy counters of the CPU up to date */
+	if (th->cpu_owner != NULL)
+		cpu_update_thread(th->cpu_owner, th);
+
 	struct chan *st = &th->chan[TH_CHAN_STATE];
 	if (chan_set(st, value_int64(th->state)) != 0) {
 		err("chan_set() failed");
@@ -424,5 +488,8 @@ thread_load_metadata(struct thread *thread, struct stream *s)
 
 	thread->meta = meta;
 
+	if (json_object_dotget_number(meta, "ovni.ring.dropped") > 0)
+		thread->is_truncated = 1;
+
 	return 0;
 }
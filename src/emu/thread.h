@@ -58,13 +58,27 @@ struct thread {
 	/* Out of CPU as informed by the kernel */
 	int is_out_of_cpu;
 
+	/* The stream begins in the middle of the execution, as the flight
+	 * recorder dropped the first events */
+	int is_truncated;
+
 	/* Current cpu, NULL if not unique affinity */
 	struct cpu *cpu;
 
+	/* CPU which has the thread in its list, NULL if none */
+	struct cpu *cpu_owner;
+
 	/* Linked list of threads in each CPU */
 	struct thread *cpu_prev;
 	struct thread *cpu_next;
 
+	/* Lists of running and active threads in each CPU, the prev
+	 * pointer is NULL when not in the list */
+	struct thread *run_prev;
+	struct thread *run_next;
+	struct thread *act_prev;
+	struct thread *act_next;
+
 	/* Local list */
 	struct thread *lprev;
 	struct thread *lnext;
@@ -75,6 +89,9 @@ struct thread {
 
 	struct chan chan[TH_CHAN_MAX];
 
+	/* Set to null on each state change, created on demand */
+	struct chan *null_chan;
+
 	/* Metadata */
 	JSON_Object *meta;
 
@@ -95,6 +112,7 @@ USE_RET int thread_get_tid(struct thread *thread);
         void thread_set_gindex(struct thread *th, int64_t gindex);
         void thread_set_proc(struct thread *th, struct proc *proc);
 USE_RET int thread_connect(struct thread *th, struct bay *bay, struct recorder *rec);
+USE_RET struct chan *thread_get_null_chan(struct thread *th, struct bay *bay);
 USE_RET int thread_select_active(struct mux *mux, struct value value, struct mux_input **input);
 USE_RET int thread_select_running(struct mux *mux, struct value value, struct mux_input **input);
 USE_RET int thread_create_pcf_types(struct pcf *pcf);
@@ -6,15 +6,31 @@
 #include "trace.h"
 #include <dirent.h>
 #include <ftw.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include "ovni.h"
 #include "path.h"
 #include "stream.h"
+#include "uthash.h"
 #include "utlist.h"
 
+/* Entry of the manifest, for a stream or a process */
+struct mentry {
+	char *relpath;
+	int ended;
+	UT_hash_handle hh;
+};
+
+struct manifest {
+	struct mentry *streams;
+	struct mentry *procs;
+	struct mentry *containers;
+};
+
 /* See the nftw(3) manual to see why we need a global variable here:
  * https://pubs.opengroup.org/onlinepubs/9699919799/functions/nftw.html */
 static struct trace *cur_trace = NULL;
@@ -26,6 +42,7 @@ add_stream(struct trace *trace, struct stream *stream)
 	trace->nstreams++;
 }
 
+/* Returns 1 if the stream.json file doesn't exist */
 static int
 load_stream(struct trace *trace, const char *json_path)
 {
@@ -40,6 +57,7 @@ load_stream(struct trace *trace, const char *json_path)
 	char path[PATH_MAX];
 	if (path_copy(path, json_path) != 0) {
 		err("path_copy failed");
+		free(stream);
 		return -1;
 	}
 	path_dirname(path);
@@ -50,9 +68,12 @@ load_stream(struct trace *trace, const char *json_path)
 	/* Skip begin slashes */
 	while (relpath[0] == '/') relpath++;
 
-	if (stream_load(stream, trace->tracedir, relpath) != 0) {
-		err("emu_steam_load failed");
-		return -1;
+	int ret = stream_load(stream, trace->tracedir, relpath);
+	if (ret != 0) {
+		if (ret < 0)
+			err("emu_steam_load failed");
+		free(stream);
+		return ret;
 	}
 
 	add_stream(trace, stream);
@@ -60,6 +81,54 @@ load_stream(struct trace *trace, const char *json_path)
 	return 0;
 }
 
+/* Loads all the thread streams stored in the container of a process.
+ * Returns 1 if the container.idx file doesn't exist. */
+static int
+load_container(struct trace *trace, const char *relproc)
+{
+	struct stream *streams = NULL;
+	size_t n = 0;
+	int ret = stream_load_container(trace->tracedir, relproc, &streams, &n);
+	if (ret != 0) {
+		if (ret < 0)
+			err("stream_load_container failed for: %s", relproc);
+		return ret;
+	}
+
+	/* Each stream is owned by the trace, so it can be freed alone */
+	for (size_t i = 0; i < n; i++) {
+		struct stream *stream = malloc(sizeof(struct stream));
+		if (stream == NULL) {
+			err("malloc failed:");
+			for (; i < n; i++)
+				stream_unload(&streams[i]);
+			free(streams);
+			return -1;
+		}
+
+		memcpy(stream, &streams[i], sizeof(struct stream));
+		add_stream(trace, stream);
+	}
+
+	free(streams);
+
+	return 0;
+}
+
+/* Releases the streams loaded so far, to start over */
+static void
+trace_reset(struct trace *trace)
+{
+	struct stream *stream, *tmp;
+	DL_FOREACH_SAFE(trace->streams, stream, tmp) {
+		DL_DELETE(trace->streams, stream);
+		stream_unload(stream);
+		free(stream);
+	}
+
+	trace->nstreams = 0;
+}
+
 static int
 is_stream(const char *fpath)
 {
@@ -71,6 +140,35 @@ is_stream(const char *fpath)
 	return 0;
 }
 
+static int
+is_container(const char *fpath)
+{
+	const char *filename = path_filename(fpath);
+
+	if (strcmp(filename, "container.idx") == 0)
+		return 1;
+
+	return 0;
+}
+
+/* Gets the path of the directory of fpath relative to the trace */
+static int
+reldir(const char *fpath, char *path)
+{
+	if (path_copy(path, fpath) != 0) {
+		err("path_copy failed");
+		return -1;
+	}
+	path_dirname(path);
+
+	const char *relpath = path + strlen(cur_trace->tracedir);
+	while (relpath[0] == '/') relpath++;
+
+	memmove(path, relpath, strlen(relpath) + 1);
+
+	return 0;
+}
+
 static int
 cb_nftw(const char *fpath, const struct stat *sb,
 		int typeflag, struct FTW *ftwbuf)
@@ -81,12 +179,353 @@ cb_nftw(const char *fpath, const struct stat *sb,
 	if (typeflag != FTW_F)
 		return 0;
 
+	if (is_container(fpath)) {
+		char relproc[PATH_MAX];
+		if (reldir(fpath, relproc) != 0)
+			return -1;
+
+		return load_container(cur_trace, relproc);
+	}
+
 	if (!is_stream(fpath))
 		return 0;
 
 	return load_stream(cur_trace, fpath);
 }
 
+static struct mentry *
+mentry_add(struct mentry **set, const char *relpath)
+{
+	struct mentry *e = NULL;
+	HASH_FIND_STR(*set, relpath, e);
+	if (e != NULL)
+		return e;
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL) {
+		err("calloc failed:");
+		return NULL;
+	}
+
+	e->relpath = strdup(relpath);
+	if (e->relpath == NULL) {
+		err("strdup failed:");
+		return NULL;
+	}
+
+	HASH_ADD_KEYPTR(hh, *set, e->relpath, strlen(e->relpath), e);
+
+	return e;
+}
+
+static void
+mentry_free(struct mentry **set)
+{
+	struct mentry *e, *tmp;
+	HASH_ITER(hh, *set, e, tmp) {
+		HASH_DEL(*set, e);
+		free(e->relpath);
+		free(e);
+	}
+}
+
+/* Same as cur_trace, but to add the streams to the manifest */
+static struct manifest *cur_manifest = NULL;
+
+static int
+cb_nftw_manifest(const char *fpath, const struct stat *sb,
+		int typeflag, struct FTW *ftwbuf)
+{
+	UNUSED(sb);
+	UNUSED(ftwbuf);
+
+	if (typeflag != FTW_F)
+		return 0;
+
+	struct mentry **set;
+	if (is_stream(fpath))
+		set = &cur_manifest->streams;
+	else if (is_container(fpath))
+		set = &cur_manifest->containers;
+	else
+		return 0;
+
+	char relpath[PATH_MAX];
+	if (reldir(fpath, relpath) != 0)
+		return -1;
+
+	if (mentry_add(set, relpath) == NULL) {
+		err("mentry_add failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Adds the threads of a process that didn't end, first from the process
+ * manifest, or by walking its directory otherwise. Returns 1 if the process
+ * directory no longer exists or its manifest is malformed. */
+static int
+manifest_add_proc(struct trace *trace, struct manifest *m, const char *relproc)
+{
+	char path[PATH_MAX];
+
+	if (snprintf(path, PATH_MAX, "%s/%s/manifest", trace->tracedir, relproc) >= PATH_MAX) {
+		err("path too long: %s/%s/manifest", trace->tracedir, relproc);
+		return -1;
+	}
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		/* Processes in a container have no manifest, but the chunk
+		 * table already lists all threads, so only record it and let
+		 * the load find out if it is missing */
+		if (snprintf(path, PATH_MAX, "%s/%s/container.idx", trace->tracedir, relproc) >= PATH_MAX) {
+			err("path too long: %s/%s/container.idx", trace->tracedir, relproc);
+			return -1;
+		}
+
+		if (access(path, F_OK) == 0) {
+			if (mentry_add(&m->containers, relproc) == NULL) {
+				err("mentry_add failed");
+				return -1;
+			}
+			return 0;
+		}
+
+		if (snprintf(path, PATH_MAX, "%s/%s", trace->tracedir, relproc) >= PATH_MAX) {
+			err("path too long: %s/%s", trace->tracedir, relproc);
+			return -1;
+		}
+
+		if (access(path, F_OK) != 0) {
+			warn("process %s in the manifest is missing, searching the trace directory", relproc);
+			return 1;
+		}
+
+		warn("process %s has no manifest, searching its streams", relproc);
+
+		cur_manifest = m;
+		int ret = nftw(path, cb_nftw_manifest, 50, 0);
+		cur_manifest = NULL;
+
+		if (ret != 0) {
+			err("nftw failed");
+			return -1;
+		}
+
+		return 0;
+	}
+
+	int tid, finished;
+	int64_t size;
+	int ret;
+	while ((ret = fscanf(f, "%d %" SCNi64 " %d", &tid, &size, &finished)) == 3) {
+		char relpath[PATH_MAX];
+		if (snprintf(relpath, PATH_MAX, "%s/thread.%d", relproc, tid) >= PATH_MAX) {
+			err("path too long: %s/thread.%d", relproc, tid);
+			fclose(f);
+			return -1;
+		}
+
+		if (mentry_add(&m->streams, relpath) == NULL) {
+			err("mentry_add failed");
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+
+	if (ret != EOF) {
+		warn("malformed manifest of process %s, searching the trace directory", relproc);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Returns 1 if the manifest is malformed */
+static int
+parse_manifest(struct manifest *m, FILE *f)
+{
+	char line[2 * PATH_MAX];
+	char kind[16];
+	char relpath[PATH_MAX];
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		/* The relpath is always the second field */
+		if (sscanf(line, "%15s %4095s", kind, relpath) != 2) {
+			warn("malformed manifest line, searching the trace directory: %s", line);
+			return 1;
+		}
+
+		if (strcmp(kind, "thread") == 0) {
+			if (mentry_add(&m->streams, relpath) == NULL)
+				return -1;
+		} else if (strcmp(kind, "container") == 0) {
+			if (mentry_add(&m->containers, relpath) == NULL)
+				return -1;
+		} else if (strcmp(kind, "proc") == 0) {
+			if (mentry_add(&m->procs, relpath) == NULL)
+				return -1;
+		} else if (strcmp(kind, "end") == 0) {
+			struct mentry *e = mentry_add(&m->procs, relpath);
+			if (e == NULL)
+				return -1;
+			e->ended = 1;
+		} else {
+			warn("unknown manifest entry %s, searching the trace directory", kind);
+			return 1;
+		}
+	}
+
+	if (ferror(f)) {
+		err("fgets failed:");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Returns 1 if any process directory in the trace is not listed in the
+ * manifest, as when a trace has been copied into another one. Only the
+ * loom directories are read, not the streams. */
+static int
+check_unlisted(struct trace *trace, struct manifest *m)
+{
+	DIR *dir = opendir(trace->tracedir);
+	if (dir == NULL) {
+		err("cannot open \"%s\":", trace->tracedir);
+		return -1;
+	}
+
+	int ret = 0;
+	struct dirent *loom;
+	while (ret == 0 && (loom = readdir(dir)) != NULL) {
+		if (strncmp(loom->d_name, "loom.", 5) != 0)
+			continue;
+
+		char path[PATH_MAX];
+		if (snprintf(path, PATH_MAX, "%s/%s", trace->tracedir, loom->d_name) >= PATH_MAX) {
+			err("path too long: %s/%s", trace->tracedir, loom->d_name);
+			ret = -1;
+			break;
+		}
+
+		DIR *ldir = opendir(path);
+		if (ldir == NULL)
+			continue;
+
+		struct dirent *proc;
+		while ((proc = readdir(ldir)) != NULL) {
+			if (strncmp(proc->d_name, "proc.", 5) != 0)
+				continue;
+
+			char relproc[PATH_MAX];
+			if (snprintf(relproc, PATH_MAX, "%s/%s", loom->d_name, proc->d_name) >= PATH_MAX) {
+				err("path too long: %s/%s", loom->d_name, proc->d_name);
+				ret = -1;
+				break;
+			}
+
+			struct mentry *e = NULL;
+			HASH_FIND_STR(m->procs, relproc, e);
+			if (e == NULL) {
+				warn("process %s is not in the manifest, searching the trace directory", relproc);
+				ret = 1;
+				break;
+			}
+		}
+
+		closedir(ldir);
+	}
+
+	closedir(dir);
+
+	return ret;
+}
+
+/* Loads the streams listed in the trace manifest. Returns 1 if there is no
+ * manifest or it is stale, so the directory must be walked instead. */
+static int
+load_manifest(struct trace *trace)
+{
+	char path[PATH_MAX];
+	if (path_append(path, trace->tracedir, "manifest") != 0) {
+		err("path_append failed");
+		return -1;
+	}
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return 1;
+
+	struct manifest m = {0};
+	int ret = parse_manifest(&m, f);
+	fclose(f);
+
+	if (ret != 0) {
+		if (ret < 0)
+			err("cannot parse manifest %s", path);
+		goto out;
+	}
+
+	if ((ret = check_unlisted(trace, &m)) != 0)
+		goto out;
+
+	struct mentry *e, *tmp;
+	HASH_ITER(hh, m.procs, e, tmp) {
+		if (e->ended)
+			continue;
+
+		if ((ret = manifest_add_proc(trace, &m, e->relpath)) != 0) {
+			if (ret < 0)
+				err("cannot add streams of process %s", e->relpath);
+			goto out;
+		}
+	}
+
+	/* A missing entry is only found when loading it, so the streams
+	 * loaded so far are released to walk the directory instead */
+	HASH_ITER(hh, m.streams, e, tmp) {
+		if (snprintf(path, PATH_MAX, "%s/%s/stream.json",
+					trace->tracedir, e->relpath) >= PATH_MAX) {
+			err("path too long: %s/%s/stream.json",
+					trace->tracedir, e->relpath);
+			ret = -1;
+			goto out;
+		}
+
+		if ((ret = load_stream(trace, path)) != 0) {
+			if (ret < 0)
+				err("cannot load stream %s from manifest", e->relpath);
+			else
+				warn("stream %s in the manifest is missing, searching the trace directory", e->relpath);
+			goto out;
+		}
+	}
+
+	HASH_ITER(hh, m.containers, e, tmp) {
+		if ((ret = load_container(trace, e->relpath)) != 0) {
+			if (ret < 0)
+				err("cannot load container %s from manifest", e->relpath);
+			else
+				warn("container %s in the manifest is missing, searching the trace directory", e->relpath);
+			goto out;
+		}
+	}
+
+out:
+	if (ret > 0)
+		trace_reset(trace);
+
+	mentry_free(&m.streams);
+	mentry_free(&m.procs);
+	mentry_free(&m.containers);
+	return ret;
+}
+
 static int
 cmp_streams(struct stream *a, struct stream *b)
 {
@@ -121,8 +560,13 @@ trace_load(struct trace *trace, const char *tracedir)
 		return -1;
 	}
 
-	/* Search recursively all streams in the trace directory */
-	if (nftw(tracedir, cb_nftw, 50, 0) != 0) {
+	/* Use the manifest if present, otherwise search recursively all
+	 * streams in the trace directory */
+	int ret = load_manifest(trace);
+	if (ret < 0) {
+		err("load_manifest failed");
+		return -1;
+	} else if (ret > 0 && nftw(tracedir, cb_nftw, 50, 0) != 0) {
 		err("nftw failed");
 		return -1;
 	}
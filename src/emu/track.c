@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include "bay.h"
+#include "cpu.h"
 #include "thread.h"
 
 static const char *th_suffix[TRACK_TH_MAX] = {
@@ -80,6 +81,52 @@ track_set_input(struct track *track, int64_t index, struct chan *inp)
 	return 0;
 }
 
+/* Only called the first time a thread runs in the CPU, which must be the
+ * running thread. The thread may not have the channel yet, then the mux
+ * is refreshed when it is created. */
+static int
+cpu_running_input(struct mux *mux, int64_t index, struct chan **chan)
+{
+	struct track *track = mux->input_arg;
+	struct thread *th = track->cpu->th_running;
+
+	if (th == NULL || th->gindex != index) {
+		err("thread %"PRIi64" is not running in cpu %s",
+				index, track->cpu->name);
+		return -1;
+	}
+
+	*chan = track->th_chan(th, track->th_arg, track->th_index);
+
+	return 0;
+}
+
+/** Follows the channel of the thread running in the CPU, given by th_chan
+ * with the arg and index.
+ * The threads are only connected when they first run in the CPU, so the
+ * cost doesn't depend on the number of threads in the system. */
+int
+track_set_cpu_running(struct track *track, struct cpu *cpu, int64_t nthreads,
+		track_th_chan_func_t th_chan, void *arg, int64_t index)
+{
+	track->cpu = cpu;
+	track->th_chan = th_chan;
+	track->th_arg = arg;
+	track->th_index = index;
+
+	struct mux *mux = &track->mux;
+	struct chan *sel = cpu_get_th_chan(cpu);
+	struct chan *out = &track->ch;
+	if (mux_init_sparse(mux, track->bay, sel, out,
+				cpu_running_input, track, nthreads) != 0) {
+		err("mux_init_sparse failed");
+		return -1;
+	}
+	track->out = out;
+
+	return 0;
+}
+
 static int
 track_th_input_chan(struct track *track, struct chan *sel, struct chan *inp)
 {
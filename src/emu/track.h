@@ -9,6 +9,8 @@
 #include "common.h"
 #include "mux.h"
 struct bay;
+struct cpu;
+struct thread;
 
 enum track_type {
 	TRACK_TYPE_TH = 0,
@@ -22,6 +24,10 @@ enum track_th {
 	TRACK_TH_MAX,
 };
 
+/* Returns the channel at index of the thread followed by a CPU track, or
+ * NULL if the thread doesn't have it yet */
+typedef struct chan *(*track_th_chan_func_t)(struct thread *th, void *arg, int64_t index);
+
 struct track {
 	enum track_type type;
 	int mode;
@@ -30,11 +36,18 @@ struct track {
 	struct chan ch; /*< Scratch channel as output when mux is used */
 	struct chan *out; /*< Output channel (ch or the input channel) */
 	struct mux mux;
+
+	/* Thread channel followed by the CPU, in CPU tracks */
+	struct cpu *cpu;
+	track_th_chan_func_t th_chan;
+	void *th_arg;
+	int64_t th_index;
 };
 
 USE_RET int track_init(struct track *track, struct bay *bay, enum track_type type, int mode, const char *fmt, ...) __attribute__((format(printf, 5, 6)));
 USE_RET int track_set_select(struct track *track, struct chan *sel, mux_select_func_t fsel, int64_t ninputs);
 USE_RET int track_set_input(struct track *track, int64_t index, struct chan *inp);
+USE_RET int track_set_cpu_running(struct track *track, struct cpu *cpu, int64_t nthreads, track_th_chan_func_t th_chan, void *arg, int64_t index);
 USE_RET struct chan *track_get_output(struct track *track);
 USE_RET int track_connect_thread(struct track *tracks, struct chan *chans, struct chan *sel, int n);
 
@@ -2,20 +2,28 @@
  * SPDX-License-Identifier: MIT */
 
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "compat.h"
 #include "ovni.h"
 #include "parson.h"
 #include "version.h"
@@ -35,12 +43,85 @@ struct ovni_rcpu {
 	struct ovni_rcpu *prev;
 };
 
+/* Thread state as seen from the ovni events emitted by the thread, used to
+ * reconstruct the state when the flight recorder drops events */
+enum ovni_rsnap_state {
+	RSNAP_UNKNOWN = 0,
+	RSNAP_RUNNING,
+	RSNAP_PAUSED,
+	RSNAP_COOLING,
+	RSNAP_WARMING,
+	RSNAP_DEAD,
+};
+
+struct ovni_rsnap {
+	enum ovni_rsnap_state state;
+	int32_t cpu;
+};
+
+struct ovni_rslot {
+	uint8_t *buf;
+	size_t len;
+
+	/* Thread state when the slot began to be filled */
+	struct ovni_rsnap snap;
+};
+
+/* Circular set of event buffers kept in memory (flight recorder mode) */
+struct ovni_rring {
+	struct ovni_rslot *slots;
+	int nslots;
+
+	/* Oldest slot and slot being filled */
+	int first;
+	int cur;
+
+	/* Number of bytes of events overwritten */
+	uint64_t dropped;
+
+	/* Current thread state */
+	struct ovni_rsnap snap;
+
+	/* Thread state at the end of the last dump */
+	struct ovni_rsnap dumped;
+
+	/* Last trigger generation seen by the thread */
+	int gen;
+};
+
+/* Number of data pages of the perf ring, must be a power of two */
+#define PERF_PAGES 64
+
+/* Kernel context switches captured with perf_event_open(2) */
+struct ovni_rperf {
+	int fd;
+
+	/* Control page followed by the data ring */
+	struct perf_event_mmap_page *page;
+	size_t mmap_size;
+	uint8_t *data;
+	uint64_t data_size;
+
+	/* Events merged with the context switches */
+	uint8_t *buf;
+
+	/* Number of records lost by the kernel */
+	uint64_t lost;
+};
+
+#define MAX_REQUIRE 32
+
+struct ovni_rreq {
+	char model[64];
+	char version[32];
+};
+
 /* State of each thread on runtime */
 struct ovni_rthread {
 	/* Current thread id */
 	pid_t tid;
 
-	/* Stream trace file descriptor */
+	/* Stream trace file descriptor, opened on the first write */
 	int streamfd;
 
 	int ready;
@@ -52,6 +133,24 @@ struct ovni_rthread {
 	/* Buffer to write events */
 	uint8_t *evbuf;
 
+	/* Size of the event reserved in evbuf, pending to be committed */
+	size_t reserved;
+
+	/* Flush times of the reserve, to be emitted after the commit */
+	int flush_pending;
+	uint64_t flush_t0;
+	uint64_t flush_t1;
+
+	/* Only in flight recorder mode, NULL otherwise */
+	struct ovni_rring *ring;
+
+	/* Flight recorder details, once the ring is written */
+	int ring_nslots;
+	uint64_t ring_dropped;
+
+	/* Only when capturing context switches, NULL otherwise */
+	struct ovni_rperf *perf;
+
 	struct ovni_rcpu *cpus;
 
 	int rank_set;
@@ -62,9 +161,25 @@ struct ovni_rthread {
 	char thdir_final[PATH_MAX];
 	char thdir[PATH_MAX];
 
+	/* Models required, stored out of the JSON metadata */
+	struct ovni_rreq req[MAX_REQUIRE];
+	int nreq;
+
+	/* Sequence number of the next chunk in the process container */
+	uint32_t chunk_seq;
+
+	/* Only created when the user attributes are used, so the metadata
+	 * can be written without parson otherwise */
 	JSON_Value *meta;
 };
 
+/* Thread directory pending to be moved out of OVNI_TMPDIR */
+struct ovni_rmove {
+	char thdir[PATH_MAX];
+	char thdir_final[PATH_MAX];
+	struct ovni_rmove *next;
+};
+
 /* State of each process on runtime */
 struct ovni_rproc {
 	/* Where the process trace is finally copied */
@@ -78,6 +193,15 @@ struct ovni_rproc {
 	/* If needs to be moved at the end */
 	int move_to_final;
 
+	/* Manifests of the trace and the process, to find the streams
+	 * without walking the trace directory */
+	char trace_manifest[PATH_MAX];
+	char proc_manifest[PATH_MAX];
+	char relproc[PATH_MAX];
+
+	/* Kept open to add the threads, -1 in container mode */
+	int proc_manifest_fd;
+
 	int app;
 	int pid;
 	char loom[OVNI_MAX_HOSTNAME];
@@ -85,6 +209,48 @@ struct ovni_rproc {
 
 	atomic_int st;
 
+	/* Bitmap of disabled events, indexed by model and category */
+	uint8_t filter[256][256 / 8];
+	int filter_set;
+
+	/* Number of buffers per thread in flight recorder mode, or 0 */
+	int ring_nslots;
+
+	/* Incremented on each trigger to dump the flight recorder */
+	atomic_int ring_gen;
+
+	/* Capture the kernel context switches of each thread */
+	int perf_switch;
+	atomic_int perf_warned;
+
+	/* Measure the cost of emitting an event on the process init */
+	int calibrate;
+
+	/* Measured cost of emitting one event in clock units, or 0 if the
+	 * calibration is disabled */
+	double calib_emit_ns;
+
+	/* Number of workers to move the threads out of OVNI_TMPDIR at
+	 * ovni_proc_fini(), or 0 to move them at ovni_thread_free() */
+	int move_workers;
+	pthread_mutex_t move_lock;
+	struct ovni_rmove *moves;
+	int moves_closed;
+
+	/* Statistics of the files moved out of OVNI_TMPDIR, only
+	 * reported with OVNI_TMPDIR_REPORT=1 */
+	int move_report;
+	atomic_uint_fast64_t moved_files;
+	atomic_uint_fast64_t moved_bytes;
+	atomic_uint_fast64_t moved_ns;
+
+	/* All threads write their chunks to a single container file, which
+	 * are located by the entries of the chunk table */
+	int container;
+	int cont_fd;
+	int cont_idx;
+	atomic_uint_fast64_t cont_off;
+
 	JSON_Value *meta;
 };
 
@@ -130,7 +296,9 @@ void ovni_version_check_str(const char *version)
 	/* Ignore the patch number */
 }
 
-/* Create dir $procdir/thread.$tid and return it in path. */
+/* Create dir $procdir/thread.$tid and return it in path. The procdir must
+ * have been created earlier by ovni_proc_init(), so only one mkdir is needed
+ * per thread. */
 static void
 mkdir_thread(char *path, const char *procdir, int tid)
 {
@@ -139,36 +307,30 @@ mkdir_thread(char *path, const char *procdir, int tid)
 		die("path too long: %s/thread.%d", procdir, tid);
 	}
 
-	if (mkpath(path, 0755, /* subdir */ 1))
-		die("mkpath %s failed:", path);
+	if (mkdir(path, 0755) != 0 && errno != EEXIST)
+		die("mkdir %s failed:", path);
 }
 
 static void
-create_thread_dir(int tid)
-{
-	/* The procdir must have been created earlier */
-	mkdir_thread(rthread.thdir, rproc.procdir, tid);
-	if (rproc.move_to_final)
-		mkdir_thread(rthread.thdir_final, rproc.procdir_final, tid);
-}
+write_stream_header(int fd);
 
+/* Opens the stream file, only when the first events are written */
 static void
 create_trace_stream(void)
 {
 	char path[PATH_MAX];
 
-	int written = snprintf(path, PATH_MAX, "%s/thread.%d/stream.obs",
-			rproc.procdir, rthread.tid);
+	int written = snprintf(path, PATH_MAX, "%s/stream.obs", rthread.thdir);
 
-	if (written >= PATH_MAX) {
-		die("path too long: %s/thread.%d/stream.obs",
-				rproc.procdir, rthread.tid);
-	}
+	if (written >= PATH_MAX)
+		die("path too long: %s/stream.obs", rthread.thdir);
 
 	rthread.streamfd = open(path, O_WRONLY | O_CREAT, 0644);
 
 	if (rthread.streamfd == -1)
 		die("open %s failed:", path);
+
+	write_stream_header(rthread.streamfd);
 }
 
 void
@@ -244,6 +406,389 @@ create_proc_dir(const char *loom, int pid)
 		rproc.move_to_final = 0;
 		mkdir_proc(rproc.procdir, tracedir, loom, pid);
 	}
+
+	/* The manifests are always in the final place */
+	const char *procdir = rproc.move_to_final ? rproc.procdir_final : rproc.procdir;
+
+	if (snprintf(rproc.relproc, PATH_MAX, "loom.%s/proc.%d", loom, pid) >= PATH_MAX)
+		die("path too long: loom.%s/proc.%d", loom, pid);
+
+	if (snprintf(rproc.trace_manifest, PATH_MAX, "%s/manifest", tracedir) >= PATH_MAX)
+		die("path too long: %s/manifest", tracedir);
+
+	if (snprintf(rproc.proc_manifest, PATH_MAX, "%smanifest", procdir) >= PATH_MAX)
+		die("path too long: %smanifest", procdir);
+}
+
+/* Writes the buffer to a manifest opened with O_APPEND in a single write, so
+ * the lines of different processes or threads are not mixed */
+static void
+manifest_write(int fd, const char *path, const char *buf, size_t len)
+{
+	ssize_t written = write(fd, buf, len);
+	if (written < 0 || (size_t) written != len)
+		die("write %s failed:", path);
+}
+
+static int
+manifest_open(const char *path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0)
+		die("open %s failed:", path);
+
+	return fd;
+}
+
+/* Appends the buffer to the manifest, only for the few lines of the process
+ * in the trace manifest */
+static void
+manifest_append(const char *path, const char *buf, size_t len)
+{
+	int fd = manifest_open(path);
+	manifest_write(fd, path, buf, len);
+
+	if (close(fd) != 0)
+		die("close %s failed:", path);
+}
+
+/* Adds a line to the process manifest with the state of the thread stream */
+static void
+manifest_thread(pid_t tid, uint64_t size, int finished)
+{
+	char line[128];
+	int n = snprintf(line, sizeof(line), "%d %" PRIu64 " %d\n",
+			(int) tid, size, finished);
+
+	manifest_write(rproc.proc_manifest_fd, rproc.proc_manifest, line, (size_t) n);
+}
+
+/* Merges the process manifest into the trace manifest, converting each line
+ * to the trace format. The process is marked as ended, so the loader doesn't
+ * need to look at the process manifest. */
+static void
+manifest_merge(void)
+{
+	size_t cap = 4096;
+	size_t len = 0;
+	char *buf = malloc(cap);
+	if (buf == NULL)
+		die("malloc failed:");
+
+	FILE *f = fopen(rproc.proc_manifest, "r");
+
+	/* No threads, only mark it as ended */
+	if (f == NULL && errno != ENOENT)
+		die("fopen %s failed:", rproc.proc_manifest);
+
+	int tid, finished;
+	uint64_t size;
+	while (f != NULL && fscanf(f, "%d %" SCNu64 " %d", &tid, &size, &finished) == 3) {
+		char line[PATH_MAX + 256];
+		int n = snprintf(line, sizeof(line), "thread %s/thread.%d %d %d %s %" PRIu64 " %d\n",
+				rproc.relproc, tid, tid, rproc.pid, rproc.loom, size, finished);
+
+		if (n < 0 || (size_t) n >= sizeof(line))
+			die("manifest line too long");
+
+		while (len + (size_t) n + 1 > cap) {
+			cap *= 2;
+			buf = realloc(buf, cap);
+			if (buf == NULL)
+				die("realloc failed:");
+		}
+
+		memcpy(buf + len, line, (size_t) n);
+		len += (size_t) n;
+	}
+
+	if (f != NULL)
+		fclose(f);
+
+	/* The threads of the container are found in its chunk table */
+	char end[2 * PATH_MAX + 32];
+	int n = 0;
+	if (rproc.container)
+		n = snprintf(end, sizeof(end), "container %s\n", rproc.relproc);
+
+	n += snprintf(end + n, sizeof(end) - (size_t) n, "end %s\n", rproc.relproc);
+
+	while (len + (size_t) n > cap) {
+		cap *= 2;
+		buf = realloc(buf, cap);
+		if (buf == NULL)
+			die("realloc failed:");
+	}
+
+	memcpy(buf + len, end, (size_t) n);
+	len += (size_t) n;
+
+	manifest_append(rproc.trace_manifest, buf, len);
+	free(buf);
+}
+
+static void
+filter_update(const char *mc, int enable)
+{
+	if (mc == NULL)
+		die("filter string is NULL");
+
+	size_t len = strlen(mc);
+	if (len < 1 || len > 2)
+		die("malformed filter '%s', expecting model or model and category", mc);
+
+	uint8_t m = (uint8_t) mc[0];
+
+	if (m == 'O')
+		die("cannot filter events of the ovni model");
+
+	/* Only the model, apply to all categories */
+	int c0 = 0, c1 = 255;
+	if (len == 2)
+		c0 = c1 = (uint8_t) mc[1];
+
+	for (int c = c0; c <= c1; c++) {
+		uint8_t bit = (uint8_t) (1 << (c & 7));
+		if (enable)
+			rproc.filter[m][c >> 3] &= (uint8_t) ~bit;
+		else
+			rproc.filter[m][c >> 3] |= bit;
+	}
+
+	if (!enable)
+		rproc.filter_set = 1;
+}
+
+static inline int
+is_filtered(const struct ovni_ev *ev)
+{
+	uint8_t c = ev->header.category;
+	return rproc.filter[ev->header.model][c >> 3] & (1 << (c & 7));
+}
+
+/**
+ * Disables the emission of events of a model or a model category.
+ *
+ * @param mc The model character alone, to disable all the events of the model,
+ * or followed by the category character, to only disable that category.
+ *
+ * The filter is global to the process. It should be set after ovni_proc_init()
+ * and before the threads emit events of the affected model.
+ */
+void
+ovni_filter_disable(const char *mc)
+{
+	filter_update(mc, 0);
+}
+
+/**
+ * Enables again the emission of events previously disabled with
+ * ovni_filter_disable(), with the same syntax.
+ */
+void
+ovni_filter_enable(const char *mc)
+{
+	filter_update(mc, 1);
+}
+
+/* Parses the OVNI_FILTER environment variable, as a comma separated list of
+ * models or model and category to disable. */
+static void
+filter_from_env(void)
+{
+	const char *env = getenv("OVNI_FILTER");
+	if (env == NULL || env[0] == '\0')
+		return;
+
+	char buf[1024];
+	if (snprintf(buf, sizeof(buf), "%s", env) >= (int) sizeof(buf))
+		die("OVNI_FILTER too long");
+
+	char *saveptr = NULL;
+	for (char *tok = strtok_r(buf, ",", &saveptr); tok;
+			tok = strtok_r(NULL, ",", &saveptr)) {
+		filter_update(tok, 0);
+	}
+}
+
+/**
+ * Requests all threads in flight recorder mode to write their buffers to disk.
+ *
+ * Each thread writes them the next time it emits an event or when it is freed,
+ * and then continues keeping the events in memory until the next trigger. It
+ * is async-signal-safe. Ignored if the flight recorder is not enabled.
+ */
+void
+ovni_ring_trigger(void)
+{
+	atomic_fetch_add(&rproc.ring_gen, 1);
+}
+
+static void
+ring_signal_handler(int signum)
+{
+	UNUSED(signum);
+	ovni_ring_trigger();
+}
+
+/* Parses OVNI_RING as the number of buffers kept by each thread and
+ * OVNI_RING_SIGNAL as the signal number that triggers the dump. */
+static void
+ring_from_env(void)
+{
+	const char *env = getenv("OVNI_RING");
+	if (env == NULL || env[0] == '\0')
+		return;
+
+	char *end = NULL;
+	long n = strtol(env, &end, 10);
+	if (*end != '\0' || n < 1 || n > 4096)
+		die("OVNI_RING must be a number of buffers in [1, 4096]: %s", env);
+
+	rproc.ring_nslots = (int) n;
+
+	const char *sig = getenv("OVNI_RING_SIGNAL");
+	if (sig == NULL || sig[0] == '\0')
+		return;
+
+	long signum = strtol(sig, &end, 10);
+	if (*end != '\0' || signum <= 0 || signum > INT_MAX)
+		die("OVNI_RING_SIGNAL must be a signal number: %s", sig);
+
+	struct sigaction sa = {0};
+	sa.sa_handler = ring_signal_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction((int) signum, &sa, NULL) != 0)
+		die("sigaction failed for signal %ld:", signum);
+}
+
+static void
+perf_from_env(void)
+{
+	const char *env = getenv("OVNI_PERF_SWITCH");
+	if (env == NULL || env[0] == '\0' || strcmp(env, "0") == 0)
+		return;
+
+	if (strcmp(env, "1") != 0)
+		die("OVNI_PERF_SWITCH must be 0 or 1: %s", env);
+
+#ifdef USE_TSC
+	die("OVNI_PERF_SWITCH is not supported with the TSC clock");
+#endif
+
+	if (rproc.ring_nslots > 0)
+		die("OVNI_PERF_SWITCH cannot be used with OVNI_RING");
+
+	rproc.perf_switch = 1;
+}
+
+static void
+calibrate_from_env(void)
+{
+	rproc.calibrate = 1;
+
+	const char *env = getenv("OVNI_CALIBRATE");
+	if (env == NULL || env[0] == '\0' || strcmp(env, "1") == 0)
+		return;
+
+	if (strcmp(env, "0") != 0)
+		die("OVNI_CALIBRATE must be 0 or 1: %s", env);
+
+	rproc.calibrate = 0;
+}
+
+static void
+container_from_env(void)
+{
+	const char *env = getenv("OVNI_CONTAINER");
+	if (env == NULL || env[0] == '\0' || strcmp(env, "0") == 0)
+		return;
+
+	if (strcmp(env, "1") != 0)
+		die("OVNI_CONTAINER must be 0 or 1: %s", env);
+
+	rproc.container = 1;
+}
+
+/* Opens the container and the chunk table in the process directory */
+static void
+container_open(void)
+{
+	char path[PATH_MAX];
+	if (snprintf(path, PATH_MAX, "%scontainer.obs", rproc.procdir) >= PATH_MAX)
+		die("path too long: %scontainer.obs", rproc.procdir);
+
+	rproc.cont_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (rproc.cont_fd < 0)
+		die("open %s failed:", path);
+
+	write_stream_header(rproc.cont_fd);
+	atomic_store(&rproc.cont_off, sizeof(struct ovni_stream_header));
+
+	if (snprintf(path, PATH_MAX, "%scontainer.idx", rproc.procdir) >= PATH_MAX)
+		die("path too long: %scontainer.idx", rproc.procdir);
+
+	rproc.cont_idx = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (rproc.cont_idx < 0)
+		die("open %s failed:", path);
+}
+
+static void
+move_from_env(void)
+{
+	if (pthread_mutex_init(&rproc.move_lock, NULL) != 0)
+		die("pthread_mutex_init failed");
+
+	const char *report = getenv("OVNI_TMPDIR_REPORT");
+	if (report != NULL && report[0] != '\0' && strcmp(report, "0") != 0) {
+		if (strcmp(report, "1") != 0)
+			die("OVNI_TMPDIR_REPORT must be 0 or 1: %s", report);
+		rproc.move_report = 1;
+	}
+
+	const char *env = getenv("OVNI_TMPDIR_WORKERS");
+	if (env == NULL || env[0] == '\0')
+		return;
+
+	char *end = NULL;
+	long n = strtol(env, &end, 10);
+	if (*end != '\0' || n < 0 || n > 1024)
+		die("OVNI_TMPDIR_WORKERS must be a number in [0, 1024]: %s", env);
+
+	rproc.move_workers = (int) n;
+}
+
+/* Measures the cost of emitting one event, by reading the clock and
+ * copying an event into a buffer. The minimum of a few rounds is taken
+ * to exclude preemptions. Only done once per process, as it is the same
+ * for all threads. */
+static void
+calibrate_emit(void)
+{
+	enum { ROUNDS = 5, ITERS = 64 };
+	struct ovni_ev ev = {0};
+	ovni_ev_set_mcv(&ev, "OB.");
+	size_t size = (size_t) ovni_ev_size(&ev);
+	uint8_t buf[sizeof(struct ovni_ev)];
+
+	uint64_t best = UINT64_MAX;
+	for (int r = 0; r < ROUNDS; r++) {
+		uint64_t t0 = ovni_clock_now();
+		for (int i = 0; i < ITERS; i++) {
+			ovni_ev_set_clock(&ev, ovni_clock_now());
+			memcpy(buf, &ev, size);
+			/* Prevent the copies from being merged */
+			__asm__ volatile("" : : "r"(buf) : "memory");
+		}
+		uint64_t t1 = ovni_clock_now();
+
+		if (t1 - t0 < best)
+			best = t1 - t0;
+	}
+
+	rproc.calib_emit_ns = (double) best / ITERS;
 }
 
 void
@@ -271,70 +816,206 @@ ovni_proc_init(int app, const char *loom, int pid)
 	rproc.app = app;
 	rproc.clockid = CLOCK_MONOTONIC;
 
+	filter_from_env();
+	ring_from_env();
+	perf_from_env();
+	move_from_env();
+	container_from_env();
+	calibrate_from_env();
 	create_proc_dir(loom, pid);
 
+	if (rproc.calibrate)
+		calibrate_emit();
+
+	/* The threads add their streams to the process manifest, so it is
+	 * opened once for all of them */
+	if (rproc.container) {
+		container_open();
+		rproc.proc_manifest_fd = -1;
+	} else {
+		rproc.proc_manifest_fd = manifest_open(rproc.proc_manifest);
+	}
+
+	/* Register the process, so the loader knows if it didn't end */
+	char line[PATH_MAX + 16];
+	int n = snprintf(line, sizeof(line), "proc %s\n", rproc.relproc);
+	manifest_append(rproc.trace_manifest, line, (size_t) n);
+
 	atomic_store(&rproc.st, ST_READY);
 }
 
-static int
-move_thread_to_final(const char *src, const char *dst)
+static uint64_t
+now_ns(void)
 {
-	char buffer[1024];
+	struct timespec tp;
+	if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0)
+		die("clock_gettime failed:");
+
+	return (uint64_t) tp.tv_sec * 1000000000ULL + (uint64_t) tp.tv_nsec;
+}
 
-	FILE *infile = fopen(src, "r");
+/* Copies the rest of the file with read and write */
+static int
+copy_rw(int infd, int outfd)
+{
+	size_t bufsize = 1024 * 1024;
+	uint8_t *buf = malloc(bufsize);
 
-	if (infile == NULL) {
-		err("fopen(%s) failed:", src);
+	if (buf == NULL) {
+		err("malloc failed:");
 		return -1;
 	}
 
-	FILE *outfile = fopen(dst, "w");
+	int ret = 0;
+	while (1) {
+		ssize_t n = read(infd, buf, bufsize);
 
-	if (outfile == NULL) {
-		err("fopen(%s) failed:", src);
-		return -1;
-	}
+		if (n == 0)
+			break;
 
-	size_t bytes;
-	while ((bytes = fread(buffer, 1, sizeof(buffer), infile)) > 0)
-		fwrite(buffer, 1, bytes, outfile);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
 
-	fclose(outfile);
-	fclose(infile);
+			err("read failed:");
+			ret = -1;
+			break;
+		}
 
-	if (remove(src) != 0) {
-		err("remove(%s) failed:", src);
-		return -1;
+		for (ssize_t off = 0; off < n; ) {
+			ssize_t w = write(outfd, buf + off, (size_t) (n - off));
+			if (w < 0) {
+				if (errno == EINTR)
+					continue;
+
+				err("write failed:");
+				ret = -1;
+				goto out;
+			}
+			off += w;
+		}
 	}
 
-	return 0;
+out:
+	free(buf);
+	return ret;
 }
 
-static void
-move_thdir_to_final(const char *thdir, const char *thdir_final)
+/* Copies the file in the kernel with sendfile(2) in large chunks, or with
+ * read and write if not supported by the filesystems */
+static int
+copy_file(int infd, int outfd, off_t size)
 {
-	DIR *dir;
-	int ret = 0;
+	off_t left = size;
 
-	if ((dir = opendir(thdir)) == NULL) {
-		err("opendir %s failed:", thdir);
-		return;
-	}
+	while (left > 0) {
+		size_t chunk = left > (1 << 30) ? (1 << 30) : (size_t) left;
+		ssize_t n = sendfile(outfd, infd, NULL, chunk);
 
-	struct dirent *dirent;
-	const char *prefix = "stream.";
-	while (1) {
-		errno = 0;
-		if ((dirent = readdir(dir)) == NULL) {
-			if (errno)
-				die("readdir failed:");
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
 
-			break;
+			/* Both offsets have advanced the same amount, so we
+			 * can continue from here */
+			if (errno == EINVAL || errno == ENOSYS)
+				return copy_rw(infd, outfd);
+
+			err("sendfile failed:");
+			return -1;
 		}
 
-		/* It should only contain stream.* directories, skip others */
-		if (strncmp(dirent->d_name, prefix, strlen(prefix)) != 0)
-			continue;
+		/* The file was truncated */
+		if (n == 0)
+			break;
+
+		left -= n;
+	}
+
+	return 0;
+}
+
+static int
+move_thread_to_final(const char *src, const char *dst, uint64_t *bytes)
+{
+	struct stat st;
+	if (stat(src, &st) != 0) {
+		err("stat(%s) failed:", src);
+		return -1;
+	}
+
+	*bytes = (uint64_t) st.st_size;
+
+	/* Only a rename is needed when both are in the same filesystem */
+	if (rename(src, dst) == 0)
+		return 0;
+
+	if (errno != EXDEV) {
+		err("rename(%s, %s) failed:", src, dst);
+		return -1;
+	}
+
+	int infd = open(src, O_RDONLY);
+	if (infd < 0) {
+		err("open(%s) failed:", src);
+		return -1;
+	}
+
+	int outfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (outfd < 0) {
+		err("open(%s) failed:", dst);
+		close(infd);
+		return -1;
+	}
+
+	int ret = copy_file(infd, outfd, st.st_size);
+
+	if (close(outfd) != 0) {
+		err("close(%s) failed:", dst);
+		ret = -1;
+	}
+
+	close(infd);
+
+	if (ret != 0)
+		return -1;
+
+	if (remove(src) != 0) {
+		err("remove(%s) failed:", src);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+move_thdir_to_final(const char *thdir, const char *thdir_final)
+{
+	DIR *dir;
+	int ret = 0;
+	uint64_t t0 = now_ns();
+	uint64_t nfiles = 0;
+	uint64_t nbytes = 0;
+
+	if ((dir = opendir(thdir)) == NULL) {
+		err("opendir %s failed:", thdir);
+		return;
+	}
+
+	struct dirent *dirent;
+	const char *prefix = "stream.";
+	while (1) {
+		errno = 0;
+		if ((dirent = readdir(dir)) == NULL) {
+			if (errno)
+				die("readdir failed:");
+
+			break;
+		}
+
+		/* It should only contain stream.* directories, skip others */
+		if (strncmp(dirent->d_name, prefix, strlen(prefix)) != 0)
+			continue;
 
 		char thread[PATH_MAX];
 		if (snprintf(thread, PATH_MAX, "%s/%s", thdir,
@@ -356,12 +1037,22 @@ move_thdir_to_final(const char *thdir, const char *thdir_final)
 			continue;
 		}
 
-		if (move_thread_to_final(thread, thread_final) != 0)
+		uint64_t bytes = 0;
+		if (move_thread_to_final(thread, thread_final, &bytes) != 0) {
 			ret = 1;
+			continue;
+		}
+
+		nfiles++;
+		nbytes += bytes;
 	}
 
 	closedir(dir);
 
+	atomic_fetch_add(&rproc.moved_files, nfiles);
+	atomic_fetch_add(&rproc.moved_bytes, nbytes);
+	atomic_fetch_add(&rproc.moved_ns, now_ns() - t0);
+
 	/* Warn the user, but we cannot do much at this point */
 	if (ret)
 		err("errors occurred when moving the thread dir to %s", thdir_final);
@@ -375,6 +1066,145 @@ try_clean_dir(const char *dir)
 		warn("cannot remove dir %s:", dir);
 }
 
+static void
+move_thread(const char *thdir, const char *thdir_final)
+{
+	if (mkdir(thdir_final, 0755) != 0 && errno != EEXIST)
+		die("mkdir %s failed:", thdir_final);
+
+	move_thdir_to_final(thdir, thdir_final);
+	try_clean_dir(thdir);
+}
+
+/* Queues the thread directory to be moved by the workers at
+ * ovni_proc_fini(). Returns 0 if queued or -1 if it must be moved now. */
+static int
+move_thread_defer(const char *thdir, const char *thdir_final)
+{
+	if (rproc.move_workers == 0)
+		return -1;
+
+	struct ovni_rmove *mv = malloc(sizeof(*mv));
+	if (mv == NULL)
+		die("malloc failed:");
+
+	memcpy(mv->thdir, thdir, PATH_MAX);
+	memcpy(mv->thdir_final, thdir_final, PATH_MAX);
+
+	int queued = 0;
+	pthread_mutex_lock(&rproc.move_lock);
+	if (!rproc.moves_closed) {
+		mv->next = rproc.moves;
+		rproc.moves = mv;
+		queued = 1;
+	}
+	pthread_mutex_unlock(&rproc.move_lock);
+
+	if (!queued) {
+		free(mv);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *
+move_worker(void *arg)
+{
+	UNUSED(arg);
+
+	while (1) {
+		pthread_mutex_lock(&rproc.move_lock);
+		struct ovni_rmove *mv = rproc.moves;
+		if (mv != NULL)
+			rproc.moves = mv->next;
+		pthread_mutex_unlock(&rproc.move_lock);
+
+		if (mv == NULL)
+			break;
+
+		move_thread(mv->thdir, mv->thdir_final);
+		free(mv);
+	}
+
+	return NULL;
+}
+
+/* Moves the queued threads with a pool of workers */
+static void
+move_pending_threads(void)
+{
+	pthread_mutex_lock(&rproc.move_lock);
+	rproc.moves_closed = 1;
+	int nmoves = 0;
+	for (struct ovni_rmove *mv = rproc.moves; mv; mv = mv->next)
+		nmoves++;
+	pthread_mutex_unlock(&rproc.move_lock);
+
+	int nworkers = rproc.move_workers;
+	if (nworkers > nmoves)
+		nworkers = nmoves;
+
+	/* The current thread also works, so we always make progress */
+	size_t nextra = nworkers > 1 ? (size_t) nworkers - 1 : 0;
+	pthread_t *workers = calloc(nextra + 1, sizeof(pthread_t));
+	if (workers == NULL)
+		die("calloc failed:");
+
+	size_t nstarted = 0;
+	for (size_t i = 0; i < nextra; i++) {
+		if (pthread_create(&workers[nstarted], NULL, move_worker, NULL) != 0) {
+			warn("pthread_create failed, using fewer workers");
+			break;
+		}
+		nstarted++;
+	}
+
+	move_worker(NULL);
+
+	for (size_t i = 0; i < nstarted; i++) {
+		if (pthread_join(workers[i], NULL) != 0)
+			die("pthread_join failed");
+	}
+
+	free(workers);
+}
+
+/* Closes the container and moves it out of OVNI_TMPDIR if needed */
+static void
+container_close(void)
+{
+	if (close(rproc.cont_fd) != 0)
+		die("close container failed:");
+
+	if (close(rproc.cont_idx) != 0)
+		die("close chunk table failed:");
+
+	if (!rproc.move_to_final)
+		return;
+
+	uint64_t t0 = now_ns();
+	const char *names[] = { "container.obs", "container.idx" };
+	for (int i = 0; i < 2; i++) {
+		char src[PATH_MAX], dst[PATH_MAX];
+		if (snprintf(src, PATH_MAX, "%s%s", rproc.procdir, names[i]) >= PATH_MAX)
+			die("path too long: %s%s", rproc.procdir, names[i]);
+		if (snprintf(dst, PATH_MAX, "%s%s", rproc.procdir_final, names[i]) >= PATH_MAX)
+			die("path too long: %s%s", rproc.procdir_final, names[i]);
+
+		uint64_t bytes = 0;
+		if (move_thread_to_final(src, dst, &bytes) != 0) {
+			err("cannot move %s to %s", src, dst);
+			continue;
+		}
+
+		atomic_fetch_add(&rproc.moved_files, 1);
+		atomic_fetch_add(&rproc.moved_bytes, bytes);
+	}
+
+	atomic_fetch_add(&rproc.moved_ns, now_ns() - t0);
+}
+
 void
 ovni_proc_fini(void)
 {
@@ -386,18 +1216,46 @@ ovni_proc_fini(void)
 	if (!was_ready)
 		die("process not ready");
 
+	if (rproc.proc_manifest_fd >= 0) {
+		if (close(rproc.proc_manifest_fd) != 0)
+			die("close %s failed:", rproc.proc_manifest);
+		rproc.proc_manifest_fd = -1;
+	}
+
+	manifest_merge();
+
+	if (rproc.container)
+		container_close();
+
 	if (rproc.move_to_final) {
+		uint64_t t0 = now_ns();
+		move_pending_threads();
+		uint64_t t1 = now_ns();
+
 		try_clean_dir(rproc.procdir);
 		try_clean_dir(rproc.loomdir);
 		try_clean_dir(rproc.tmpdir);
+
+		/* With workers the moves overlap, so report the elapsed time
+		 * instead of the sum of the time of each thread */
+		uint64_t ns = atomic_load(&rproc.moved_ns);
+		if (rproc.move_workers > 0)
+			ns = t1 - t0;
+
+		if (rproc.move_report) {
+			info("moved %" PRIu64 " files (%.1f MiB) from OVNI_TMPDIR in %.3f s",
+					(uint64_t) atomic_load(&rproc.moved_files),
+					(double) atomic_load(&rproc.moved_bytes) / (1024.0 * 1024.0),
+					(double) ns * 1e-9);
+		}
 	}
 }
 
 static void
-write_evbuf(uint8_t *buf, size_t size)
+write_fd(int fd, const uint8_t *buf, size_t size)
 {
 	do {
-		ssize_t written = write(rthread.streamfd, buf, size);
+		ssize_t written = write(fd, buf, size);
 
 		if (written < 0)
 			die("failed to write buffer to disk:");
@@ -407,40 +1265,870 @@ write_evbuf(uint8_t *buf, size_t size)
 	} while (size > 0);
 }
 
+/* Writes a chunk of the current thread in the process container. The space
+ * is reserved atomically, so the threads don't need to synchronize. The
+ * entry is added to the chunk table once the data is written, so a chunk in
+ * the table is always complete. */
+static void
+container_write(enum ovni_chunk_kind kind, const uint8_t *buf, size_t size)
+{
+	uint64_t off = atomic_fetch_add(&rproc.cont_off, size);
+
+	for (size_t done = 0; done < size; ) {
+		ssize_t n = pwrite(rproc.cont_fd, buf + done, size - done,
+				(off_t) (off + done));
+
+		if (n < 0)
+			die("failed to write chunk to container:");
+
+		done += (size_t) n;
+	}
+
+	struct ovni_chunk_entry e = {
+		.tid = (int32_t) rthread.tid,
+		.seq = rthread.chunk_seq++,
+		.kind = (uint32_t) kind,
+		.offset = off,
+		.size = size,
+	};
+
+	/* Appends of one entry are not mixed with other threads */
+	ssize_t n = write(rproc.cont_idx, &e, sizeof(e));
+	if (n != (ssize_t) sizeof(e))
+		die("failed to write chunk table entry:");
+}
+
+static void
+write_evbuf(uint8_t *buf, size_t size)
+{
+	if (rproc.container) {
+		if (size > 0)
+			container_write(OVNI_CHUNK_EVENTS, buf, size);
+		return;
+	}
+
+	if (rthread.streamfd == -1)
+		create_trace_stream();
+
+	write_fd(rthread.streamfd, buf, size);
+}
+
+static void
+write_stream_header(int fd)
+{
+	struct ovni_stream_header h;
+
+	memcpy(h.magic, OVNI_STREAM_MAGIC, 4);
+	h.version = OVNI_STREAM_VERSION;
+
+	write_fd(fd, (uint8_t *) &h, sizeof(h));
+}
+
+/* Moves to the next buffer of the ring, overwriting the oldest one if the
+ * ring is full. */
+static void
+ring_rotate(void)
+{
+	struct ovni_rring *ring = rthread.ring;
+
+	ring->slots[ring->cur].len = rthread.evlen;
+
+	int next = (ring->cur + 1) % ring->nslots;
+	if (next == ring->first) {
+		ring->dropped += ring->slots[next].len;
+		ring->first = (ring->first + 1) % ring->nslots;
+	}
+
+	struct ovni_rslot *slot = &ring->slots[next];
+	slot->len = 0;
+	slot->snap = ring->snap;
+
+	ring->cur = next;
+	rthread.evbuf = slot->buf;
+	rthread.evlen = 0;
+}
+
+/* Opens a software perf event that records the context switches of the
+ * current thread in a ring shared with the kernel, so no syscall is needed to
+ * read them. */
+static void
+perf_init(void)
+{
+	struct perf_event_attr attr = {0};
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+	attr.sample_type = PERF_SAMPLE_TIME;
+	attr.sample_id_all = 1;
+	attr.context_switch = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	/* Use the same clock as the events */
+	attr.use_clockid = 1;
+	attr.clockid = rproc.clockid;
+
+	int fd = perf_event_open(&attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (fd < 0) {
+		if (atomic_fetch_add(&rproc.perf_warned, 1) == 0)
+			warn("perf_event_open failed, context switches disabled:");
+		return;
+	}
+
+	long pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize <= 0)
+		die("sysconf failed:");
+
+	uint64_t data_size = (uint64_t) pagesize * PERF_PAGES;
+	size_t mmap_size = (size_t) pagesize + (size_t) data_size;
+	void *m = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED)
+		die("mmap of perf ring failed:");
+
+	struct ovni_rperf *perf = calloc(1, sizeof(*perf));
+	if (perf == NULL)
+		die("calloc failed:");
+
+	perf->fd = fd;
+	perf->page = m;
+	perf->mmap_size = mmap_size;
+	perf->data = (uint8_t *) m + pagesize;
+	perf->data_size = data_size;
+
+	/* Each record is larger than the ovni event it produces */
+	perf->buf = malloc(OVNI_MAX_EV_BUF + data_size);
+	if (perf->buf == NULL)
+		die("malloc failed:");
+
+	rthread.perf = perf;
+}
+
+static void
+perf_free(void)
+{
+	struct ovni_rperf *perf = rthread.perf;
+
+	if (perf->lost > 0)
+		warn("thread %d lost %" PRIu64 " context switch records",
+				rthread.tid, perf->lost);
+
+	munmap(perf->page, perf->mmap_size);
+	close(perf->fd);
+	free(perf->buf);
+	free(perf);
+
+	rthread.perf = NULL;
+}
+
+/* Copies n bytes from the perf ring, which may wrap around */
+static void
+perf_copy(struct ovni_rperf *perf, uint64_t off, void *dst, size_t n)
+{
+	uint64_t i = off & (perf->data_size - 1);
+	size_t first = n;
+
+	if (i + n > perf->data_size)
+		first = (size_t) (perf->data_size - i);
+
+	memcpy(dst, perf->data + i, first);
+	memcpy((uint8_t *) dst + first, perf->data, n - first);
+}
+
+/* Merges the context switch records with the events in the buffer, in clock
+ * order. The records after the last event are left in the ring for the next
+ * flush, so the clock never goes backwards. Returns the merged size. */
+static size_t
+perf_merge(const uint8_t *evbuf, size_t evlen)
+{
+	struct ovni_rperf *perf = rthread.perf;
+	uint64_t head = __atomic_load_n(&perf->page->data_head, __ATOMIC_ACQUIRE);
+	uint64_t tail = perf->page->data_tail;
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < evlen) {
+		const struct ovni_ev *ev = (const struct ovni_ev *) (evbuf + in);
+
+		while (tail < head) {
+			struct perf_event_header h;
+			perf_copy(perf, tail, &h, sizeof(h));
+
+			if (h.type == PERF_RECORD_SWITCH) {
+				uint64_t t;
+				perf_copy(perf, tail + sizeof(h), &t, sizeof(t));
+
+				if (t > ev->header.clock)
+					break;
+
+				struct ovni_ev kev = {0};
+				ovni_ev_set_clock(&kev, t);
+				if (h.misc & PERF_RECORD_MISC_SWITCH_OUT)
+					ovni_ev_set_mcv(&kev, "KCO");
+				else
+					ovni_ev_set_mcv(&kev, "KCI");
+
+				if (!is_filtered(&kev)) {
+					size_t ksize = (size_t) ovni_ev_size(&kev);
+					memcpy(perf->buf + out, &kev, ksize);
+					out += ksize;
+				}
+			} else if (h.type == PERF_RECORD_LOST) {
+				/* Skip the id before the lost count */
+				uint64_t lost;
+				perf_copy(perf, tail + sizeof(h) + 8, &lost, sizeof(lost));
+				perf->lost += lost;
+			}
+
+			tail += h.size;
+		}
+
+		size_t size = (size_t) ovni_ev_size(ev);
+		memcpy(perf->buf + out, ev, size);
+		out += size;
+		in += size;
+	}
+
+	__atomic_store_n(&perf->page->data_tail, tail, __ATOMIC_RELEASE);
+
+	return out;
+}
+
+static void
+flush_evbuf(void)
+{
+	/* No I/O in flight recorder mode */
+	if (rthread.ring != NULL) {
+		ring_rotate();
+		return;
+	}
+
+	if (rthread.perf != NULL) {
+		size_t len = perf_merge(rthread.evbuf, rthread.evlen);
+		write_evbuf(rthread.perf->buf, len);
+	} else {
+		write_evbuf(rthread.evbuf, rthread.evlen);
+	}
+
+	rthread.evlen = 0;
+}
+
+static void
+ring_init(int nslots)
+{
+	struct ovni_rring *ring = calloc(1, sizeof(*ring));
+	if (ring == NULL)
+		die("calloc failed:");
+
+	ring->slots = calloc((size_t) nslots, sizeof(struct ovni_rslot));
+	if (ring->slots == NULL)
+		die("calloc failed:");
+
+	/* The first buffer is the one already in evbuf */
+	ring->slots[0].buf = rthread.evbuf;
+	for (int i = 1; i < nslots; i++) {
+		ring->slots[i].buf = malloc(OVNI_MAX_EV_BUF);
+		if (ring->slots[i].buf == NULL)
+			die("malloc failed:");
+	}
+
+	ring->nslots = nslots;
+	ring->snap.cpu = -1;
+	ring->dumped.cpu = -1;
+	ring->gen = atomic_load(&rproc.ring_gen);
+
+	rthread.ring = ring;
+}
+
+/* Updates the state snapshot from the ovni events of the thread */
+static void
+ring_track(const struct ovni_ev *ev)
+{
+	if (ev->header.model != 'O')
+		return;
+
+	struct ovni_rsnap *snap = &rthread.ring->snap;
+	uint8_t c = ev->header.category;
+	uint8_t v = ev->header.value;
+
+	if (c == 'H') {
+		switch (v) {
+			case 'x':
+				snap->cpu = ev->payload.i32[0];
+				snap->state = RSNAP_RUNNING;
+				break;
+			case 'r': snap->state = RSNAP_RUNNING; break;
+			case 'p': snap->state = RSNAP_PAUSED; break;
+			case 'c': snap->state = RSNAP_COOLING; break;
+			case 'w': snap->state = RSNAP_WARMING; break;
+			case 'e': snap->state = RSNAP_DEAD; break;
+			default: break;
+		}
+	} else if (c == 'A') {
+		if (v == 's')
+			snap->cpu = ev->payload.i32[0];
+		else if (v == 'r' && ev->payload.i32[1] == rthread.tid)
+			snap->cpu = ev->payload.i32[0];
+	}
+}
+
+static void
+write_snap_ev(const char *mcv, uint64_t clock, const struct ovni_rsnap *snap)
+{
+	struct ovni_ev ev = {0};
+	ovni_ev_set_clock(&ev, clock);
+	ovni_ev_set_mcv(&ev, mcv);
+
+	if (mcv[1] == 'A') {
+		ovni_payload_add(&ev, (uint8_t *) &snap->cpu, sizeof(snap->cpu));
+	} else if (mcv[2] == 'x') {
+		int32_t ctid = -1;
+		uint64_t tag = 0;
+		ovni_payload_add(&ev, (uint8_t *) &snap->cpu, sizeof(snap->cpu));
+		ovni_payload_add(&ev, (uint8_t *) &ctid, sizeof(ctid));
+		ovni_payload_add(&ev, (uint8_t *) &tag, sizeof(tag));
+	}
+
+	write_evbuf((uint8_t *) &ev, (size_t) ovni_ev_size(&ev));
+}
+
+/* Writes the events that bring the thread from the state of the last dump to
+ * the snapshot state, so the emulator can continue after the lost events. The
+ * thread is first brought to running, where it can change the CPU. */
+static void
+write_snap(const struct ovni_rsnap *from, const struct ovni_rsnap *to,
+		uint64_t clock)
+{
+	if (to->state == RSNAP_UNKNOWN || to->state == RSNAP_DEAD)
+		return;
+
+	switch (from->state) {
+		case RSNAP_UNKNOWN:
+			write_snap_ev("OHx", clock, to);
+			break;
+		case RSNAP_PAUSED:
+		case RSNAP_WARMING:
+			write_snap_ev("OHr", clock, to);
+			break;
+		case RSNAP_COOLING:
+			write_snap_ev("OHp", clock, to);
+			write_snap_ev("OHr", clock, to);
+			break;
+		case RSNAP_DEAD:
+			return;
+		default:
+			break;
+	}
+
+	if (from->state != RSNAP_UNKNOWN && from->cpu != to->cpu)
+		write_snap_ev("OAs", clock, to);
+
+	switch (to->state) {
+		case RSNAP_PAUSED:
+			write_snap_ev("OHp", clock, to);
+			break;
+		case RSNAP_COOLING:
+			write_snap_ev("OHc", clock, to);
+			break;
+		case RSNAP_WARMING:
+			write_snap_ev("OHp", clock, to);
+			write_snap_ev("OHw", clock, to);
+			break;
+		default:
+			break;
+	}
+}
+
+static void thread_metadata_store(int finished);
+
+/* Writes the retained buffers to disk, and starts filling the ring again from
+ * the first buffer until the next dump. */
+static void
+ring_dump(void)
+{
+	struct ovni_rring *ring = rthread.ring;
+	ring->slots[ring->cur].len = rthread.evlen;
+
+	int first = 1;
+	for (int i = ring->first; ; i = (i + 1) % ring->nslots) {
+		struct ovni_rslot *slot = &ring->slots[i];
+
+		if (slot->len > 0) {
+			/* Only needed when some events were lost */
+			if (first && ring->dropped > 0) {
+				struct ovni_ev *ev = (struct ovni_ev *) slot->buf;
+				write_snap(&ring->dumped, &slot->snap,
+						ovni_ev_get_clock(ev));
+			}
+
+			write_evbuf(slot->buf, slot->len);
+			first = 0;
+		}
+
+		if (i == ring->cur)
+			break;
+	}
+
+	rthread.ring_nslots = ring->nslots;
+	rthread.ring_dropped += ring->dropped;
+
+	ring->dumped = ring->snap;
+	ring->dropped = 0;
+	ring->first = 0;
+	ring->cur = 0;
+	ring->slots[0].len = 0;
+	ring->slots[0].snap = ring->snap;
+	ring->gen = atomic_load(&rproc.ring_gen);
+
+	rthread.evbuf = ring->slots[0].buf;
+	rthread.evlen = 0;
+
+	thread_metadata_store(0);
+}
+
+/* Leaves the flight recorder mode, keeping the current buffer so the next
+ * events are written to disk as usual. */
+static void
+ring_free(void)
+{
+	struct ovni_rring *ring = rthread.ring;
+
+	for (int i = 0; i < ring->nslots; i++) {
+		if (i != ring->cur)
+			free(ring->slots[i].buf);
+	}
+
+	rthread.evbuf = ring->slots[ring->cur].buf;
+
+	free(ring->slots);
+	free(ring);
+	rthread.ring = NULL;
+}
+
+/* Records a flush whose events must be emitted after the next user event. If
+ * there is one already pending, both are merged. */
+static void
+set_pending_flush(uint64_t t0, uint64_t t1)
+{
+	if (!rthread.flush_pending)
+		rthread.flush_t0 = t0;
+
+	rthread.flush_t1 = t1;
+	rthread.flush_pending = 1;
+}
+
+/* Dumps the flight recorder if a trigger has been requested since the last
+ * check. The flush events are left pending for the next user event. */
+static inline void
+ring_poll(void)
+{
+	if (likely(rthread.ring == NULL))
+		return;
+
+	if (rthread.ring->gen == atomic_load_explicit(&rproc.ring_gen, memory_order_relaxed))
+		return;
+
+	uint64_t t0 = ovni_clock_now();
+	ring_dump();
+	uint64_t t1 = ovni_clock_now();
+
+	set_pending_flush(t0, t1);
+}
+
+/* Calls fn for each entry of the filter, as a model or a model and category
+ * string */
+static void
+filter_foreach(void (*fn)(const char *mc, void *arg), void *arg)
+{
+	if (!rproc.filter_set)
+		return;
+
+	for (int m = 0; m < 256; m++) {
+		int ndisabled = 0;
+		for (int i = 0; i < 256 / 8; i++)
+			ndisabled += __builtin_popcount(rproc.filter[m][i]);
+
+		if (ndisabled == 0)
+			continue;
+
+		char mc[3] = { (char) m, '\0', '\0' };
+
+		/* The whole model is disabled */
+		if (ndisabled == 256) {
+			fn(mc, arg);
+			continue;
+		}
+
+		/* Otherwise list the categories, which are printable */
+		for (int c = '!'; c <= '~'; c++) {
+			if ((rproc.filter[m][c >> 3] & (1 << (c & 7))) == 0)
+				continue;
+
+			mc[1] = (char) c;
+			fn(mc, arg);
+		}
+	}
+}
+
+/* Metadata with parson, only used when there are user attributes */
+
+static void
+append_filter_json(const char *mc, void *arg)
+{
+	if (json_array_append_string(arg, mc) != 0)
+		die("json_array_append_string() failed");
+}
+
+/* Stores the list of disabled models and categories in the metadata, so the
+ * emulator knows which events are intentionally absent. */
+static void
+set_thread_filter(JSON_Object *meta)
+{
+	if (!rproc.filter_set)
+		return;
+
+	JSON_Value *value = json_value_init_array();
+	if (value == NULL)
+		die("json_value_init_array() failed");
+
+	JSON_Array *array = json_array(value);
+	if (array == NULL)
+		die("json_array() failed");
+
+	filter_foreach(append_filter_json, array);
+
+	if (json_object_dotset_value(meta, "ovni.filter", value) != 0)
+		die("json_object_dotset_value failed");
+}
+
+static void
+set_thread_rank(JSON_Object *meta)
+{
+	if (json_object_dotset_number(meta, "ovni.rank", rthread.rank) != 0)
+		die("json_object_set_number for rank failed");
+
+	if (json_object_dotset_number(meta, "ovni.nranks", rthread.nranks) != 0)
+		die("json_object_set_number for nranks failed");
+}
+
+static void
+set_thread_cpus(JSON_Object *meta)
+{
+	JSON_Value *value = json_value_init_array();
+	if (value == NULL)
+		die("json_value_init_array() failed");
+
+	JSON_Array *cpuarray = json_array(value);
+	if (cpuarray == NULL)
+		die("json_array() failed");
+
+	for (struct ovni_rcpu *c = rthread.cpus; c; c = c->next) {
+		JSON_Value *valcpu = json_value_init_object();
+		if (valcpu == NULL)
+			die("json_value_init_object() failed");
+
+		JSON_Object *cpu = json_object(valcpu);
+		if (cpu == NULL)
+			die("json_object() failed");
+
+		if (json_object_set_number(cpu, "index", c->index) != 0)
+			die("json_object_set_number() failed");
+
+		if (json_object_set_number(cpu, "phyid", c->phyid) != 0)
+			die("json_object_set_number() failed");
+
+		if (json_array_append_value(cpuarray, valcpu) != 0)
+			die("json_array_append_value() failed");
+	}
+
+	if (json_object_dotset_value(meta, "ovni.loom_cpus", value) != 0)
+		die("json_object_dotset_value failed");
+}
+
+static void
+set_thread_require(JSON_Object *meta, const struct ovni_rreq *req)
+{
+	char dotpath[128];
+	if (snprintf(dotpath, 128, "ovni.require.%s", req->model) >= 128)
+		die("model name too long");
+
+	if (json_object_dotset_string(meta, dotpath, req->version) != 0)
+		die("json_object_dotset_string failed");
+}
+
+static void
+set_thread_ring(JSON_Object *meta)
+{
+	if (json_object_dotset_number(meta, "ovni.ring.nbuffers", rthread.ring_nslots) != 0)
+		die("json_object_dotset_number failed");
+
+	if (json_object_dotset_number(meta, "ovni.ring.dropped", (double) rthread.ring_dropped) != 0)
+		die("json_object_dotset_number failed");
+}
+
+/* Sets the keys managed by libovni in the JSON metadata */
+static void
+thread_metadata_populate(JSON_Object *meta, int finished)
+{
+	if (json_object_dotset_number(meta, "version", OVNI_METADATA_VERSION) != 0)
+		die("json_object_dotset_string failed");
+
+	if (json_object_dotset_string(meta, "ovni.lib.version", OVNI_LIB_VERSION) != 0)
+		die("json_object_dotset_string failed");
+
+	if (json_object_dotset_string(meta, "ovni.lib.commit", OVNI_GIT_COMMIT) != 0)
+		die("json_object_dotset_string failed");
+
+	if (json_object_dotset_string(meta, "ovni.part", "thread") != 0)
+		die("json_object_dotset_string failed");
+
+	if (json_object_dotset_number(meta, "ovni.tid", (double) rthread.tid) != 0)
+		die("json_object_dotset_number failed");
+
+	if (json_object_dotset_number(meta, "ovni.pid", (double) rproc.pid) != 0)
+		die("json_object_dotset_number failed");
+
+	if (json_object_dotset_string(meta, "ovni.loom", rproc.loom) != 0)
+		die("json_object_dotset_string failed");
+
+	if (json_object_dotset_number(meta, "ovni.app_id", rproc.app) != 0)
+		die("json_object_dotset_number for ovni.app_id failed");
+
+	for (int i = 0; i < rthread.nreq; i++)
+		set_thread_require(meta, &rthread.req[i]);
+
+	set_thread_filter(meta);
+
+	if (rthread.rank_set)
+		set_thread_rank(meta);
+
+	/* It can happen there are no CPUs defined if there is another
+	 * process in the loom that defines them. */
+	if (rthread.cpus)
+		set_thread_cpus(meta);
+
+	if (rthread.ring_nslots > 0)
+		set_thread_ring(meta);
+
+	if (rproc.calib_emit_ns > 0.0
+			&& json_object_dotset_number(meta, "ovni.calib.emit_ns", rproc.calib_emit_ns) != 0)
+		die("json_object_dotset_number failed");
+
+	/* The emulator must know the context switches are unpaired */
+	if (rthread.perf != NULL && rthread.perf->lost > 0
+			&& json_object_dotset_number(meta, "ovni.perf.lost", (double) rthread.perf->lost) != 0)
+		die("json_object_dotset_number failed");
+
+	/* Mark it finished so we can detect partial streams */
+	if (finished && json_object_dotset_number(meta, "ovni.finished", 1) != 0)
+		die("json_object_dotset_string failed");
+}
+
+/* Creates the JSON metadata if not created yet */
+static JSON_Object *
+thread_metadata_json(void)
+{
+	if (rthread.meta == NULL) {
+		rthread.meta = json_value_init_object();
+
+		if (rthread.meta == NULL)
+			die("failed to create metadata JSON object");
+
+		JSON_Object *meta = json_value_get_object(rthread.meta);
+
+		if (meta == NULL)
+			die("json_value_get_object failed");
+
+		thread_metadata_populate(meta, 0);
+	}
+
+	JSON_Object *meta = json_value_get_object(rthread.meta);
+
+	if (meta == NULL)
+		die("json_value_get_object failed");
+
+	return meta;
+}
+
+/* Compact metadata writer, without parson */
+
+struct strbuf {
+	char *buf;
+	size_t len;
+	size_t cap;
+};
+
+static void sb_printf(struct strbuf *sb, const char *fmt, ...)
+		__attribute__((format(printf, 2, 3)));
+
+static void
+sb_printf(struct strbuf *sb, const char *fmt, ...)
+{
+	while (1) {
+		va_list ap;
+		va_start(ap, fmt);
+		int n = vsnprintf(sb->buf + sb->len, sb->cap - sb->len, fmt, ap);
+		va_end(ap);
+
+		if (n < 0)
+			die("vsnprintf failed");
+
+		if (sb->len + (size_t) n < sb->cap) {
+			sb->len += (size_t) n;
+			return;
+		}
+
+		sb->cap = 2 * sb->cap + (size_t) n;
+		sb->buf = realloc(sb->buf, sb->cap);
+		if (sb->buf == NULL)
+			die("realloc failed:");
+	}
+}
+
+/* Appends the string s quoted and escaped as a JSON string */
+static void
+sb_str(struct strbuf *sb, const char *s)
+{
+	sb_printf(sb, "\"");
+	for (const char *p = s; *p; p++) {
+		unsigned char c = (unsigned char) *p;
+		if (c == '"' || c == '\\')
+			sb_printf(sb, "\\%c", c);
+		else if (c < 0x20)
+			sb_printf(sb, "\\u%04x", c);
+		else
+			sb_printf(sb, "%c", c);
+	}
+	sb_printf(sb, "\"");
+}
+
 static void
-flush_evbuf(void)
+append_filter_sb(const char *mc, void *arg)
 {
-	write_evbuf(rthread.evbuf, rthread.evlen);
-
-	rthread.evlen = 0;
+	struct strbuf *sb = arg;
+
+	/* Remove the last ']' to append the entry */
+	int first = (sb->buf[sb->len - 2] == '[');
+	sb->len--;
+	sb_printf(sb, "%s", first ? "" : ",");
+	sb_str(sb, mc);
+	sb_printf(sb, "]");
 }
 
+/* Writes the same keys as thread_metadata_populate() */
 static void
-write_stream_header(void)
+thread_metadata_compact(struct strbuf *sb, int finished)
 {
-	struct ovni_stream_header *h =
-			(struct ovni_stream_header *) rthread.evbuf;
+	sb_printf(sb, "{\"version\":%d,\"ovni\":{", OVNI_METADATA_VERSION);
+	sb_printf(sb, "\"lib\":{\"version\":");
+	sb_str(sb, OVNI_LIB_VERSION);
+	sb_printf(sb, ",\"commit\":");
+	sb_str(sb, OVNI_GIT_COMMIT);
+	sb_printf(sb, "},\"part\":\"thread\",\"tid\":%d,\"pid\":%d,\"loom\":",
+			(int) rthread.tid, rproc.pid);
+	sb_str(sb, rproc.loom);
+	sb_printf(sb, ",\"app_id\":%d", rproc.app);
+
+	if (rthread.nreq > 0) {
+		sb_printf(sb, ",\"require\":{");
+		for (int i = 0; i < rthread.nreq; i++) {
+			sb_printf(sb, "%s", i == 0 ? "" : ",");
+			sb_str(sb, rthread.req[i].model);
+			sb_printf(sb, ":");
+			sb_str(sb, rthread.req[i].version);
+		}
+		sb_printf(sb, "}");
+	}
 
-	memcpy(h->magic, OVNI_STREAM_MAGIC, 4);
-	h->version = OVNI_STREAM_VERSION;
+	if (rproc.filter_set) {
+		sb_printf(sb, ",\"filter\":[]");
+		filter_foreach(append_filter_sb, sb);
+	}
 
-	rthread.evlen = sizeof(struct ovni_stream_header);
-	flush_evbuf();
+	if (rthread.rank_set) {
+		sb_printf(sb, ",\"rank\":%d,\"nranks\":%d",
+				rthread.rank, rthread.nranks);
+	}
+
+	if (rthread.cpus) {
+		sb_printf(sb, ",\"loom_cpus\":[");
+		for (struct ovni_rcpu *c = rthread.cpus; c; c = c->next) {
+			sb_printf(sb, "%s{\"index\":%d,\"phyid\":%d}",
+					c == rthread.cpus ? "" : ",",
+					c->index, c->phyid);
+		}
+		sb_printf(sb, "]");
+	}
+
+	if (rthread.ring_nslots > 0) {
+		sb_printf(sb, ",\"ring\":{\"nbuffers\":%d,\"dropped\":%" PRIu64 "}",
+				rthread.ring_nslots, rthread.ring_dropped);
+	}
+
+	if (rproc.calib_emit_ns > 0.0)
+		sb_printf(sb, ",\"calib\":{\"emit_ns\":%.3f}", rproc.calib_emit_ns);
+
+	if (rthread.perf != NULL && rthread.perf->lost > 0)
+		sb_printf(sb, ",\"perf\":{\"lost\":%" PRIu64 "}", rthread.perf->lost);
+
+	if (finished)
+		sb_printf(sb, ",\"finished\":1");
+
+	sb_printf(sb, "}}\n");
 }
 
 static void
-thread_metadata_store(void)
+thread_metadata_store(int finished)
 {
+	/* The last metadata chunk of each thread is the one used */
+	if (rproc.container) {
+		if (rthread.meta != NULL) {
+			thread_metadata_populate(thread_metadata_json(), finished);
+
+			char *str = json_serialize_to_string_pretty(rthread.meta);
+			if (str == NULL)
+				die("failed to serialize thread metadata");
+
+			container_write(OVNI_CHUNK_METADATA, (uint8_t *) str, strlen(str));
+			json_free_serialized_string(str);
+		} else {
+			struct strbuf sb = {0};
+			thread_metadata_compact(&sb, finished);
+			container_write(OVNI_CHUNK_METADATA, (uint8_t *) sb.buf, sb.len);
+			free(sb.buf);
+		}
+
+		return;
+	}
+
 	char path[PATH_MAX];
-	int written = snprintf(path, PATH_MAX, "%s/thread.%d/stream.json",
-			rproc.procdir, rthread.tid);
+	int written = snprintf(path, PATH_MAX, "%s/stream.json", rthread.thdir);
 
 	if (written >= PATH_MAX)
-		die("thread trace path too long: %s/thread.%d/stream.json",
-				rproc.procdir, rthread.tid);
+		die("thread trace path too long: %s/stream.json", rthread.thdir);
+
+	/* Use parson only when the user has set any attribute */
+	if (rthread.meta != NULL) {
+		thread_metadata_populate(thread_metadata_json(), finished);
+
+		if (json_serialize_to_file_pretty(rthread.meta, path) != JSONSuccess)
+			die("failed to write thread metadata");
+
+		return;
+	}
+
+	struct strbuf sb = {0};
+	thread_metadata_compact(&sb, finished);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die("open %s failed:", path);
+
+	write_fd(fd, (uint8_t *) sb.buf, sb.len);
+
+	if (close(fd) != 0)
+		die("close %s failed:", path);
 
-	if (json_serialize_to_file_pretty(rthread.meta, path) != JSONSuccess)
-		die("failed to write thread metadata");
+	free(sb.buf);
 }
 
 void
@@ -467,65 +2155,33 @@ ovni_thread_require(const char *model, const char *version)
 	if (version_parse(version, parsedver) != 0)
 		die("failed to parse provided version \"%s\"", version);
 
-	/* Store into metadata */
-	JSON_Object *meta = json_value_get_object(rthread.meta);
-
-	if (meta == NULL)
-		die("json_value_get_object failed");
-
-	char dotpath[128];
-	if (snprintf(dotpath, 128, "ovni.require.%s", model) >= 128)
-		die("model name too long");
-
-	if (json_object_dotset_string(meta, dotpath, version) != 0)
-		die("json_object_dotset_string failed");
-}
-
-static void
-thread_metadata_populate(void)
-{
-	JSON_Object *meta = json_value_get_object(rthread.meta);
-
-	if (meta == NULL)
-		die("json_value_get_object failed");
-
-	if (json_object_dotset_number(meta, "version", OVNI_METADATA_VERSION) != 0)
-		die("json_object_dotset_string failed");
-
-	if (json_object_dotset_string(meta, "ovni.lib.version", OVNI_LIB_VERSION) != 0)
-		die("json_object_dotset_string failed");
-
-	if (json_object_dotset_string(meta, "ovni.lib.commit", OVNI_GIT_COMMIT) != 0)
-		die("json_object_dotset_string failed");
-
-	if (json_object_dotset_string(meta, "ovni.part", "thread") != 0)
-		die("json_object_dotset_string failed");
-
-	if (json_object_dotset_number(meta, "ovni.tid", (double) rthread.tid) != 0)
-		die("json_object_dotset_number failed");
-
-	if (json_object_dotset_number(meta, "ovni.pid", (double) rproc.pid) != 0)
-		die("json_object_dotset_number failed");
-
-	if (json_object_dotset_string(meta, "ovni.loom", rproc.loom) != 0)
-		die("json_object_dotset_string failed");
+	/* Replace the version if already required */
+	struct ovni_rreq *req = NULL;
+	for (int i = 0; i < rthread.nreq; i++) {
+		if (strcmp(rthread.req[i].model, model) == 0) {
+			req = &rthread.req[i];
+			break;
+		}
+	}
 
-	if (json_object_dotset_number(meta, "ovni.app_id", rproc.app) != 0)
-		die("json_object_dotset_number for ovni.app_id failed");
-}
+	if (req == NULL) {
+		if (rthread.nreq >= MAX_REQUIRE)
+			die("too many required models");
 
-static void
-thread_metadata_init(void)
-{
-	rthread.meta = json_value_init_object();
+		req = &rthread.req[rthread.nreq++];
 
-	if (rthread.meta == NULL)
-		die("failed to create metadata JSON object");
+		if (snprintf(req->model, sizeof(req->model), "%s", model)
+				>= (int) sizeof(req->model))
+			die("model name too long");
+	}
 
-	thread_metadata_populate();
+	if (snprintf(req->version, sizeof(req->version), "%s", version)
+			>= (int) sizeof(req->version))
+		die("version string too long");
 
-	/* Store initial metadata on disk, to detect broken streams */
-	thread_metadata_store();
+	/* Keep the JSON metadata updated if already in use */
+	if (rthread.meta != NULL)
+		set_thread_require(thread_metadata_json(), req);
 }
 
 void
@@ -554,59 +2210,31 @@ ovni_thread_init(pid_t tid)
 	if (rthread.evbuf == NULL)
 		die("malloc failed:");
 
-	create_thread_dir(tid);
-	create_trace_stream();
-	write_stream_header();
-
-	thread_metadata_init();
-
-	rthread.ready = 1;
-
-	ovni_thread_require("ovni", OVNI_MODEL_VERSION);
-}
-
-static void
-set_thread_rank(JSON_Object *meta)
-{
-	if (json_object_dotset_number(meta, "ovni.rank", rthread.rank) != 0)
-		die("json_object_set_number for rank failed");
+	rthread.streamfd = -1;
 
-	if (json_object_dotset_number(meta, "ovni.nranks", rthread.nranks) != 0)
-		die("json_object_set_number for nranks failed");
-}
+	/* The stream file is created on the first flush */
+	if (!rproc.container)
+		mkdir_thread(rthread.thdir, rproc.procdir, tid);
 
-static void
-set_thread_cpus(JSON_Object *meta)
-{
-	JSON_Value *value = json_value_init_array();
-	if (value == NULL)
-		die("json_value_init_array() failed");
+	/* Store initial metadata on disk, to detect broken streams */
+	thread_metadata_store(0);
 
-	JSON_Array *cpuarray = json_array(value);
-	if (cpuarray == NULL)
-		die("json_array() failed");
+	if (!rproc.container)
+		manifest_thread(tid, 0, 0);
 
-	for (struct ovni_rcpu *c = rthread.cpus; c; c = c->next) {
-		JSON_Value *valcpu = json_value_init_object();
-		if (valcpu == NULL)
-			die("json_value_init_object() failed");
+	if (rproc.ring_nslots > 0)
+		ring_init(rproc.ring_nslots);
 
-		JSON_Object *cpu = json_object(valcpu);
-		if (cpu == NULL)
-			die("json_object() failed");
+	rthread.ready = 1;
 
-		if (json_object_set_number(cpu, "index", c->index) != 0)
-			die("json_object_set_number() failed");
+	ovni_thread_require("ovni", OVNI_MODEL_VERSION);
 
-		if (json_object_set_number(cpu, "phyid", c->phyid) != 0)
-			die("json_object_set_number() failed");
+	if (rproc.perf_switch) {
+		perf_init();
 
-		if (json_array_append_value(cpuarray, valcpu) != 0)
-			die("json_array_append_value() failed");
+		if (rthread.perf != NULL)
+			ovni_thread_require("kernel", "1.0.0");
 	}
-
-	if (json_object_dotset_value(meta, "ovni.loom_cpus", value) != 0)
-		die("json_object_dotset_value failed");
 }
 
 void
@@ -618,35 +2246,55 @@ ovni_thread_free(void)
 	if (!rthread.ready)
 		die("thread not initialized");
 
-	JSON_Object *meta = json_value_get_object(rthread.meta);
+	/* Write the flight recorder buffers before the thread ends */
+	if (rthread.ring != NULL) {
+		ring_dump();
+		ring_free();
+	}
 
-	if (meta == NULL)
-		die("json_value_get_object failed");
+	if (rproc.container) {
+		thread_metadata_store(1);
+		free(rthread.evbuf);
+		rthread.evbuf = NULL;
 
-	if (rthread.rank_set)
-		set_thread_rank(meta);
+		if (rthread.perf != NULL)
+			perf_free();
 
-	/* It can happen there are no CPUs defined if there is another
-	 * process in the loom that defines them. */
-	if (rthread.cpus)
-		set_thread_cpus(meta);
+		rthread.finished = 1;
+		rthread.ready = 0;
+		return;
+	}
 
-	/* Mark it finished so we can detect partial streams */
-	if (json_object_dotset_number(meta, "ovni.finished", 1) != 0)
-		die("json_object_dotset_string failed");
+	/* Ensure the stream file exists even if it has no events */
+	if (rthread.streamfd == -1)
+		create_trace_stream();
+
+	thread_metadata_store(1);
 
-	thread_metadata_store();
+	off_t size = lseek(rthread.streamfd, 0, SEEK_END);
+	if (size < 0)
+		die("lseek failed:");
+
+	manifest_thread(rthread.tid, (uint64_t) size, 1);
 
 	free(rthread.evbuf);
 	rthread.evbuf = NULL;
 
+	if (rthread.perf != NULL)
+		perf_free();
+
 	close(rthread.streamfd);
 	rthread.streamfd = -1;
 
 	if (rproc.move_to_final) {
-		/* The dir rthread.thdir_final must exist in the FS */
-		move_thdir_to_final(rthread.thdir, rthread.thdir_final);
-		try_clean_dir(rthread.thdir);
+		if (snprintf(rthread.thdir_final, PATH_MAX, "%s/thread.%d",
+					rproc.procdir_final, rthread.tid) >= PATH_MAX) {
+			die("path too long: %s/thread.%d",
+					rproc.procdir_final, rthread.tid);
+		}
+
+		if (move_thread_defer(rthread.thdir, rthread.thdir_final) != 0)
+			move_thread(rthread.thdir, rthread.thdir_final);
 	}
 
 	rthread.finished = 1;
@@ -780,10 +2428,16 @@ ovni_flush(void)
 	if (atomic_load(&rproc.st) != ST_READY)
 		die("process not ready");
 
+	if (rthread.reserved)
+		die("cannot flush with a reserved event");
+
 	ovni_ev_set_clock(&pre, ovni_clock_now());
 	ovni_ev_set_mcv(&pre, "OF[");
 
-	flush_evbuf();
+	if (rthread.ring != NULL)
+		ring_dump();
+	else
+		flush_evbuf();
 
 	ovni_ev_set_clock(&post, ovni_clock_now());
 	ovni_ev_set_mcv(&post, "OF]");
@@ -809,48 +2463,152 @@ add_flush_events(uint64_t t0, uint64_t t1)
 	ovni_ev_add(&post);
 }
 
-static void
-ovni_ev_add_jumbo(struct ovni_ev *ev, const uint8_t *buf, uint32_t bufsize)
+/* Adds the flush events recorded with set_pending_flush(), if any */
+static inline void
+add_pending_flush(void)
+{
+	if (likely(!rthread.flush_pending))
+		return;
+
+	rthread.flush_pending = 0;
+	add_flush_events(rthread.flush_t0, rthread.flush_t1);
+}
+
+/* Ensures there is room for size bytes in the event buffer, flushing it
+ * otherwise. Returns 1 if the buffer was flushed, storing the flush times in t0
+ * and t1, or 0 if not. */
+static int
+make_room(size_t size, uint64_t *t0, uint64_t *t1)
+{
+	if (size >= OVNI_MAX_EV_BUF)
+		die("event too large");
+
+	if (rthread.evlen + size < OVNI_MAX_EV_BUF)
+		return 0;
+
+	/* Not a real flush, so don't emit flush events */
+	if (rthread.ring != NULL) {
+		ring_rotate();
+		return 0;
+	}
+
+	/* Measure the flush times */
+	*t0 = ovni_clock_now();
+	flush_evbuf();
+	*t1 = ovni_clock_now();
+
+	return 1;
+}
+
+/**
+ * Reserves room for an event of the given size directly in the thread buffer.
+ *
+ * @param size The total size in bytes of the event, including the header.
+ *
+ * @return A pointer inside the thread buffer where the event must be written
+ * before calling ovni_ev_commit(). The buffer is flushed first if the event
+ * doesn't fit. No other event can be emitted until the commit.
+ *
+ * The clock of the event must be read before calling it, as the flush events
+ * are written after the committed event.
+ */
+void *
+ovni_ev_reserve(size_t size)
 {
 	if (!rthread.ready)
 		die("thread is not initialized");
 
-	int flushed = 0;
+	if (rthread.reserved)
+		die("previous reserved event not committed");
+
+	if (size < sizeof(struct ovni_ev_header))
+		die("event size %zu too small", size);
+
+	ring_poll();
+
 	uint64_t t0, t1;
+	if (make_room(size, &t0, &t1))
+		set_pending_flush(t0, t1);
 
+	rthread.reserved = size;
+
+	return &rthread.evbuf[rthread.evlen];
+}
+
+/**
+ * Reserves a jumbo event with a payload of bufsize bytes in the thread buffer.
+ *
+ * @param ev The event header, with an empty payload. It is copied into the
+ * thread buffer, so it can be reused on return.
+ * @param bufsize The size of the jumbo payload in bytes.
+ *
+ * @return A pointer to the jumbo payload inside the thread buffer, where the
+ * caller must serialize bufsize bytes before calling ovni_ev_commit().
+ */
+uint8_t *
+ovni_ev_jumbo_reserve(struct ovni_ev *ev, uint32_t bufsize)
+{
 	if (ovni_payload_size(ev) != 0)
 		die("the event payload must be empty");
 
 	ovni_payload_add(ev, (uint8_t *) &bufsize, sizeof(bufsize));
 	size_t evsize = (size_t) ovni_ev_size(ev);
 
-	size_t totalsize = evsize + bufsize;
-
-	if (totalsize >= OVNI_MAX_EV_BUF)
-		die("event too large");
-
-	/* Check if the event fits or flush first otherwise */
-	if (rthread.evlen + totalsize >= OVNI_MAX_EV_BUF) {
-		/* Measure the flush times */
-		t0 = ovni_clock_now();
-		flush_evbuf();
-		t1 = ovni_clock_now();
-		flushed = 1;
-	}
+	uint8_t *dst = ovni_ev_reserve(evsize + bufsize);
 
 	/* Set the jumbo flag here, so we capture the previous evsize
 	 * properly, ignoring the jumbo buffer */
 	ev->header.flags |= OVNI_EV_JUMBO;
 
-	memcpy(&rthread.evbuf[rthread.evlen], ev, evsize);
-	rthread.evlen += evsize;
-	memcpy(&rthread.evbuf[rthread.evlen], buf, bufsize);
-	rthread.evlen += bufsize;
+	memcpy(dst, ev, evsize);
+
+	return dst + evsize;
+}
+
+/**
+ * Commits the event written in the region returned by the last reserve. The
+ * size of the written event must match the reserved size.
+ */
+void
+ovni_ev_commit(void)
+{
+	if (!rthread.ready)
+		die("thread is not initialized");
+
+	if (rthread.reserved == 0)
+		die("no event reserved");
 
-	if (flushed) {
-		/* Emit the flush events *after* the user event */
-		add_flush_events(t0, t1);
+	struct ovni_ev *ev = (struct ovni_ev *) &rthread.evbuf[rthread.evlen];
+	size_t size = (size_t) ovni_ev_size(ev);
+
+	if (size != rthread.reserved)
+		die("committed event size %zu differs from reserved size %zu",
+				size, rthread.reserved);
+
+	/* The flush events go after the event, so it cannot be later */
+	if (unlikely(rthread.flush_pending && ev->header.clock > rthread.flush_t0))
+		die("the clock of a reserved event must be read before ovni_ev_reserve()");
+
+	/* Discard the event if filtered, by not advancing evlen */
+	if (likely(!is_filtered(ev))) {
+		if (unlikely(rthread.ring != NULL))
+			ring_track(ev);
+
+		rthread.evlen += size;
 	}
+
+	rthread.reserved = 0;
+
+	/* Emit the flush events *after* the user event */
+	add_pending_flush();
+}
+
+static void
+ovni_ev_add_jumbo(struct ovni_ev *ev, const uint8_t *buf, uint32_t bufsize)
+{
+	uint8_t *dst = ovni_ev_jumbo_reserve(ev, bufsize);
+	memcpy(dst, buf, bufsize);
+	ovni_ev_commit();
 }
 
 static void
@@ -859,41 +2617,105 @@ ovni_ev_add(struct ovni_ev *ev)
 	if (!rthread.ready)
 		die("thread is not initialized");
 
-	int flushed = 0;
-	uint64_t t0, t1;
+	if (rthread.reserved)
+		die("cannot emit with a reserved event");
 
+	uint64_t t0, t1;
 	size_t size = (size_t) ovni_ev_size(ev);
 
 	/* Check if the event fits or flush first otherwise */
-	if (rthread.evlen + size >= OVNI_MAX_EV_BUF) {
-		/* Measure the flush times */
-		t0 = ovni_clock_now();
-		flush_evbuf();
-		t1 = ovni_clock_now();
-		flushed = 1;
-	}
+	if (make_room(size, &t0, &t1))
+		set_pending_flush(t0, t1);
+
+	if (unlikely(rthread.ring != NULL))
+		ring_track(ev);
 
 	memcpy(&rthread.evbuf[rthread.evlen], ev, size);
 	rthread.evlen += size;
 
-	if (flushed) {
-		/* Emit the flush events *after* the user event */
-		add_flush_events(t0, t1);
-	}
+	/* Emit the flush events *after* the user event */
+	add_pending_flush();
 }
 
 void
 ovni_ev_jumbo_emit(struct ovni_ev *ev, const uint8_t *buf, uint32_t bufsize)
 {
+	if (unlikely(is_filtered(ev)))
+		return;
+
+	ring_poll();
 	ovni_ev_add_jumbo(ev, buf, bufsize);
 }
 
 void
 ovni_ev_emit(struct ovni_ev *ev)
 {
+	if (unlikely(is_filtered(ev)))
+		return;
+
+	ring_poll();
 	ovni_ev_add(ev);
 }
 
+/**
+ * Emits a group of n non-jumbo events with a single clock read.
+ *
+ * @param evs The array of events, in emission order. The clock of all of them
+ * is set to the same value.
+ * @param n The number of events in the array.
+ *
+ * The events are written contiguously, so a flush never falls in between.
+ */
+void
+ovni_ev_emit_many(struct ovni_ev *evs, size_t n)
+{
+	if (!rthread.ready)
+		die("thread is not initialized");
+
+	if (rthread.reserved)
+		die("cannot emit with a reserved event");
+
+	ring_poll();
+
+	size_t total = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (evs[i].header.flags & OVNI_EV_JUMBO)
+			die("cannot emit jumbo events in a group");
+
+		if (unlikely(is_filtered(&evs[i])))
+			continue;
+
+		total += (size_t) ovni_ev_size(&evs[i]);
+	}
+
+	/* Read the clock before a flush, so the flush events that follow
+	 * the group are not earlier than it */
+	uint64_t clock = ovni_clock_now();
+
+	uint64_t t0, t1;
+	if (make_room(total, &t0, &t1))
+		set_pending_flush(t0, t1);
+
+	for (size_t i = 0; i < n; i++) {
+		struct ovni_ev *ev = &evs[i];
+		size_t size = (size_t) ovni_ev_size(ev);
+
+		ovni_ev_set_clock(ev, clock);
+
+		if (unlikely(is_filtered(ev)))
+			continue;
+
+		if (unlikely(rthread.ring != NULL))
+			ring_track(ev);
+
+		memcpy(&rthread.evbuf[rthread.evlen], ev, size);
+		rthread.evlen += size;
+	}
+
+	/* Emit the flush events *after* the user events */
+	add_pending_flush();
+}
+
 /* Attributes */
 
 static JSON_Object *
@@ -905,12 +2727,7 @@ get_thread_metadata(void)
 	if (!rthread.ready)
 		die("thread not initialized");
 
-	JSON_Object *meta = json_value_get_object(rthread.meta);
-
-	if (meta == NULL)
-		die("json_value_get_object failed");
-
-	return meta;
+	return thread_metadata_json();
 }
 
 /**
@@ -1104,7 +2921,7 @@ ovni_attr_flush(void)
 	if (!rthread.ready)
 		die("thread not initialized");
 
-	thread_metadata_store();
+	thread_metadata_store(0);
 }
 
 /* Mark API */
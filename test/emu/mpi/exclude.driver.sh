@@ -0,0 +1,18 @@
+# The MPI events of a thread that ends with a stacked function are discarded
+# when the MPI model is excluded, so the emulation doesn't fail.
+$OVNI_TEST_BIN
+ovniemu -l -M nosv ovni 2>&1 | tee emu.log
+grep -q "dropped [0-9]* events of excluded models" emu.log
+
+# Without the configurations and PRV types of the MPI model
+test -d ovni/cfg/thread/ovni
+test '!' -e ovni/cfg/thread/mpi
+test '!' -e ovni/cfg/cpu/mpi
+if grep -q "MPI" ovni/thread.pcf; then
+  exit 1
+fi
+
+# Unknown models are rejected
+if ovniemu -M foo ovni; then
+  exit 1
+fi
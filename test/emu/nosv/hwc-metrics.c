@@ -0,0 +1,53 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "compat.h"
+#include "instr.h"
+#include "instr_nosv.h"
+
+/* Runs tasks of two types with known counters, so the derived metrics
+ * can be checked by the driver */
+int
+main(void)
+{
+	instr_start(0, 1);
+	instr_nosv_init();
+
+	enum hwc { PAPI_TOT_INS = 0, PAPI_TOT_CYC = 1, MAX_HWC };
+	int64_t hwc[MAX_HWC] = { 0 };
+
+	ovni_attr_set_str("nosv.hwc.0.name", "PAPI_TOT_INS");
+	ovni_attr_set_str("nosv.hwc.1.name", "PAPI_TOT_CYC");
+
+	instr_nosv_type_create(1);
+	instr_nosv_type_create(2);
+
+	/* First read, outside of tasks, with an unknown interval that
+	 * must be left out of the totals */
+	hwc[PAPI_TOT_INS] = 777;
+	hwc[PAPI_TOT_CYC] = 777;
+	instr_nosv_hwc(MAX_HWC, hwc);
+
+	for (uint32_t i = 1; i <= 10; i++) {
+		uint32_t type = 1 + i % 2;
+		instr_nosv_task_create(i, type);
+		instr_nosv_task_execute(i, 0);
+		sleep_us(100);
+
+		/* Type 1 has IPC 2 and type 2 has IPC 0.5 */
+		hwc[PAPI_TOT_INS] = type == 1 ? 2000 : 1000;
+		hwc[PAPI_TOT_CYC] = type == 1 ? 1000 : 2000;
+		instr_nosv_hwc(MAX_HWC, hwc);
+
+		instr_nosv_task_end(i, 0);
+
+		/* The runtime in between */
+		hwc[PAPI_TOT_INS] = 10;
+		hwc[PAPI_TOT_CYC] = 100;
+		instr_nosv_hwc(MAX_HWC, hwc);
+	}
+
+	instr_end();
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+# The derived metrics must be computed per read and per task type
+$OVNI_TEST_BIN
+
+ovniemu -l ovni
+
+# IPC_x1000 is the first metric (type 300), with the value of each read
+grep -q ':300:2000$' ovni/thread.prv
+grep -q ':300:500$' ovni/thread.prv
+grep -q ':300:100$' ovni/thread.prv
+
+# Five bodies of each type
+cat ovni/nosv-hwc.csv
+grep -q '^type,[0-9]*,"testtype1",[0-9]*,10000,5000,2000.000$' ovni/nosv-hwc.csv
+grep -q '^type,[0-9]*,"testtype2",[0-9]*,5000,10000,500.000$' ovni/nosv-hwc.csv
+grep -q '^notask,,"",[0-9]*,100,1000,100.000$' ovni/nosv-hwc.csv
+
+# Same totals in the CPU
+grep -q '^cpu,0,"[^"]*",[0-9]*,15100,16000,' ovni/nosv-hwc.csv
+
+test -e ovni/cfg/thread/nosv/hwc-IPC_x1000.cfg
+
+# Custom metrics replace the default ones
+rm -rf ovni/*.prv ovni/*.pcf ovni/*.row ovni/cfg
+ovniemu -H 'CPI=PAPI_TOT_CYC/PAPI_TOT_INS*1000;INS_per_us=PAPI_TOT_INS/ns*1000' ovni
+head -1 ovni/nosv-hwc.csv | grep -q ',"CPI","INS_per_us"$'
+grep -q ':301:' ovni/thread.prv
+grep -q ':300:500$' ovni/thread.prv
+
+# Unknown counters are rejected
+if ovniemu -H 'X=PAPI_FOO/PAPI_TOT_INS' ovni; then
+  exit 1
+fi
@@ -0,0 +1,100 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "compat.h"
+#include "instr.h"
+#include "instr_nosv.h"
+
+/* Run nOS-V tasks in flight recorder mode, filling the ring so the creation
+ * of the first tasks and their types are lost, as well as some subsystem
+ * events before and after a trigger. The emulator must ignore the events of
+ * the unknown tasks and the unmatched pops. */
+
+static uint8_t *buf;
+static size_t size;
+
+static void
+emit_jumbo(void)
+{
+	struct ovni_ev ev = {0};
+	ovni_ev_set_mcv(&ev, "OB.");
+	ovni_ev_set_clock(&ev, (uint64_t) get_clock());
+	ovni_ev_jumbo_emit(&ev, buf, (uint32_t) size);
+}
+
+/* Overwrites all the buffers of the ring, pausing the thread in between */
+static void
+fill_ring(void)
+{
+	for (int i = 0; i < 8; i++) {
+		emit_jumbo();
+		if (i % 3 == 0) {
+			instr_thread_pause();
+			emit_jumbo();
+			instr_thread_resume();
+		}
+	}
+}
+
+int
+main(void)
+{
+	instr_start(0, 1);
+	instr_nosv_init();
+
+	size = (size_t) (0.3 * (double) OVNI_MAX_EV_BUF);
+	buf = calloc(1, size);
+	if (buf == NULL)
+		die("calloc failed:");
+
+	int ntasks = 10;
+	uint32_t typeid = 1;
+	instr_nosv_type_create((int32_t) typeid);
+
+	for (int id = 1; id <= ntasks; id++)
+		instr_nosv_task_create((uint32_t) id, typeid);
+
+	/* Leave the first task running inside the submit subsystem */
+	instr_nosv_task_execute(1, 0);
+	instr_nosv_submit_enter();
+
+	fill_ring();
+
+	/* Unknown task and pop from an empty stack */
+	instr_nosv_submit_exit();
+	instr_nosv_task_end(1, 0);
+
+	/* The type was lost, so the task is ignored */
+	instr_nosv_task_create((uint32_t) ntasks + 1, typeid);
+	instr_nosv_task_execute((uint32_t) ntasks + 1, 0);
+	instr_nosv_task_end((uint32_t) ntasks + 1, 0);
+
+	/* A new type is known */
+	uint32_t typeid2 = 2;
+	instr_nosv_type_create((int32_t) typeid2);
+	instr_nosv_task_create((uint32_t) ntasks + 2, typeid2);
+	instr_nosv_task_execute((uint32_t) ntasks + 2, 0);
+	instr_nosv_task_end((uint32_t) ntasks + 2, 0);
+
+	instr_nosv_submit_enter();
+	ovni_ring_trigger();
+
+	/* The ring is filled again after the dump, so the pop of the
+	 * attach pushed in the lost events is not in the stack */
+	instr_nosv_submit_exit();
+	instr_nosv_attach_enter();
+	fill_ring();
+	instr_nosv_attach_exit();
+
+	instr_nosv_task_create((uint32_t) ntasks + 3, typeid2);
+	instr_nosv_task_execute((uint32_t) ntasks + 3, 0);
+	instr_nosv_task_end((uint32_t) ntasks + 3, 0);
+
+	free(buf);
+
+	instr_end();
+
+	return 0;
+}
@@ -0,0 +1,14 @@
+# The compressed PRV files must hold the same content as the plain ones,
+# including the header with the final duration.
+$OVNI_TEST_BIN
+
+ovniemu -l ovni
+mv ovni/thread.prv thread.prv
+mv ovni/cpu.prv cpu.prv
+
+rm -rf ovni/cfg
+ovniemu -l -z 2 ovni
+test ! -e ovni/thread.prv
+gzip -t ovni/thread.prv.gz
+zcat ovni/thread.prv.gz | cmp - thread.prv
+zcat ovni/cpu.prv.gz | cmp - cpu.prv
@@ -0,0 +1,22 @@
+target=$OVNI_TEST_BIN
+
+# The container and its chunk table are moved out of OVNI_TMPDIR, and the
+# threads don't have their own directories.
+
+export OVNI_CONTAINER=1
+mkdir tmp
+export OVNI_TMPDIR=tmp
+$target
+
+procdir=$(echo ovni/loom.*/proc.*)
+test -e "$procdir/container.obs"
+test -e "$procdir/container.idx"
+test '!' -e "$procdir/thread.$$"
+test -z "$(find tmp -type f)"
+
+ovniemu ovni
+
+# The sorter cannot rewrite the streams inside the container
+if ovnisort ovni; then
+  exit 1
+fi
@@ -0,0 +1,76 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include <pthread.h>
+#include <stdint.h>
+#include "compat.h"
+#include "instr.h"
+#include "ovni.h"
+
+/* Several threads write their events to the process container at the same
+ * time, with many flushes, so the chunks of the threads are interleaved */
+
+#define NTHREADS 4
+#define NEVENTS 2000
+
+static void
+emit(const char *mcv, int32_t cpu)
+{
+	struct ovni_ev ev = {0};
+	ovni_ev_set_mcv(&ev, mcv);
+	ovni_ev_set_clock(&ev, ovni_clock_now());
+
+	if (mcv[2] == 'x') {
+		int32_t creator = -1;
+		uint64_t tag = 0;
+		ovni_payload_add(&ev, (uint8_t *) &cpu, sizeof(cpu));
+		ovni_payload_add(&ev, (uint8_t *) &creator, sizeof(creator));
+		ovni_payload_add(&ev, (uint8_t *) &tag, sizeof(tag));
+	}
+
+	ovni_ev_emit(&ev);
+}
+
+static void *
+worker(void *arg)
+{
+	int32_t cpu = (int32_t) (intptr_t) arg;
+
+	ovni_thread_init(get_tid());
+	emit("OHx", cpu);
+
+	for (int i = 0; i < NEVENTS; i++) {
+		emit("OHp", cpu);
+		emit("OHr", cpu);
+
+		if (i % 100 == 0)
+			ovni_flush();
+	}
+
+	emit("OHe", cpu);
+	ovni_flush();
+	ovni_thread_free();
+
+	return NULL;
+}
+
+int
+main(void)
+{
+	instr_start(0, NTHREADS + 1);
+
+	pthread_t th[NTHREADS];
+	for (int i = 0; i < NTHREADS; i++) {
+		if (pthread_create(&th[i], NULL, worker, (void *) (intptr_t) (i + 1)) != 0)
+			die("pthread_create failed");
+	}
+
+	for (int i = 0; i < NTHREADS; i++) {
+		if (pthread_join(th[i], NULL) != 0)
+			die("pthread_join failed");
+	}
+
+	instr_end();
+
+	return 0;
+}
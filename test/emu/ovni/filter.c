@@ -0,0 +1,40 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include <stdint.h>
+#include "instr.h"
+#include "ovni.h"
+
+/* Events of filtered models must not reach the stream. Here the nosv model is
+ * not required, so the emulator would reject the trace if any nosv event is
+ * emitted. The OVNI_FILTER environment variable also disables the MPI model. */
+
+INSTR_2ARG(instr_nosv_task_create, "VTc", uint32_t, taskid, uint32_t, typeid)
+INSTR_0ARG(instr_mpi_init_enter, "MUi")
+
+int
+main(void)
+{
+	instr_start(0, 1);
+
+	ovni_filter_disable("V");
+
+	for (uint32_t i = 1; i <= 100; i++)
+		instr_nosv_task_create(i, 1);
+
+	instr_mpi_init_enter();
+
+	/* Only keep the task category disabled */
+	ovni_filter_enable("V");
+	ovni_filter_disable("VT");
+
+	struct ovni_ev evs[2] = {0};
+	ovni_ev_set_mcv(&evs[0], "VTc");
+	ovni_ev_set_mcv(&evs[1], "OHp");
+	ovni_ev_emit_many(evs, 2);
+	instr_thread_resume();
+
+	instr_end();
+
+	return 0;
+}
@@ -2,5 +2,6 @@ target=$OVNI_TEST_BIN
 
 mkdir tmp
 export OVNI_TMPDIR=tmp
-$target
+OVNI_TMPDIR_REPORT=1 $target 2> report.log
+grep -q "moved .* files .* from OVNI_TMPDIR" report.log
 ovniemu ovni
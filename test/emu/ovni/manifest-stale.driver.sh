@@ -0,0 +1,26 @@
+# A stale manifest which lists a removed loom falls back to the directory
+# walk instead of failing to load the trace
+for i in $(seq 0 1); do
+  OVNI_RANK=$i OVNI_NRANKS=2 $OVNI_TEST_BIN
+done
+
+# A malformed line is also walked instead
+cp ovni/manifest manifest.orig
+echo "garbage" >> ovni/manifest
+ovniemu ovni 2> emu.log
+grep -q "malformed manifest line" emu.log
+grep -q "loaded 2 streams" emu.log
+
+# As well as a process on disk which is not listed
+loom=$(ls -d ovni/loom.* | head -1)
+grep -v "$(basename "$loom")" manifest.orig > ovni/manifest
+ovniemu ovni 2> emu.log
+grep -q "is not in the manifest" emu.log
+grep -q "loaded 2 streams" emu.log
+
+cp manifest.orig ovni/manifest
+rm -rf "$loom"
+
+ovniemu ovni 2> emu.log
+grep -q "in the manifest is missing" emu.log
+grep -q "loaded 1 streams" emu.log
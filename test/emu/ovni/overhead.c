@@ -0,0 +1,30 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "instr.h"
+#include "ovni.h"
+
+/* Emits many events and flushes, so the instrumentation overhead of the
+ * thread can be measured by the emulator */
+
+#define NEVENTS 20000
+
+int
+main(void)
+{
+	instr_start(0, 1);
+
+	for (int i = 0; i < NEVENTS; i++) {
+		struct ovni_ev ev = {0};
+		ovni_ev_set_mcv(&ev, "OB.");
+		ovni_ev_set_clock(&ev, ovni_clock_now());
+		ovni_ev_emit(&ev);
+
+		if (i % 1000 == 0)
+			ovni_flush();
+	}
+
+	instr_end();
+
+	return 0;
+}
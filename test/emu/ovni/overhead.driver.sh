@@ -0,0 +1,40 @@
+# The emit cost is calibrated and the overhead written per thread
+$OVNI_TEST_BIN
+
+grep -q '"calib"' ovni/loom.*/proc.*/thread.*/stream.json
+
+ovniemu ovni 2> emu.log
+grep -q 'instrumentation overhead: [0-9.]*% of the thread time' emu.log
+
+# Only the aggregate is reported, the threads go to the table
+if grep -q 'overhead of thread' emu.log; then
+  exit 1
+fi
+head -1 ovni/overhead.csv | grep -q '^thread,tid,events,emit_ns,flush_ns,lifetime_ns,overhead_pct$'
+grep -q '^thread\.[0-9]*,[0-9]*,[0-9]*,[0-9]*,[0-9]*,[0-9]*,[0-9.]*$' ovni/overhead.csv
+
+# The compensation requires the summary mode
+if ovniemu -k ovni; then
+  exit 1
+fi
+
+# Time running of the thread state (type 4) in the summary
+running() {
+  awk -F, '$1 == "all" && $4 == 4 && $6 == 1 { print $8 }' ovni/thread.summary.csv
+}
+
+ovniemu -s ovni
+t0=$(running)
+ovniemu -s -k ovni
+t1=$(running)
+
+# The compensated running time is shorter
+test "$t1" -lt "$t0"
+
+# Without calibration there is no emit cost in the metadata
+rm -rf ovni
+OVNI_CALIBRATE=0 $OVNI_TEST_BIN
+if grep -q '"calib"' ovni/loom.*/proc.*/thread.*/stream.json; then
+  exit 1
+fi
+ovniemu ovni 2>&1 | grep -q 'no emit cost calibration'
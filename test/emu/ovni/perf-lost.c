@@ -0,0 +1,31 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "instr.h"
+#include "../kernel/instr_kernel.h"
+
+/* Emits unpaired context switches, as when perf loses some records, which
+ * the emulator must ignore as ovni.perf.lost is set */
+
+int
+main(void)
+{
+	instr_start(0, 1);
+	instr_kernel_init();
+
+	ovni_attr_set_double("ovni.perf.lost", 2);
+
+	/* Missing KCI in between */
+	instr_kernel_cs_out();
+	instr_kernel_cs_out();
+	instr_kernel_cs_in();
+
+	/* Missing KCO in between */
+	instr_kernel_cs_in();
+	instr_kernel_cs_out();
+	instr_kernel_cs_in();
+
+	instr_end();
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "compat.h"
+#include "instr.h"
+
+/* Sleep to cause context switches, which are captured with perf when
+ * OVNI_PERF_SWITCH=1 and merged in the stream in clock order. If perf is
+ * not available, the trace is still valid without them. */
+
+int
+main(void)
+{
+	instr_start(0, 1);
+
+	for (int i = 0; i < 100; i++) {
+		instr_thread_pause();
+		sleep_us(100);
+		instr_thread_resume();
+
+		/* Merge some of them in intermediate flushes */
+		if (i % 10 == 0)
+			ovni_flush();
+	}
+
+	instr_end();
+
+	return 0;
+}
@@ -0,0 +1,12 @@
+# The context switches are captured with perf when available
+OVNI_PERF_SWITCH=1 $OVNI_TEST_BIN 2> run.log
+ovniemu -l ovni
+
+if grep -q "perf_event_open failed" run.log; then
+  echo "perf events not available, skipping"
+  exit 77
+fi
+
+ovnidump ovni > dump.txt
+grep -q KCO dump.txt
+grep -q KCI dump.txt
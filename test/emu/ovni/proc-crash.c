@@ -0,0 +1,20 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include <ovni.h>
+#include "instr.h"
+
+/* Emulate a crash of the whole process by neither freeing the thread nor
+ * calling ovni_proc_fini(). The process is not marked as ended in the trace
+ * manifest, so its streams must be found from the process manifest and
+ * then rejected as they are not finished. */
+
+int
+main(void)
+{
+	instr_start(0, 1);
+
+	ovni_flush();
+
+	return 0;
+}
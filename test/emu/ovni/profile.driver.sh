@@ -0,0 +1,34 @@
+# Only the PRV types and rows selected by the output profile are written,
+# and the rest of types are left out of the PCF.
+$OVNI_TEST_BIN
+
+types() {
+  awk -F: 'NR>1 {print $7}' "$1" | sort -u | tr '\n' ' '
+}
+
+ovniemu -l -O "thread type 4,7;cpu skip 1-3" ovni
+test "$(types ovni/thread.prv)" = "4 7 "
+test "$(types ovni/cpu.prv)" = "7 "
+if grep -q "TID of the ACTIVE thread" ovni/thread.pcf; then
+  exit 1
+fi
+
+# The same from a file, also selecting the rows
+rm -rf ovni/cfg
+cat > profile.txt <<EOT
+# Nothing from the thread trace
+thread row 100
+cpu type 1-10
+EOT
+ovniemu -l -o profile.txt ovni
+test "$(types ovni/thread.prv)" = ""
+test "$(types ovni/cpu.prv)" = "1 2 3 7 "
+
+# Bad rules are rejected
+if ovniemu -O "thread kind 1" ovni; then
+  exit 1
+fi
+
+# Unknown trace names are warned
+ovniemu -O "thraed type 4" ovni 2> emu.log
+grep -q "unknown trace 'thraed'" emu.log
@@ -0,0 +1,72 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include <stdint.h>
+#include <string.h>
+#include "instr.h"
+#include "ovni.h"
+
+/* Build events directly in the thread buffer with the reserve and commit API,
+ * forcing some flushes in the middle, and emit grouped events. */
+
+static void
+emit_reserved(const char *mcv)
+{
+	struct ovni_ev ev = {0};
+	ovni_ev_set_clock(&ev, (uint64_t) get_clock());
+	ovni_ev_set_mcv(&ev, mcv);
+
+	size_t size = (size_t) ovni_ev_size(&ev);
+	struct ovni_ev *dst = ovni_ev_reserve(size);
+	memcpy(dst, &ev, size);
+	ovni_ev_commit();
+}
+
+static void
+emit_jumbo_reserved(size_t n)
+{
+	struct ovni_ev ev = {0};
+	ovni_ev_set_clock(&ev, (uint64_t) get_clock());
+	ovni_ev_set_mcv(&ev, "OB.");
+
+	uint32_t nbytes = (uint32_t) (n * sizeof(int64_t));
+	uint8_t *buf = ovni_ev_jumbo_reserve(&ev, nbytes);
+
+	/* Serialize the values in place */
+	for (size_t i = 0; i < n; i++) {
+		int64_t v = (int64_t) i;
+		memcpy(&buf[i * sizeof(v)], &v, sizeof(v));
+	}
+
+	ovni_ev_commit();
+}
+
+int
+main(void)
+{
+	instr_start(0, 1);
+
+	/* Each jumbo event fills 40 % of the buffer, so some will flush */
+	size_t n = (size_t) (0.4 * (double) OVNI_MAX_EV_BUF) / sizeof(int64_t);
+	for (int i = 0; i < 5; i++) {
+		emit_jumbo_reserved(n);
+		emit_reserved("OHp");
+		emit_reserved("OHr");
+	}
+
+	struct ovni_ev evs[2] = {0};
+	ovni_ev_set_mcv(&evs[0], "OHp");
+	ovni_ev_set_mcv(&evs[1], "OHr");
+
+	/* Fill the buffer a few times, so some groups flush before them */
+	size_t ngroups = 3 * (size_t) OVNI_MAX_EV_BUF / (2 * sizeof(struct ovni_ev_header));
+	for (size_t i = 0; i < ngroups; i++)
+		ovni_ev_emit_many(evs, 2);
+
+	if (ovni_ev_get_clock(&evs[0]) != ovni_ev_get_clock(&evs[1]))
+		die("grouped events have different clocks");
+
+	instr_end();
+
+	return 0;
+}
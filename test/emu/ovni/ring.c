@@ -0,0 +1,69 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "instr.h"
+#include "ovni.h"
+
+/* Fill the flight recorder ring several times, so the first events are
+ * dropped, then trigger the dump and fill it again, so the events after the
+ * dump are dropped too. The emulator must accept the stream that begins in
+ * the middle of the execution and has a gap after the first dump. */
+
+static void
+emit_jumbo(uint8_t *buf, size_t size)
+{
+	struct ovni_ev ev = {0};
+	ovni_ev_set_mcv(&ev, "OB.");
+	ovni_ev_set_clock(&ev, (uint64_t) get_clock());
+	ovni_ev_jumbo_emit(&ev, buf, (uint32_t) size);
+}
+
+int
+main(void)
+{
+	instr_start(0, 1);
+	ovni_add_cpu(1, 1);
+
+	size_t size = (size_t) (0.3 * (double) OVNI_MAX_EV_BUF);
+	uint8_t *buf = calloc(1, size);
+	if (buf == NULL)
+		die("calloc failed:");
+
+	/* Leave the thread paused at some ring rotations */
+	for (int i = 0; i < 20; i++) {
+		emit_jumbo(buf, size);
+		if (i % 3 == 0) {
+			instr_thread_pause();
+			emit_jumbo(buf, size);
+			instr_thread_resume();
+		}
+	}
+
+	ovni_ring_trigger();
+
+	/* Move to another CPU and end paused over several buffers, so the
+	 * events of the last dump begin in a different state */
+	for (int i = 0; i < 20; i++) {
+		emit_jumbo(buf, size);
+		if (i == 10)
+			instr_thread_affinity_set(1);
+		if (i % 3 == 1) {
+			instr_thread_pause();
+			emit_jumbo(buf, size);
+			instr_thread_resume();
+		}
+	}
+
+	instr_thread_pause();
+	for (int i = 0; i < 5; i++)
+		emit_jumbo(buf, size);
+	instr_thread_resume();
+
+	free(buf);
+
+	instr_end();
+
+	return 0;
+}
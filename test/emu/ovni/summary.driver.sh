@@ -0,0 +1,36 @@
+# The summary must give the same time in each thread state as the PRV
+$OVNI_TEST_BIN
+
+ovniemu -l ovni
+
+# Time in each value of the thread state (type 4) from the PRV, where the
+# last value lasts until the end of the trace
+awk -F: 'NR==1 { split($3, a, "_"); end = a[1] + 0 }
+  NR>1 && $7 == 4 {
+    if (last[$5]) t[last[$5]] += $6 - since[$5]
+    last[$5] = $8; since[$5] = $6
+  }
+  END {
+    for (r in last) if (last[r]) t[last[r]] += end - since[r]
+    for (v in t) print v, t[v]
+  }' ovni/thread.prv | sort > prv.txt
+
+rm -rf ovni/*.prv ovni/*.pcf ovni/*.row ovni/cfg
+ovniemu -l -s ovni
+
+# No Paraver trace is written
+test ! -e ovni/thread.prv
+test ! -e ovni/thread.pcf
+test ! -e ovni/cfg
+
+awk -F, '$1 == "all" && $4 == 4 { print $6, $8 }' ovni/thread.summary.csv \
+  | sort > summary.txt
+cmp prv.txt summary.txt
+
+# The rows of each process add up to the process time
+awk -F, '$1 == "row" && $4 == 4 { t[$6] += $8 } END { for (v in t) print v, t[v] }' \
+  ovni/thread.summary.csv | sort > rows.txt
+awk -F, '$1 == "group" && $4 == 4 { print $6, $8 }' ovni/thread.summary.csv \
+  | sort > group.txt
+cmp rows.txt group.txt
+test -s ovni/cpu.summary.csv
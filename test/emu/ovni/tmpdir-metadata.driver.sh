@@ -53,3 +53,28 @@ test_no_files() {
   test_no_files "tmp"
   ovniemu ovni
 )
+
+# Move the threads with workers at ovni_proc_fini()
+(
+  rm -rf tmp ovni
+  mkdir tmp
+  export OVNI_TMPDIR=tmp
+  export OVNI_TMPDIR_WORKERS=4
+  $target
+  test_files "ovni"
+  test_no_files "tmp"
+  ovniemu ovni
+)
+
+# Copy from another filesystem if available
+if [ -d /dev/shm ] && [ -w /dev/shm ]; then
+(
+  rm -rf ovni
+  shmdir=$(mktemp -u /dev/shm/ovni-test.XXXXXX)
+  export OVNI_TMPDIR="$shmdir"
+  $target
+  test_files "ovni"
+  test_no_files "$shmdir"
+  ovniemu ovni
+)
+fi
@@ -117,6 +117,7 @@ function(ovni_test source)
     PROPERTIES
       TIMEOUT 60
       RUN_SERIAL TRUE
+      SKIP_RETURN_CODE 77
       ENVIRONMENT "${OVNI_TEST_ENV}"
       WORKING_DIRECTORY "${OVNI_TEST_BUILD_DIR}")
 
@@ -0,0 +1,114 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include "emu/arena.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "common.h"
+#include "unittest.h"
+
+static void
+check_zero(const char *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (p[i] != 0)
+			die("byte %zu is not zero", i);
+	}
+}
+
+static void
+test_small(void)
+{
+	struct arena arena;
+	arena_init(&arena);
+
+	char *prev = NULL;
+	for (size_t i = 0; i < 100000; i++) {
+		size_t n = 1 + i % 100;
+		char *p = arena_calloc(&arena, n, 1);
+		if (p == NULL)
+			die("arena_calloc failed");
+
+		if ((uintptr_t) p % _Alignof(max_align_t) != 0)
+			die("object %zu not aligned", i);
+
+		check_zero(p, n);
+
+		/* Overwrite it all to catch overlaps */
+		memset(p, 0xff, n);
+
+		if (prev != NULL && p == prev)
+			die("same object returned twice");
+		prev = p;
+	}
+
+	if (arena.nobjects != 100000)
+		die("wrong number of objects %zu", arena.nobjects);
+
+	/* Only a few blocks needed */
+	if (arena.nblocks > 16)
+		die("too many blocks %zu", arena.nblocks);
+
+	arena_destroy(&arena);
+
+	if (arena.blocks != NULL || arena.nobjects != 0)
+		die("arena not empty after destroy");
+
+	err("OK");
+}
+
+static void
+test_big(void)
+{
+	struct arena arena;
+	arena_init(&arena);
+
+	char *a = arena_calloc(&arena, 1, 16);
+	if (a == NULL)
+		die("arena_calloc failed");
+
+	/* Larger than a block */
+	size_t n = 4 * 1024 * 1024;
+	char *big = arena_calloc(&arena, n, 1);
+	if (big == NULL)
+		die("arena_calloc failed");
+	check_zero(big, n);
+	memset(big, 0xff, n);
+
+	/* The small objects continue in the same block */
+	char *b = arena_calloc(&arena, 1, 16);
+	if (b == NULL)
+		die("arena_calloc failed");
+
+	if (b != a + 16)
+		die("small object not placed after the previous one");
+
+	/* Overflow */
+	if (arena_calloc(&arena, SIZE_MAX / 2, 4) != NULL)
+		die("arena_calloc didn't fail");
+
+	arena_destroy(&arena);
+	err("OK");
+}
+
+static void
+test_no_arena(void)
+{
+	char *p = arena_calloc(NULL, 10, 10);
+	if (p == NULL)
+		die("arena_calloc failed");
+	check_zero(p, 100);
+	arena_free(NULL, p);
+	err("OK");
+}
+
+int
+main(void)
+{
+	test_small();
+	test_big();
+	test_no_arena();
+
+	return 0;
+}
@@ -1,4 +1,4 @@
-/* Copyright (c) 2021-2023 Barcelona Supercomputing Center (BSC)
+/* Copyright (c) 2021-2024 Barcelona Supercomputing Center (BSC)
  * SPDX-License-Identifier: GPL-3.0-or-later */
 
 #include <stddef.h>
@@ -61,6 +61,109 @@ test_callback(struct bay *bay)
 		die("data didn't change after bay_propagate");
 }
 
+struct sum {
+	struct chan *a;
+	struct chan *b;
+	struct chan *out;
+};
+
+/* Writes the sum of both channels in the output */
+static int
+cb_sum(struct chan *chan, void *ptr)
+{
+	UNUSED(chan);
+	struct sum *sum = ptr;
+	struct value a, b;
+	OK(chan_read(sum->a, &a));
+	OK(chan_read(sum->b, &b));
+
+	int64_t x = a.type == VALUE_INT64 ? a.i : 0;
+	int64_t y = b.type == VALUE_INT64 ? b.i : 0;
+
+	return chan_set(sum->out, value_int64(x + y));
+}
+
+/* Checks that the output only runs its callbacks after all the inputs are
+ * updated, even if it becomes dirty before one of its inputs */
+static void
+test_levels(void)
+{
+	struct bay bay;
+	bay_init(&bay);
+
+	struct chan s1, s2, mid, out;
+	chan_init(&s1, CHAN_SINGLE, "s1");
+	chan_init(&s2, CHAN_SINGLE, "s2");
+	chan_init(&mid, CHAN_SINGLE, "mid");
+	chan_init(&out, CHAN_SINGLE, "out");
+	chan_prop_set(&out, CHAN_DIRTY_WRITE, 1);
+	chan_prop_set(&out, CHAN_ALLOW_DUP, 1);
+
+	OK(bay_register(&bay, &s1));
+	OK(bay_register(&bay, &s2));
+	OK(bay_register(&bay, &mid));
+	OK(bay_register(&bay, &out));
+
+	/* mid = s1 + s1 and out = mid + s2 */
+	struct sum smid = { &s1, &s1, &mid };
+	struct sum sout = { &mid, &s2, &out };
+	if (bay_add_cb(&bay, BAY_CB_DIRTY, &s1, cb_sum, &smid, 1) == NULL)
+		die("bay_add_cb failed");
+	if (bay_add_cb(&bay, BAY_CB_DIRTY, &mid, cb_sum, &sout, 1) == NULL)
+		die("bay_add_cb failed");
+	if (bay_add_cb(&bay, BAY_CB_DIRTY, &s2, cb_sum, &sout, 1) == NULL)
+		die("bay_add_cb failed");
+
+	struct bay_dep *dmid = bay_add_dep(&bay, &mid, 1);
+	struct bay_dep *dout = bay_add_dep(&bay, &out, 1);
+	if (dmid == NULL || dout == NULL)
+		die("bay_add_dep failed");
+
+	OK(bay_dep_input(dmid, &s1));
+	OK(bay_dep_input(dout, &mid));
+	OK(bay_dep_input(dout, &s2));
+	OK(bay_compile(&bay));
+
+	/* Record the output value seen by its dirty callback */
+	int64_t seen = 0;
+	if (bay_add_cb(&bay, BAY_CB_DIRTY, &out, callback, &seen, 1) == NULL)
+		die("bay_add_cb failed");
+
+	/* The s2 channel makes out dirty before mid is updated */
+	OK(chan_set(&s2, value_int64(1)));
+	OK(chan_set(&s1, value_int64(10)));
+	OK(bay_propagate(&bay));
+
+	if (seen != 21)
+		die("out callback saw %"PRIi64" instead of 21", seen);
+
+	err("OK");
+}
+
+static void
+test_cycle(void)
+{
+	struct bay bay;
+	bay_init(&bay);
+
+	struct chan a, b;
+	chan_init(&a, CHAN_SINGLE, "a");
+	chan_init(&b, CHAN_SINGLE, "b");
+	OK(bay_register(&bay, &a));
+	OK(bay_register(&bay, &b));
+
+	struct bay_dep *da = bay_add_dep(&bay, &a, 1);
+	struct bay_dep *db = bay_add_dep(&bay, &b, 1);
+	if (da == NULL || db == NULL)
+		die("bay_add_dep failed");
+
+	OK(bay_dep_input(db, &a));
+	OK(bay_dep_input(da, &b));
+	ERR(bay_compile(&bay));
+
+	err("OK");
+}
+
 int main(void)
 {
 	struct bay bay;
@@ -68,6 +171,8 @@ int main(void)
 
 	test_duplicate(&bay);
 	test_callback(&bay);
+	test_levels();
+	test_cycle();
 
 	return 0;
 }
@@ -10,7 +10,7 @@
 
 int main(void)
 {
-	if (cfg_generate(".") != 0)
+	if (cfg_generate(".", NULL) != 0)
 		die("cfg_generate failed");
 
 	/* Check that one configuration file is present */
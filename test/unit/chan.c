@@ -117,12 +117,53 @@ test_ignore_dup(void)
 	err("OK");
 }
 
+/* Test that a stack channel with CHAN_IGNORE_UNMATCHED ignores the pops of
+ * values not in the stack and discards the values above the popped one */
+static void
+test_ignore_unmatched(void)
+{
+	struct chan chan;
+	chan_init(&chan, CHAN_STACK, "testchan");
+
+	/* Fails without the flag */
+	ERR(chan_pop(&chan, value_int64(1)));
+
+	chan_prop_set(&chan, CHAN_IGNORE_UNMATCHED, 1);
+
+	/* Empty stack */
+	OK(chan_pop(&chan, value_int64(1)));
+
+	OK(chan_push(&chan, value_int64(1)));
+	OK(chan_flush(&chan));
+	OK(chan_push(&chan, value_int64(2)));
+	OK(chan_flush(&chan));
+	OK(chan_push(&chan, value_int64(3)));
+	OK(chan_flush(&chan));
+
+	/* Not in the stack */
+	OK(chan_pop(&chan, value_int64(4)));
+	if (chan.data.stack.n != 3)
+		die("stack modified by unmatched pop");
+
+	/* Discards the 3 above */
+	OK(chan_pop(&chan, value_int64(2)));
+	OK(chan_flush(&chan));
+
+	struct value top, one = value_int64(1);
+	OK(chan_read(&chan, &top));
+	if (!value_is_equal(&top, &one))
+		die("unexpected top of stack");
+
+	err("OK");
+}
+
 int main(void)
 {
 	test_single();
 	test_dirty();
 	test_allow_dup();
 	test_ignore_dup();
+	test_ignore_unmatched();
 
 	return 0;
 }
@@ -144,6 +144,59 @@ test_duplicate_output(struct mux *mux, int key1, int key2)
 	err("OK");
 }
 
+static struct chan *sparse_chan = NULL;
+
+static int
+sparse_input(struct mux *mux, int64_t index, struct chan **chan)
+{
+	UNUSED(mux);
+	UNUSED(index);
+	*chan = sparse_chan;
+	return 0;
+}
+
+/* The sparse input has no channel when first selected, so the mux uses the
+ * default until it is refreshed */
+static void
+test_sparse_refresh(void)
+{
+	struct bay bay;
+	bay_init(&bay);
+
+	struct chan input, output, select;
+	chan_init(&input, CHAN_SINGLE, "input");
+	chan_init(&output, CHAN_SINGLE, "output");
+	chan_init(&select, CHAN_SINGLE, "select");
+	OK(bay_register(&bay, &input));
+	OK(bay_register(&bay, &output));
+	OK(bay_register(&bay, &select));
+
+	struct mux mux;
+	OK(mux_init_sparse(&mux, &bay, &select, &output, sparse_input, NULL, N));
+	OK(bay_compile(&bay));
+
+	OK(chan_set(&input, value_int64(1000)));
+	OK(chan_set(&select, value_int64(3)));
+	OK(bay_propagate(&bay));
+	check_output(&mux, value_null());
+
+	if (mux_get_input(&mux, 3) != NULL)
+		die("input without channel was created");
+
+	/* Now the channel exists */
+	sparse_chan = &input;
+	OK(mux_refresh(&mux));
+	OK(bay_propagate(&bay));
+	check_output(&mux, value_int64(1000));
+
+	/* Further changes reach the output */
+	OK(chan_set(&input, value_int64(2000)));
+	OK(bay_propagate(&bay));
+	check_output(&mux, value_int64(2000));
+
+	err("OK");
+}
+
 int
 main(void)
 {
@@ -188,6 +241,7 @@ main(void)
 	test_input_and_select(&mux, 4);
 	test_mid_propagate(&mux, 5);
 	test_duplicate_output(&mux, 6, 7);
+	test_sparse_refresh();
 
 	err("OK");
 
@@ -0,0 +1,183 @@
+/* Copyright (c) 2026 Barcelona Supercomputing Center (BSC)
+ * SPDX-License-Identifier: GPL-3.0-or-later */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "emu/pv/pcf.h"
+#include "emu/pv/prf.h"
+#include "emu/pv/strtab.h"
+#include "unittest.h"
+
+static void
+test_intern(void)
+{
+	struct strtab tab;
+	strtab_init(&tab);
+
+	char buf[64];
+	const char *first[1000];
+	for (int i = 0; i < 1000; i++) {
+		sprintf(buf, "label %d", i);
+		if ((first[i] = strtab_intern(&tab, buf)) == NULL)
+			die("strtab_intern failed");
+		if (strcmp(first[i], buf) != 0)
+			die("wrong label %s", first[i]);
+	}
+
+	/* The same pointer is returned for an equal string */
+	for (int i = 0; i < 1000; i++) {
+		sprintf(buf, "label %d", i);
+		if (strtab_intern(&tab, buf) != first[i])
+			die("label %d interned twice", i);
+	}
+
+	if (tab.n != 1000)
+		die("wrong number of strings %zu", tab.n);
+
+	strtab_destroy(&tab);
+
+	err("OK");
+}
+
+static void
+test_values(void)
+{
+	struct pcf pcf;
+	OK(pcf_open(&pcf, NULL));
+
+	struct pcf_type *t = pcf_add_type(&pcf, 10, "Type");
+	if (t == NULL)
+		die("pcf_add_type failed");
+
+	/* Out of order, to exercise the sorted index */
+	int values[] = { 5, 1, 9, 3, 7, 2, 100, 0 };
+	char buf[64];
+	for (int i = 0; i < (int) ARRAYLEN(values); i++) {
+		sprintf(buf, "value %d", values[i]);
+		if (pcf_add_value(t, values[i], buf) == NULL)
+			die("pcf_add_value failed");
+	}
+
+	if (pcf_add_value(t, 9, "again") != NULL)
+		die("duplicated value accepted");
+
+	for (int i = 0; i < (int) ARRAYLEN(values); i++) {
+		struct pcf_value *v = pcf_find_value(t, values[i]);
+		if (v == NULL)
+			die("value %d not found", values[i]);
+		sprintf(buf, "value %d", values[i]);
+		if (strcmp(v->label, buf) != 0)
+			die("wrong label %s", v->label);
+	}
+
+	if (pcf_find_value(t, 4) != NULL || pcf_find_value(t, 1000) != NULL)
+		die("found missing value");
+
+	/* Written in insertion order */
+	for (int i = 0; i < (int) ARRAYLEN(values); i++) {
+		if (t->values[i].value != values[i])
+			die("value %d out of order", i);
+	}
+
+	/* Without file the values are kept */
+	OK(pcf_flush(&pcf));
+	if (pcf_find_value(t, 5) == NULL)
+		die("value lost on flush");
+
+	OK(pcf_close(&pcf));
+
+	err("OK");
+}
+
+static void
+test_flush(const char *path)
+{
+	struct pcf pcf;
+	OK(pcf_open(&pcf, (char *) path));
+
+	struct pcf_type *a = pcf_add_type(&pcf, 1, "Full");
+	struct pcf_type *b = pcf_add_type(&pcf, 2, "Empty");
+	if (a == NULL || b == NULL)
+		die("pcf_add_type failed");
+
+	if (pcf_add_value(a, 1, "one") == NULL)
+		die("pcf_add_value failed");
+
+	/* Only the type with values is written */
+	OK(pcf_flush(&pcf));
+	if (!a->is_written || b->is_written)
+		die("wrong types written");
+
+	if (pcf_add_value(a, 2, "two") != NULL)
+		die("value added to a written type");
+
+	/* The empty type is filled later */
+	if (pcf_add_value(b, 3, "three") == NULL)
+		die("pcf_add_value failed");
+
+	OK(pcf_close(&pcf));
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		die("fopen failed:");
+
+	char line[256];
+	int nfull = 0, nempty = 0, nthree = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (strstr(line, "Full"))
+			nfull++;
+		if (strstr(line, "Empty"))
+			nempty++;
+		if (strstr(line, "three"))
+			nthree++;
+	}
+	fclose(f);
+
+	if (nfull != 1 || nempty != 1 || nthree != 1)
+		die("wrong PCF file");
+
+	err("OK");
+}
+
+static void
+test_rows(const char *path)
+{
+	struct prf prf;
+	OK(prf_open(&prf, path, 3));
+
+	OK(prf_add(&prf, 0, "row 0"));
+	OK(prf_add(&prf, 2, "row 2"));
+	ERR(prf_add(&prf, 2, "again"));
+	OK(prf_set_group(&prf, 0, "group"));
+	OK(prf_set_group(&prf, 2, "group"));
+
+	if (prf.rows[0].group != prf.rows[2].group)
+		die("group not interned");
+
+	/* Not all rows are set yet */
+	OK(prf_flush(&prf));
+	if (prf.is_written)
+		die("written with rows missing");
+
+	OK(prf_add(&prf, 1, "row 1"));
+	OK(prf_flush(&prf));
+	if (!prf.is_written)
+		die("not written with all rows");
+
+	ERR(prf_add(&prf, 1, "late"));
+	OK(prf_close(&prf));
+
+	err("OK");
+}
+
+int main(void)
+{
+	test_intern();
+	test_values();
+	test_flush("ovni.pcf");
+	test_rows("ovni.row");
+
+	return 0;
+}
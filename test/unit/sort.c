@@ -2,6 +2,7 @@
  * SPDX-License-Identifier: GPL-3.0-or-later */
 
 #include "emu/sort.h"
+#include <stdlib.h>
 #include "bay.h"
 #include "chan.h"
 #include "common.h"
@@ -69,10 +70,81 @@ test_sort(void)
 	}
 }
 
+static int
+cmp_int64(const void *a, const void *b)
+{
+	int64_t aa = *(const int64_t *) a;
+	int64_t bb = *(const int64_t *) b;
+
+	return (aa > bb) - (aa < bb);
+}
+
+/* Change several inputs at once with random values, with many duplicates,
+ * and compare the outputs with the inputs sorted from scratch */
+static void
+test_sort_random(void)
+{
+	enum { NR = 1000, NSTEPS = 200 };
+	struct bay bay;
+	bay_init(&bay);
+
+	static struct chan inputs[NR];
+	static int64_t ref[NR];
+
+	for (int i = 0; i < NR; i++) {
+		chan_init(&inputs[i], CHAN_SINGLE, "input.%d", i);
+		OK(bay_register(&bay, &inputs[i]));
+		OK(chan_set(&inputs[i], value_int64(0)));
+	}
+
+	OK(bay_propagate(&bay));
+
+	struct sort sort;
+	OK(sort_init(&sort, &bay, NR, "sort1"));
+
+	for (int i = 0; i < NR; i++)
+		OK(sort_set_input(&sort, i, &inputs[i]));
+
+	srand(1234);
+	for (int step = 0; step < NSTEPS; step++) {
+		/* Change a few different inputs on each step */
+		int first = rand() % NR;
+		int nchanges = 1 + rand() % 8;
+		for (int j = 0; j < nchanges; j++) {
+			int i = (first + j) % NR;
+			struct value v;
+			OK(chan_read(&inputs[i], &v));
+
+			/* Always a different value */
+			v.i = (v.i + 1 + rand() % 19) % 20;
+			OK(chan_set(&inputs[i], v));
+		}
+
+		OK(bay_propagate(&bay));
+
+		for (int i = 0; i < NR; i++) {
+			struct value v;
+			OK(chan_read(&inputs[i], &v));
+			ref[i] = v.i;
+		}
+		qsort(ref, NR, sizeof(int64_t), cmp_int64);
+
+		/* Without check_output(), too verbose */
+		for (int i = 0; i < NR; i++) {
+			struct value v;
+			OK(chan_read(sort_get_output(&sort, i), &v));
+			if (v.i != ref[i])
+				die("output %d: found %"PRIi64" expected %"PRIi64,
+						i, v.i, ref[i]);
+		}
+	}
+}
+
 int
 main(void)
 {
 	test_sort();
+	test_sort_random();
 
 	err("OK\n");
 
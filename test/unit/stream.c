@@ -1,6 +1,8 @@
 /* Copyright (c) 2021-2024 Barcelona Supercomputing Center (BSC)
  * SPDX-License-Identifier: GPL-3.0-or-later */
 
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -87,10 +89,119 @@ test_bad(void)
 	err("OK");
 }
 
+/* Writes a stream with normal and jumbo events, where each event has the
+ * clock i and a payload filled with i */
+static void
+write_events(const char *dir, int n)
+{
+	OK(mkdir(dir, 0755));
+
+	char path[PATH_MAX];
+	sprintf(path, "%s/stream.obs", dir);
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL)
+		die("fopen failed:");
+
+	struct ovni_stream_header header;
+	memcpy(&header.magic, OVNI_STREAM_MAGIC, 4);
+	header.version = OVNI_STREAM_VERSION;
+
+	if (fwrite(&header, sizeof(header), 1, f) != 1)
+		die("fwrite failed:");
+
+	uint8_t data[5000];
+	for (int i = 1; i <= n; i++) {
+		struct ovni_ev ev = {0};
+		ovni_ev_set_mcv(&ev, "OB.");
+		ovni_ev_set_clock(&ev, (uint64_t) i);
+		memset(data, i, sizeof(data));
+
+		/* Jumbo events larger than a page every few events */
+		if (i % 7 == 0) {
+			ev.header.flags = OVNI_EV_JUMBO;
+			uint32_t size = sizeof(data);
+			if (fwrite(&ev.header, sizeof(ev.header), 1, f) != 1
+					|| fwrite(&size, sizeof(size), 1, f) != 1
+					|| fwrite(data, size, 1, f) != 1)
+				die("fwrite failed:");
+		} else {
+			ovni_payload_add(&ev, data, 2 + i % 15);
+			size_t size = (size_t) ovni_ev_size(&ev);
+			if (fwrite(&ev, size, 1, f) != 1)
+				die("fwrite failed:");
+		}
+	}
+
+	fclose(f);
+
+	sprintf(path, "%s/stream.json", dir);
+	write_dummy_json(path);
+}
+
+static void
+check_event(struct stream *stream, int i)
+{
+	struct ovni_ev *ev = stream_ev(stream);
+
+	if (ev == NULL)
+		die("missing event %d", i);
+
+	if (ovni_ev_get_clock(ev) != (uint64_t) i)
+		die("wrong clock %"PRIu64", expected %d", ovni_ev_get_clock(ev), i);
+
+	uint8_t *payload;
+	size_t size;
+	if (ev->header.flags & OVNI_EV_JUMBO) {
+		payload = ev->payload.jumbo.data;
+		size = ev->payload.jumbo.size;
+	} else {
+		payload = ev->payload.u8;
+		size = (size_t) ovni_payload_size(ev);
+	}
+
+	for (size_t j = 0; j < size; j++) {
+		if (payload[j] != (uint8_t) i)
+			die("wrong payload in event %d", i);
+	}
+}
+
+/* Read two streams interleaved with tiny limits, so the window slides and
+ * the mappings and files are released and recovered at every step */
+static void
+test_window(void)
+{
+	int n = 1000;
+	write_events("win1", n);
+	write_events("win2", n);
+
+	stream_set_limits(4096, 1);
+
+	struct stream s1, s2;
+	OK(stream_load(&s1, ".", "win1"));
+	OK(stream_load(&s2, ".", "win2"));
+
+	for (int i = 1; i <= n; i++) {
+		OK(stream_step(&s1));
+		OK(stream_step(&s2));
+		check_event(&s1, i);
+		check_event(&s2, i);
+	}
+
+	if (stream_step(&s1) != 1 || stream_step(&s2) != 1)
+		die("streams didn't finish");
+
+	if (s1.buf != NULL || s1.fd != -1)
+		die("finished stream not released");
+
+	err("OK");
+}
+
 int main(void)
 {
 	test_ok();
 	test_bad();
+	test_window();
 
 	return 0;
 }
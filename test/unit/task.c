@@ -22,7 +22,7 @@ test_parallel(void)
 	OK(task_type_create(&info, type_id, "parallel_task"));
 	OK(task_create(&info, type_id, task_id, TASK_FLAG_PARALLEL));
 
-	struct task *task = task_find(info.tasks, task_id);
+	struct task *task = task_find(&info, task_id);
 
 	if (task == NULL)
 		err("task_find failed");
@@ -54,9 +54,61 @@ test_parallel(void)
 	err("ok");
 }
 
+static void
+test_reclaim(void)
+{
+	struct task_info info;
+	struct task_stack stack;
+
+	memset(&info, 0, sizeof(info));
+	memset(&stack, 0, sizeof(stack));
+
+	OK(task_type_create(&info, 1, "task"));
+
+	/* Spread over several pages */
+	for (uint32_t id = 1; id <= 3 * TASK_PAGE_SIZE; id++) {
+		OK(task_create(&info, 1, id, 0));
+		struct task *task = task_find(&info, id);
+		if (task == NULL)
+			die("task_find failed");
+		OK(task_execute(&stack, task, 1));
+		OK(task_end(&stack, task, 1));
+
+		/* Gone as soon as it ends */
+		if (task_find(&info, id) != NULL)
+			die("task %u not reclaimed", id);
+	}
+
+	if (info.nlive != 0 || info.npeak != 1)
+		die("wrong counts: nlive=%ld npeak=%ld", info.nlive, info.npeak);
+
+	/* The ids of ended tasks cannot be used again */
+	ERR(task_create(&info, 1, 1, 0));
+
+	/* Tasks that can run again are kept */
+	OK(task_create(&info, 1, 5 * TASK_PAGE_SIZE, TASK_FLAG_RESURRECT));
+	struct task *task = task_find(&info, 5 * TASK_PAGE_SIZE);
+	OK(task_execute(&stack, task, 1));
+	OK(task_end(&stack, task, 1));
+	if (task_find(&info, 5 * TASK_PAGE_SIZE) != task)
+		die("resurrect task reclaimed");
+
+	/* And all of them with reclaim disabled */
+	task_set_reclaim(0);
+	OK(task_create(&info, 1, 6 * TASK_PAGE_SIZE, 0));
+	task = task_find(&info, 6 * TASK_PAGE_SIZE);
+	OK(task_execute(&stack, task, 1));
+	OK(task_end(&stack, task, 1));
+	ERR(task_execute(&stack, task, 1));
+	task_set_reclaim(1);
+
+	err("ok");
+}
+
 int main(void)
 {
 	test_parallel();
+	test_reclaim();
 
 	return 0;
 }